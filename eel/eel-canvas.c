@@ -1569,9 +1569,15 @@ eel_canvas_group_draw (EelCanvasItem  *item,
     EelCanvasGroup *group;
     GList *list;
     EelCanvasItem *child = NULL;
+    cairo_rectangle_int_t extents;
 
     group = EEL_CANVAS_GROUP (item);
 
+    /* Most children of a big group are nowhere near the exposed area;
+     * reject those against the extents before asking the region.
+     */
+    cairo_region_get_extents (region, &extents);
+
     for (list = group->item_list; list; list = list->next)
     {
         child = list->data;
@@ -1581,6 +1587,12 @@ eel_canvas_group_draw (EelCanvasItem  *item,
         {
             CdkRectangle child_rect;
 
+            if (child->x2 < extents.x || child->x1 >= extents.x + extents.width ||
+                    child->y2 < extents.y || child->y1 >= extents.y + extents.height)
+            {
+                continue;
+            }
+
             child_rect.x = child->x1;
             child_rect.y = child->y1;
             child_rect.width = child->x2 - child->x1 + 1;
@@ -33,6 +33,7 @@
 #include <glib-object.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 typedef struct
 {
@@ -449,6 +450,255 @@ eel_g_hash_table_safe_for_each (GHashTable *hash_table,
     g_list_free (flattened.values);
 }
 
+/* Arrays with fewer items per thread are not worth splitting. */
+#define SORT_MIN_ITEMS_PER_THREAD 4096
+#define SORT_MAX_THREADS 8
+#define SORT_INSERTION_THRESHOLD 16
+
+typedef struct
+{
+    gpointer *items;
+    gpointer *scratch;
+    gsize start;
+    gsize middle;
+    gsize end;
+    gboolean merge;
+    GCompareDataFunc compare_func;
+    gpointer user_data;
+} SortTask;
+
+static void
+merge_runs (gpointer *from,
+            gpointer *to,
+            gsize start,
+            gsize middle,
+            gsize end,
+            GCompareDataFunc compare_func,
+            gpointer user_data)
+{
+    gsize i, j, k;
+
+    i = start;
+    j = middle;
+    k = start;
+
+    /* Taking from the left run on ties keeps the sort stable. */
+    while (i < middle && j < end)
+    {
+        if ((* compare_func) (from[j], from[i], user_data) < 0)
+        {
+            to[k++] = from[j++];
+        }
+        else
+        {
+            to[k++] = from[i++];
+        }
+    }
+
+    memcpy (to + k, from + i, (middle - i) * sizeof (gpointer));
+    k += middle - i;
+    memcpy (to + k, from + j, (end - j) * sizeof (gpointer));
+}
+
+static void
+merge_sort (gpointer *items,
+            gpointer *scratch,
+            gsize start,
+            gsize end,
+            GCompareDataFunc compare_func,
+            gpointer user_data)
+{
+    gsize middle, i, j;
+    gpointer item;
+
+    if (end - start <= SORT_INSERTION_THRESHOLD)
+    {
+        for (i = start + 1; i < end; i++)
+        {
+            item = items[i];
+            for (j = i; j > start && (* compare_func) (item, items[j - 1], user_data) < 0; j--)
+            {
+                items[j] = items[j - 1];
+            }
+            items[j] = item;
+        }
+        return;
+    }
+
+    middle = start + (end - start) / 2;
+    merge_sort (items, scratch, start, middle, compare_func, user_data);
+    merge_sort (items, scratch, middle, end, compare_func, user_data);
+
+    if ((* compare_func) (items[middle - 1], items[middle], user_data) <= 0)
+    {
+        return;
+    }
+
+    memcpy (scratch + start, items + start, (end - start) * sizeof (gpointer));
+    merge_runs (scratch, items, start, middle, end, compare_func, user_data);
+}
+
+static gpointer
+sort_task_thread (gpointer data)
+{
+    SortTask *task;
+
+    task = data;
+
+    if (task->merge)
+    {
+        merge_runs (task->items, task->scratch,
+                    task->start, task->middle, task->end,
+                    task->compare_func, task->user_data);
+    }
+    else
+    {
+        merge_sort (task->items, task->scratch,
+                    task->start, task->end,
+                    task->compare_func, task->user_data);
+    }
+
+    return NULL;
+}
+
+/* Runs all tasks, the first one in the calling thread. */
+static void
+run_sort_tasks (SortTask *tasks,
+                guint n_tasks)
+{
+    GThread *threads[SORT_MAX_THREADS];
+    guint i;
+
+    for (i = 1; i < n_tasks; i++)
+    {
+        threads[i] = g_thread_new ("eel-sort", sort_task_thread, &tasks[i]);
+    }
+
+    sort_task_thread (&tasks[0]);
+
+    for (i = 1; i < n_tasks; i++)
+    {
+        g_thread_join (threads[i]);
+    }
+}
+
+/**
+ * eel_sort_pointers_parallel:
+ * @items: the array to sort
+ * @n_items: the number of items in @items
+ * @compare_func: comparison function, called with two items
+ * @user_data: data passed to @compare_func
+ *
+ * Stable merge sort of an array of pointers. Large arrays are split
+ * into runs that are sorted and then merged on several threads, so
+ * @compare_func must be safe to call from other threads than the
+ * calling one for as long as the sort runs.
+ */
+void
+eel_sort_pointers_parallel (gpointer *items,
+                            gsize n_items,
+                            GCompareDataFunc compare_func,
+                            gpointer user_data)
+{
+    SortTask tasks[SORT_MAX_THREADS];
+    gsize bounds[SORT_MAX_THREADS + 1];
+    gpointer *scratch, *from, *to, *swap;
+    guint n_runs, n_tasks, i;
+
+    g_return_if_fail (items != NULL || n_items == 0);
+    g_return_if_fail (compare_func != NULL);
+
+    if (n_items < 2)
+    {
+        return;
+    }
+
+    n_runs = MIN (g_get_num_processors (), SORT_MAX_THREADS);
+    n_runs = MIN (n_runs, n_items / SORT_MIN_ITEMS_PER_THREAD);
+
+    scratch = g_new (gpointer, n_items);
+
+    if (n_runs < 2)
+    {
+        merge_sort (items, scratch, 0, n_items, compare_func, user_data);
+        g_free (scratch);
+        return;
+    }
+
+    for (i = 0; i <= n_runs; i++)
+    {
+        bounds[i] = n_items * i / n_runs;
+    }
+
+    /* Sort each run in place. */
+    for (i = 0; i < n_runs; i++)
+    {
+        tasks[i].items = items;
+        tasks[i].scratch = scratch;
+        tasks[i].start = bounds[i];
+        tasks[i].middle = bounds[i + 1];
+        tasks[i].end = bounds[i + 1];
+        tasks[i].merge = FALSE;
+        tasks[i].compare_func = compare_func;
+        tasks[i].user_data = user_data;
+    }
+    run_sort_tasks (tasks, n_runs);
+
+    /* Merge neighbouring runs, going back and forth between the
+     * two buffers, until one run is left.
+     */
+    from = items;
+    to = scratch;
+    while (n_runs > 1)
+    {
+        n_tasks = 0;
+        for (i = 0; i < n_runs; i += 2)
+        {
+            tasks[n_tasks].items = from;
+            tasks[n_tasks].scratch = to;
+            tasks[n_tasks].start = bounds[i];
+            tasks[n_tasks].merge = TRUE;
+            tasks[n_tasks].compare_func = compare_func;
+            tasks[n_tasks].user_data = user_data;
+
+            if (i + 1 < n_runs)
+            {
+                tasks[n_tasks].middle = bounds[i + 1];
+                tasks[n_tasks].end = bounds[i + 2];
+            }
+            else
+            {
+                /* A leftover run only needs copying over; merging it
+                 * with an empty run does that.
+                 */
+                tasks[n_tasks].middle = bounds[i + 1];
+                tasks[n_tasks].end = bounds[i + 1];
+            }
+            n_tasks++;
+        }
+
+        run_sort_tasks (tasks, n_tasks);
+
+        for (i = 0; i < n_tasks; i++)
+        {
+            bounds[i] = tasks[i].start;
+        }
+        bounds[n_tasks] = n_items;
+        n_runs = n_tasks;
+
+        swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != items)
+    {
+        memcpy (items, from, n_items * sizeof (gpointer));
+    }
+
+    g_free (scratch);
+}
+
 int
 eel_round (double d)
 {
@@ -680,6 +930,45 @@ eel_test_predicate (gpointer data,
     return g_ascii_strcasecmp (data, callback_data) <= 0;
 }
 
+static int
+eel_test_compare_halves (gconstpointer a,
+                         gconstpointer b,
+                         gpointer user_data G_GNUC_UNUSED)
+{
+    /* Only compares half of each value, to check stability. */
+    return GPOINTER_TO_INT (a) / 2 - GPOINTER_TO_INT (b) / 2;
+}
+
+static gboolean
+eel_test_sort_pointers_parallel (gsize n_items)
+{
+    gpointer *items;
+    gsize i;
+    gboolean sorted;
+
+    items = g_new (gpointer, n_items);
+    for (i = 0; i < n_items; i++)
+    {
+        /* Pairs of equal keys, in reverse order of the pairs. */
+        items[i] = GINT_TO_POINTER (2 * (n_items - i / 2) + i % 2);
+    }
+
+    eel_sort_pointers_parallel (items, n_items, eel_test_compare_halves, NULL);
+
+    sorted = TRUE;
+    for (i = 1; i < n_items; i++)
+    {
+        if (GPOINTER_TO_INT (items[i - 1]) >= GPOINTER_TO_INT (items[i]))
+        {
+            sorted = FALSE;
+        }
+    }
+
+    g_free (items);
+
+    return sorted;
+}
+
 void
 eel_self_check_glib_extensions (void)
 {
@@ -776,6 +1065,13 @@ eel_self_check_glib_extensions (void)
     g_list_free (actual_passed);
     g_list_free (expected_failed);
     g_list_free (actual_failed);
+
+    /* eel_sort_pointers_parallel */
+
+    EEL_CHECK_BOOLEAN_RESULT (eel_test_sort_pointers_parallel (1), TRUE);
+    EEL_CHECK_BOOLEAN_RESULT (eel_test_sort_pointers_parallel (15), TRUE);
+    EEL_CHECK_BOOLEAN_RESULT (eel_test_sort_pointers_parallel (1000), TRUE);
+    EEL_CHECK_BOOLEAN_RESULT (eel_test_sort_pointers_parallel (100001), TRUE);
 }
 
 #endif /* !EEL_OMIT_SELF_CHECK */
@@ -67,6 +67,12 @@ void        eel_g_hash_table_safe_for_each              (GHashTable            *
         GHFunc                 callback,
         gpointer               callback_data);
 
+/* Arrays of pointers */
+void        eel_sort_pointers_parallel                  (gpointer              *items,
+        gsize                  n_items,
+        GCompareDataFunc       compare_func,
+        gpointer               user_data);
+
 /* NULL terminated string arrays (strv). */
 int         eel_g_strv_find                             (char                 **strv,
         const char            *find_me);
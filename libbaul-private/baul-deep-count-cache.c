@@ -0,0 +1,433 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   baul-deep-count-cache.c: Persistent cache of directory deep counts.
+
+   Copyright (C) 2026 CAFE Desktop.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/* The cache remembers, per directory, the totals of its direct
+ * children. A deep count can then skip reading and stat'ing the
+ * children of every directory whose device, inode, mtime and ctime
+ * did not change, and only has to stat the directories themselves.
+ *
+ * Changing the contents of a file in place does not touch the mtime of
+ * its directory, so file change notifications invalidate the parent
+ * directory explicitly. Changes made while nobody is watching are not
+ * seen, which is why the cache is off by default.
+ *
+ * The file is stored in the user cache directory in host byte order and
+ * is read back with a single mapping. It is only loaded by the threads
+ * that count or save; invalidations that come in before that are kept
+ * aside and applied once it is loaded, so the main thread never waits
+ * for the file.
+ */
+
+#include <config.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "baul-deep-count-cache.h"
+#include "baul-global-preferences.h"
+
+#define CACHE_MAGIC "BAULDCC1"
+#define CACHE_MAGIC_LENGTH 8
+
+/* Bound the size of the file and of the in-memory table. */
+#define CACHE_MAX_ENTRIES 500000
+
+#define CACHE_FLAG_SHOW_HIDDEN_FILES (1 << 0)
+
+/* How long invalidations pile up before they are written out, in
+ * microseconds.
+ */
+#define CACHE_FLUSH_DELAY (5 * G_USEC_PER_SEC)
+
+#define ALIGN_8(n) (((n) + 7) & ~((gsize) 7))
+
+/* On-disk record, followed by the NUL terminated path and the NUL
+ * separated subdirectory names, padded to 8 bytes.
+ */
+typedef struct
+{
+    guint64 device;
+    guint64 inode;
+    gint64 mtime;
+    gint64 mtime_nsec;
+    gint64 ctime;
+    gint64 ctime_nsec;
+    guint64 size;
+    guint64 size_on_disk;
+    guint32 directory_count;
+    guint32 file_count;
+    guint32 flags;
+    guint32 path_length;
+    guint32 subdirectories_length;
+    guint32 padding;
+} CacheRecord;
+
+typedef struct
+{
+    CacheRecord record;
+    char **subdirectories;
+} CacheEntry;
+
+static GMutex cache_mutex;
+static GHashTable *cache;
+static gboolean cache_dirty;
+
+/* Held from taking a snapshot until it is written, so that an older
+ * snapshot never replaces a newer file.
+ */
+static GMutex save_mutex;
+
+/* Paths invalidated and not applied to the cache yet. */
+static GMutex pending_mutex;
+static GHashTable *pending_invalidations;
+static gboolean flush_scheduled;
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+    g_strfreev (entry->subdirectories);
+    g_free (entry);
+}
+
+static char *
+get_cache_filename (void)
+{
+    return g_build_filename (g_get_user_cache_dir (), "baul", "deep-counts", NULL);
+}
+
+static char **
+split_subdirectories (const char *data,
+                      gsize       length)
+{
+    GPtrArray *names;
+    const char *p, *end;
+
+    names = g_ptr_array_new ();
+    end = data + length;
+    for (p = data; p < end; p += strlen (p) + 1)
+    {
+        g_ptr_array_add (names, g_strdup (p));
+    }
+    g_ptr_array_add (names, NULL);
+
+    return (char **) g_ptr_array_free (names, FALSE);
+}
+
+/* Called with the mutex held. */
+static void
+cache_ensure_loaded (void)
+{
+    GMappedFile *mapped_file;
+    CacheEntry *entry;
+    const char *data;
+    char *filename, *path;
+    gsize length, offset;
+    guint32 n_entries, i;
+
+    if (cache != NULL)
+    {
+        return;
+    }
+
+    cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                   g_free, (GDestroyNotify) cache_entry_free);
+
+    filename = get_cache_filename ();
+    mapped_file = g_mapped_file_new (filename, FALSE, NULL);
+    g_free (filename);
+    if (mapped_file == NULL)
+    {
+        return;
+    }
+
+    data = g_mapped_file_get_contents (mapped_file);
+    length = g_mapped_file_get_length (mapped_file);
+
+    if (length < 16 || memcmp (data, CACHE_MAGIC, CACHE_MAGIC_LENGTH) != 0)
+    {
+        g_mapped_file_unref (mapped_file);
+        return;
+    }
+
+    memcpy (&n_entries, data + CACHE_MAGIC_LENGTH, sizeof (n_entries));
+    offset = 16;
+
+    for (i = 0; i < n_entries && i < CACHE_MAX_ENTRIES; i++)
+    {
+        CacheRecord record;
+
+        if (offset + sizeof (record) > length)
+        {
+            break;
+        }
+        memcpy (&record, data + offset, sizeof (record));
+        offset += sizeof (record);
+
+        if (offset + record.path_length + 1 + record.subdirectories_length > length)
+        {
+            break;
+        }
+
+        path = g_strndup (data + offset, record.path_length);
+        offset += record.path_length + 1;
+
+        entry = g_new (CacheEntry, 1);
+        entry->record = record;
+        entry->subdirectories = split_subdirectories (data + offset,
+                                                      record.subdirectories_length);
+        offset = ALIGN_8 (offset + record.subdirectories_length);
+
+        g_hash_table_replace (cache, path, entry);
+    }
+
+    g_mapped_file_unref (mapped_file);
+}
+
+/* Called with the mutex held, after cache_ensure_loaded (). */
+static void
+cache_apply_invalidations (void)
+{
+    GHashTable *invalidations;
+    GHashTableIter iter;
+    const char *path;
+
+    g_mutex_lock (&pending_mutex);
+    invalidations = pending_invalidations;
+    pending_invalidations = NULL;
+    g_mutex_unlock (&pending_mutex);
+
+    if (invalidations == NULL)
+    {
+        return;
+    }
+
+    g_hash_table_iter_init (&iter, invalidations);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &path, NULL))
+    {
+        if (g_hash_table_remove (cache, path))
+        {
+            cache_dirty = TRUE;
+        }
+    }
+
+    g_hash_table_destroy (invalidations);
+}
+
+static gboolean
+record_matches (const CacheRecord *record,
+                const struct stat *statbuf,
+                gboolean           show_hidden_files)
+{
+    return record->device == (guint64) statbuf->st_dev &&
+           record->inode == (guint64) statbuf->st_ino &&
+           record->mtime == statbuf->st_mtim.tv_sec &&
+           record->mtime_nsec == statbuf->st_mtim.tv_nsec &&
+           record->ctime == statbuf->st_ctim.tv_sec &&
+           record->ctime_nsec == statbuf->st_ctim.tv_nsec &&
+           (record->flags & CACHE_FLAG_SHOW_HIDDEN_FILES) == (show_hidden_files ? CACHE_FLAG_SHOW_HIDDEN_FILES : 0);
+}
+
+gboolean
+baul_deep_count_cache_is_enabled (void)
+{
+    return g_settings_get_boolean (baul_preferences, BAUL_PREFERENCES_DEEP_COUNT_CACHE);
+}
+
+gboolean
+baul_deep_count_cache_lookup (const char              *path,
+                              const struct stat       *statbuf,
+                              gboolean                 show_hidden_files,
+                              BaulDeepCountCacheEntry *entry)
+{
+    CacheEntry *cache_entry;
+    gboolean found;
+
+    found = FALSE;
+
+    g_mutex_lock (&cache_mutex);
+    cache_ensure_loaded ();
+    cache_apply_invalidations ();
+
+    cache_entry = g_hash_table_lookup (cache, path);
+    if (cache_entry != NULL &&
+        record_matches (&cache_entry->record, statbuf, show_hidden_files))
+    {
+        entry->directory_count = cache_entry->record.directory_count;
+        entry->file_count = cache_entry->record.file_count;
+        entry->size = cache_entry->record.size;
+        entry->size_on_disk = cache_entry->record.size_on_disk;
+        entry->subdirectories = g_strdupv (cache_entry->subdirectories);
+        found = TRUE;
+    }
+
+    g_mutex_unlock (&cache_mutex);
+
+    return found;
+}
+
+void
+baul_deep_count_cache_store (const char                    *path,
+                             const struct stat             *statbuf,
+                             gboolean                       show_hidden_files,
+                             const BaulDeepCountCacheEntry *entry)
+{
+    CacheEntry *cache_entry;
+    guint i;
+
+    g_mutex_lock (&cache_mutex);
+    cache_ensure_loaded ();
+    cache_apply_invalidations ();
+
+    if (g_hash_table_size (cache) >= CACHE_MAX_ENTRIES &&
+        !g_hash_table_contains (cache, path))
+    {
+        g_mutex_unlock (&cache_mutex);
+        return;
+    }
+
+    cache_entry = g_new0 (CacheEntry, 1);
+    cache_entry->record.device = statbuf->st_dev;
+    cache_entry->record.inode = statbuf->st_ino;
+    cache_entry->record.mtime = statbuf->st_mtim.tv_sec;
+    cache_entry->record.mtime_nsec = statbuf->st_mtim.tv_nsec;
+    cache_entry->record.ctime = statbuf->st_ctim.tv_sec;
+    cache_entry->record.ctime_nsec = statbuf->st_ctim.tv_nsec;
+    cache_entry->record.size = entry->size;
+    cache_entry->record.size_on_disk = entry->size_on_disk;
+    cache_entry->record.directory_count = entry->directory_count;
+    cache_entry->record.file_count = entry->file_count;
+    cache_entry->record.flags = show_hidden_files ? CACHE_FLAG_SHOW_HIDDEN_FILES : 0;
+    cache_entry->record.path_length = strlen (path);
+    cache_entry->record.subdirectories_length = 0;
+    for (i = 0; entry->subdirectories != NULL && entry->subdirectories[i] != NULL; i++)
+    {
+        cache_entry->record.subdirectories_length += strlen (entry->subdirectories[i]) + 1;
+    }
+    cache_entry->subdirectories = entry->subdirectories != NULL ?
+                                  g_strdupv (entry->subdirectories) : g_new0 (char *, 1);
+
+    g_hash_table_replace (cache, g_strdup (path), cache_entry);
+    cache_dirty = TRUE;
+
+    g_mutex_unlock (&cache_mutex);
+}
+
+static gpointer
+cache_flush_thread (gpointer user_data G_GNUC_UNUSED)
+{
+    /* Let a burst of changes pile up before writing the file. */
+    g_usleep (CACHE_FLUSH_DELAY);
+
+    g_mutex_lock (&pending_mutex);
+    flush_scheduled = FALSE;
+    g_mutex_unlock (&pending_mutex);
+
+    baul_deep_count_cache_save ();
+
+    return NULL;
+}
+
+void
+baul_deep_count_cache_invalidate (const char *path)
+{
+    GThread *thread;
+    gboolean start_flush;
+
+    g_mutex_lock (&pending_mutex);
+    if (pending_invalidations == NULL)
+    {
+        pending_invalidations = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                       g_free, NULL);
+    }
+    g_hash_table_add (pending_invalidations, g_strdup (path));
+    start_flush = !flush_scheduled;
+    flush_scheduled = TRUE;
+    g_mutex_unlock (&pending_mutex);
+
+    /* Without a count to apply it, the invalidation would be lost
+     * when baul quits.
+     */
+    if (start_flush)
+    {
+        thread = g_thread_new ("baul-deep-count-cache", cache_flush_thread, NULL);
+        g_thread_unref (thread);
+    }
+}
+
+void
+baul_deep_count_cache_save (void)
+{
+    static const char padding[8] = { 0 };
+    GHashTableIter iter;
+    GByteArray *data;
+    CacheEntry *entry;
+    const char *path;
+    char *filename, *dirname;
+    guint32 n_entries;
+    guint i;
+
+    g_mutex_lock (&save_mutex);
+    g_mutex_lock (&cache_mutex);
+    cache_ensure_loaded ();
+    cache_apply_invalidations ();
+
+    if (!cache_dirty)
+    {
+        g_mutex_unlock (&cache_mutex);
+        g_mutex_unlock (&save_mutex);
+        return;
+    }
+
+    data = g_byte_array_new ();
+    n_entries = g_hash_table_size (cache);
+    g_byte_array_append (data, (const guint8 *) CACHE_MAGIC, CACHE_MAGIC_LENGTH);
+    g_byte_array_append (data, (const guint8 *) &n_entries, sizeof (n_entries));
+    g_byte_array_append (data, (const guint8 *) padding, 4);
+
+    g_hash_table_iter_init (&iter, cache);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &path, (gpointer *) &entry))
+    {
+        g_byte_array_append (data, (const guint8 *) &entry->record, sizeof (entry->record));
+        g_byte_array_append (data, (const guint8 *) path, entry->record.path_length + 1);
+        for (i = 0; entry->subdirectories[i] != NULL; i++)
+        {
+            g_byte_array_append (data, (const guint8 *) entry->subdirectories[i],
+                                 strlen (entry->subdirectories[i]) + 1);
+        }
+        g_byte_array_append (data, (const guint8 *) padding,
+                             ALIGN_8 (data->len) - data->len);
+    }
+
+    cache_dirty = FALSE;
+    g_mutex_unlock (&cache_mutex);
+
+    filename = get_cache_filename ();
+    dirname = g_path_get_dirname (filename);
+    g_mkdir_with_parents (dirname, 0700);
+    g_file_set_contents (filename, (const char *) data->data, data->len, NULL);
+    g_free (dirname);
+    g_free (filename);
+
+    g_mutex_unlock (&save_mutex);
+
+    g_byte_array_free (data, TRUE);
+}
@@ -0,0 +1,61 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   baul-deep-count-cache.h: Persistent cache of directory deep counts.
+
+   Copyright (C) 2026 CAFE Desktop.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef BAUL_DEEP_COUNT_CACHE_H
+#define BAUL_DEEP_COUNT_CACHE_H
+
+#include <sys/stat.h>
+#include <glib.h>
+
+/* The counts for the direct children of one directory, and the names
+ * of the subdirectories a deep count descends into.
+ */
+typedef struct
+{
+    guint directory_count;
+    guint file_count;
+    goffset size;
+    goffset size_on_disk;
+    char **subdirectories;
+} BaulDeepCountCacheEntry;
+
+/* Must be called from the main thread. */
+gboolean baul_deep_count_cache_is_enabled (void);
+
+/* These can be called from any thread, but all except invalidate load
+ * the cache file the first time, so they belong on a worker thread.
+ * An entry is only returned if the device, inode, mtime and ctime of
+ * the directory still match. The subdirectories of a returned entry
+ * must be freed with g_strfreev ().
+ */
+gboolean baul_deep_count_cache_lookup     (const char                    *path,
+					   const struct stat             *statbuf,
+					   gboolean                       show_hidden_files,
+					   BaulDeepCountCacheEntry       *entry);
+void     baul_deep_count_cache_store      (const char                    *path,
+					   const struct stat             *statbuf,
+					   gboolean                       show_hidden_files,
+					   const BaulDeepCountCacheEntry *entry);
+void     baul_deep_count_cache_invalidate (const char                    *path);
+void     baul_deep_count_cache_save       (void);
+
+#endif /* BAUL_DEEP_COUNT_CACHE_H */
@@ -25,11 +25,19 @@
 #include <config.h>
 #include <ctk/ctk.h>
 #include <libxml/parser.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
 
+#include <eel/eel-debug.h>
 #include <eel/eel-glib-extensions.h>
 
+#include "baul-deep-count-cache.h"
 #include "baul-directory-notify.h"
 #include "baul-directory-private.h"
 #include "baul-file-attributes.h"
@@ -56,9 +64,54 @@
 #endif
 
 #define DIRECTORY_LOAD_ITEMS_PER_CALLBACK 100
+/* Directory loads start with small batches to show something quickly
+ * and grow them up to this size.
+ */
+#define DIRECTORY_LOAD_MAX_ITEMS_PER_CALLBACK 2000
+
+/* Threads used to deep count local directories. */
+#define DEEP_COUNT_MAX_WORKERS 8
+/* How often partial deep counts are shown, in milliseconds. */
+#define DEEP_COUNT_PUBLISH_INTERVAL 250
+
+/* Async. jobs are budgeted per filesystem, so that a slow mount cannot
+ * use up every slot and stall loading of directories elsewhere. Each
+ * filesystem starts with ASYNC_JOBS_PER_FILESYSTEM slots and adapts
+ * up to the max depending on how long its jobs take. Only remote
+ * filesystems are shrunk below the starting budget, down to the min.
+ */
+#define ASYNC_JOBS_PER_FILESYSTEM 10
+#define ASYNC_JOBS_PER_FILESYSTEM_MIN 2
+#define ASYNC_JOBS_PER_FILESYSTEM_MAX 32
+
+/* Thumbnails are read and decoded in chunks of this size. */
+#define THUMBNAIL_READ_CHUNK_SIZE (64 * 1024)
 
 /* Keep async. jobs down to this number for all directories. */
-#define MAX_ASYNC_JOBS 10
+#define MAX_ASYNC_JOBS 64
+
+/* Average job latencies used to grow or shrink a filesystem budget. */
+#define ASYNC_JOB_FAST_LATENCY (50 * G_TIME_SPAN_MILLISECOND)
+#define ASYNC_JOB_SLOW_LATENCY (500 * G_TIME_SPAN_MILLISECOND)
+
+struct AsyncJobQueue
+{
+    char *filesystem_id;
+    int job_count;
+    int min_jobs;
+    int max_jobs;
+
+    /* Directories waiting for a slot, in FIFO order. Directories
+     * that are being viewed go ahead of the background ones.
+     */
+    GQueue waiting_visible;
+    GQueue waiting;
+
+    gint64 average_latency;
+    guint64 total_waits;
+    gint64 total_wait_time;
+    gint64 max_wait_time;
+};
 
 struct TopLeftTextReadState
 {
@@ -82,6 +135,12 @@ struct ThumbnailState
     BaulFile *file;
     gboolean trying_original;
     gboolean tried_original;
+
+    /* The image is decoded as it is read, a chunk at a time. */
+    GInputStream *stream;
+    GdkPixbufLoader *loader;
+    guint64 bytes_read;
+    guchar *buffer;
 };
 
 struct MountState
@@ -106,6 +165,7 @@ struct DirectoryLoadState
     GHashTable *load_mime_list_hash;
     BaulFile *load_directory_file;
     int load_file_count;
+    int batch_size;
 };
 
 struct MimeListState
@@ -139,6 +199,15 @@ struct DirectoryCountState
     int file_count;
 };
 
+typedef struct
+{
+    guint directory_count;
+    guint file_count;
+    guint unreadable_count;
+    goffset size;
+    goffset size_on_disk;
+} DeepCountTotals;
+
 struct DeepCountState
 {
     BaulDirectory *directory;
@@ -146,8 +215,21 @@ struct DeepCountState
     GFileEnumerator *enumerator;
     GFile *deep_count_location;
     GList *deep_count_subdirectories;
-    GArray *seen_deep_count_inodes;
+    GHashTable *seen_deep_count_inodes;
     char *fs_id;
+
+    /* Native deep count, see deep_count_native_start (). */
+    GMutex mutex;
+    GCond cond;
+    GQueue native_directories;
+    char *native_root;
+    dev_t native_device;
+    gboolean show_hidden_files;
+    gboolean use_cache;
+    int running_workers;
+    int busy_workers;
+    DeepCountTotals native_totals;
+    guint publish_timeout_id;
 };
 
 
@@ -190,7 +272,7 @@ typedef gboolean (* FileCheck) (BaulFile *);
 
 /* Current number of async. jobs. */
 static int async_job_count;
-static GHashTable *waiting_directories;
+static GHashTable *async_job_queues;
 #ifdef DEBUG_ASYNC_JOBS
 static GHashTable *async_jobs;
 #endif
@@ -365,14 +447,210 @@ baul_directory_verify_request_counts (BaulDirectory *directory)
 }
 #endif
 
+static void
+async_job_queue_free (AsyncJobQueue *queue)
+{
+    g_queue_clear (&queue->waiting_visible);
+    g_queue_clear (&queue->waiting);
+    g_free (queue->filesystem_id);
+    g_free (queue);
+}
+
+static void
+async_job_queues_free (void)
+{
+    if (async_job_queues != NULL)
+    {
+        g_hash_table_destroy (async_job_queues);
+        async_job_queues = NULL;
+    }
+}
+
+/* Returns a key identifying the filesystem the directory lives on.
+ * This is the id::filesystem of the directory if we already know it,
+ * or the scheme and authority of the URI until then.
+ */
+static char *
+get_filesystem_key (BaulDirectory *directory)
+{
+    BaulFile *file;
+    char *uri, *p;
+
+    file = directory->details->as_file;
+    if (file != NULL && file->details->filesystem_id != NULL)
+    {
+        return g_strdup (file->details->filesystem_id);
+    }
+
+    uri = baul_directory_get_uri (directory);
+    p = strstr (uri, "://");
+    if (p != NULL)
+    {
+        p = strchr (p + 3, '/');
+        if (p != NULL)
+        {
+            *p = '\0';
+        }
+    }
+
+    return uri;
+}
+
+static AsyncJobQueue *
+async_job_queue_get (BaulDirectory *directory)
+{
+    AsyncJobQueue *queue;
+    char *key;
+
+    /* Only switch queues while the directory has nothing going on,
+     * so that starts and ends stay balanced per filesystem.
+     */
+    if (directory->details->async_job_queue != NULL &&
+        (directory->details->async_job_count > 0 ||
+         directory->details->async_job_waiting_link != NULL))
+    {
+        return directory->details->async_job_queue;
+    }
+
+    if (async_job_queues == NULL)
+    {
+        async_job_queues = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                  NULL,
+                                                  (GDestroyNotify) async_job_queue_free);
+        eel_debug_call_at_shutdown (async_job_queues_free);
+    }
+
+    key = get_filesystem_key (directory);
+    queue = g_hash_table_lookup (async_job_queues, key);
+    if (queue == NULL)
+    {
+        queue = g_new0 (AsyncJobQueue, 1);
+        queue->filesystem_id = key;
+        queue->max_jobs = ASYNC_JOBS_PER_FILESYSTEM;
+        queue->min_jobs = g_file_is_native (directory->details->location) ?
+                          ASYNC_JOBS_PER_FILESYSTEM : ASYNC_JOBS_PER_FILESYSTEM_MIN;
+        g_queue_init (&queue->waiting_visible);
+        g_queue_init (&queue->waiting);
+        g_hash_table_insert (async_job_queues, queue->filesystem_id, queue);
+    }
+    else
+    {
+        g_free (key);
+    }
+
+    directory->details->async_job_queue = queue;
+    return queue;
+}
+
+static gboolean
+async_job_queue_is_full (AsyncJobQueue *queue)
+{
+    return queue->job_count >= queue->max_jobs ||
+           async_job_count >= MAX_ASYNC_JOBS;
+}
+
+static void
+async_job_queue_add_waiting (AsyncJobQueue *queue,
+                             BaulDirectory *directory)
+{
+    GQueue *waiting;
+
+    if (directory->details->async_job_waiting_link != NULL)
+    {
+        return;
+    }
+
+    /* Directories someone is looking at get served first. */
+    directory->details->async_job_waiting_visible =
+        baul_directory_is_anyone_monitoring_file_list (directory);
+    waiting = directory->details->async_job_waiting_visible ?
+              &queue->waiting_visible : &queue->waiting;
+
+    g_queue_push_tail (waiting, directory);
+    directory->details->async_job_waiting_link = waiting->tail;
+    directory->details->async_job_waiting_since = g_get_monotonic_time ();
+}
+
+static void
+async_job_queue_remove_waiting (BaulDirectory *directory)
+{
+    AsyncJobQueue *queue;
+    GQueue *waiting;
+    gint64 wait_time;
+
+    if (directory->details->async_job_waiting_link == NULL)
+    {
+        return;
+    }
+
+    queue = directory->details->async_job_queue;
+    waiting = directory->details->async_job_waiting_visible ?
+              &queue->waiting_visible : &queue->waiting;
+    g_queue_delete_link (waiting, directory->details->async_job_waiting_link);
+    directory->details->async_job_waiting_link = NULL;
+
+    wait_time = g_get_monotonic_time () - directory->details->async_job_waiting_since;
+    queue->total_waits += 1;
+    queue->total_wait_time += wait_time;
+    queue->max_wait_time = MAX (queue->max_wait_time, wait_time);
+}
+
+/* Grow the budget of filesystems that answer quickly while there is
+ * a backlog, and shrink it for the ones that are slow to answer.
+ */
+static void
+async_job_queue_record_latency (AsyncJobQueue *queue,
+                                gint64         latency)
+{
+    if (queue->average_latency == 0)
+    {
+        queue->average_latency = latency;
+    }
+    else
+    {
+        queue->average_latency += (latency - queue->average_latency) / 8;
+    }
+
+    if (queue->average_latency > ASYNC_JOB_SLOW_LATENCY)
+    {
+        if (queue->max_jobs > queue->min_jobs)
+        {
+            queue->max_jobs -= 1;
+        }
+    }
+    else if (queue->average_latency < ASYNC_JOB_FAST_LATENCY &&
+             (queue->waiting_visible.length > 0 || queue->waiting.length > 0))
+    {
+        if (queue->max_jobs < ASYNC_JOBS_PER_FILESYSTEM_MAX)
+        {
+            queue->max_jobs += 1;
+        }
+    }
+}
+
+/* Jobs that walk a whole directory take as long as the directory is
+ * big, so their duration says nothing about how fast the filesystem
+ * answers. Only the per-file jobs are used to adapt the budget.
+ */
+static gboolean
+async_job_measures_latency (const char *job)
+{
+    return strcmp (job, "file list") != 0 &&
+           strcmp (job, "directory count") != 0 &&
+           strcmp (job, "deep count") != 0 &&
+           strcmp (job, "MIME list") != 0;
+}
+
 /* Start a job. This is really just a way of limiting the number of
  * async. requests that we issue at any given time. Without this, the
  * number of requests is unbounded.
  */
 static gboolean
 async_job_start (BaulDirectory *directory,
-		 const char    *job G_GNUC_UNUSED)
+		 const char    *job)
 {
+    AsyncJobQueue *queue;
+    gint64 *start_time;
 #ifdef DEBUG_ASYNC_JOBS
     char *key;
 #endif
@@ -384,19 +662,11 @@ async_job_start (BaulDirectory *directory,
     g_assert (async_job_count >= 0);
     g_assert (async_job_count <= MAX_ASYNC_JOBS);
 
-    if (async_job_count >= MAX_ASYNC_JOBS)
-    {
-        if (waiting_directories == NULL)
-        {
-            waiting_directories = eel_g_hash_table_new_free_at_exit
-                                  (NULL, NULL,
-                                   "baul-directory-async.c: waiting_directories");
-        }
-
-        g_hash_table_insert (waiting_directories,
-                             directory,
-                             directory);
+    queue = async_job_queue_get (directory);
 
+    if (async_job_queue_is_full (queue))
+    {
+        async_job_queue_add_waiting (queue, directory);
         return FALSE;
     }
 
@@ -421,15 +691,32 @@ async_job_start (BaulDirectory *directory,
     }
 #endif
 
+    if (async_job_measures_latency (job))
+    {
+        if (directory->details->async_job_start_times == NULL)
+        {
+            directory->details->async_job_start_times =
+                g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+        }
+        start_time = g_new (gint64, 1);
+        *start_time = g_get_monotonic_time ();
+        g_hash_table_insert (directory->details->async_job_start_times,
+                             (gpointer) job, start_time);
+    }
+
     async_job_count += 1;
+    queue->job_count += 1;
+    directory->details->async_job_count += 1;
     return TRUE;
 }
 
 /* End a job. */
 static void
-async_job_end (BaulDirectory *directory G_GNUC_UNUSED,
-	       const char    *job G_GNUC_UNUSED)
+async_job_end (BaulDirectory *directory,
+	       const char    *job)
 {
+    AsyncJobQueue *queue;
+    gint64 *start_time;
 #ifdef DEBUG_ASYNC_JOBS
     char *key;
     gpointer table_key, value;
@@ -441,6 +728,11 @@ async_job_end (BaulDirectory *directory G_GNUC_UNUSED,
 
     g_assert (async_job_count > 0);
 
+    queue = directory->details->async_job_queue;
+    g_assert (queue != NULL);
+    g_assert (queue->job_count > 0);
+    g_assert (directory->details->async_job_count > 0);
+
 #ifdef DEBUG_ASYNC_JOBS
     {
         char *uri;
@@ -462,67 +754,132 @@ async_job_end (BaulDirectory *directory G_GNUC_UNUSED,
     }
 #endif
 
-    async_job_count -= 1;
-}
-
-/* Helper to get one value from a hash table. */
-static void
-get_one_value_callback (gpointer key G_GNUC_UNUSED,
-			gpointer value,
-			gpointer callback_data)
-{
-    gpointer *returned_value;
-
-    returned_value = callback_data;
-    *returned_value = value;
-}
-
-/* return a single value from a hash table. */
-static gpointer
-get_one_value (GHashTable *table)
-{
-    gpointer value;
-
-    value = NULL;
-    if (table != NULL)
+    if (directory->details->async_job_start_times != NULL)
     {
-        g_hash_table_foreach (table, get_one_value_callback, &value);
+        start_time = g_hash_table_lookup (directory->details->async_job_start_times, job);
+        if (start_time != NULL)
+        {
+            async_job_queue_record_latency (queue, g_get_monotonic_time () - *start_time);
+            g_hash_table_remove (directory->details->async_job_start_times, job);
+        }
     }
-    return value;
+
+    async_job_count -= 1;
+    queue->job_count -= 1;
+    directory->details->async_job_count -= 1;
 }
 
 /* Wake up directories that are "blocked" as long as there are job
- * slots available.
+ * slots available on their filesystem.
  */
 static void
 async_job_wake_up (void)
 {
     static gboolean already_waking_up = FALSE;
-    gpointer value;
+    GList *queues, *node;
+    AsyncJobQueue *queue;
+    BaulDirectory *directory;
+    gboolean woke_up;
 
     g_assert (async_job_count >= 0);
     g_assert (async_job_count <= MAX_ASYNC_JOBS);
 
-    if (already_waking_up)
+    if (already_waking_up || async_job_queues == NULL)
     {
         return;
     }
 
     already_waking_up = TRUE;
-    while (async_job_count < MAX_ASYNC_JOBS)
+
+    /* Queues are only freed at shutdown, so a snapshot of them stays
+     * valid while directories start new jobs. Go round-robin so that
+     * every filesystem gets its turn when the global limit is hit.
+     */
+    queues = g_hash_table_get_values (async_job_queues);
+    do
     {
-        value = get_one_value (waiting_directories);
-        if (value == NULL)
+        woke_up = FALSE;
+        for (node = queues; node != NULL; node = node->next)
         {
-            break;
+            queue = node->data;
+            if (async_job_queue_is_full (queue))
+            {
+                continue;
+            }
+
+            directory = g_queue_peek_head (&queue->waiting_visible);
+            if (directory == NULL)
+            {
+                directory = g_queue_peek_head (&queue->waiting);
+            }
+            if (directory == NULL)
+            {
+                continue;
+            }
+
+            async_job_queue_remove_waiting (directory);
+            baul_directory_async_state_changed (directory);
+            woke_up = TRUE;
         }
-        g_hash_table_remove (waiting_directories, value);
-        baul_directory_async_state_changed
-        (BAUL_DIRECTORY (value));
     }
+    while (woke_up);
+    g_list_free (queues);
+
     already_waking_up = FALSE;
 }
 
+/**
+ * baul_directory_get_async_job_stats:
+ *
+ * Returns the current state of the async. job scheduler, one
+ * #BaulDirectoryJobStats per filesystem that has been used.
+ * Free with baul_directory_async_job_stats_list_free().
+ */
+GList *
+baul_directory_get_async_job_stats (void)
+{
+    GHashTableIter iter;
+    AsyncJobQueue *queue;
+    BaulDirectoryJobStats *stats;
+    GList *result;
+
+    result = NULL;
+    if (async_job_queues == NULL)
+    {
+        return NULL;
+    }
+
+    g_hash_table_iter_init (&iter, async_job_queues);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &queue))
+    {
+        stats = g_new0 (BaulDirectoryJobStats, 1);
+        stats->filesystem_id = g_strdup (queue->filesystem_id);
+        stats->running_jobs = queue->job_count;
+        stats->max_jobs = queue->max_jobs;
+        stats->queue_depth = queue->waiting_visible.length + queue->waiting.length;
+        stats->total_waits = queue->total_waits;
+        stats->total_wait_time = queue->total_wait_time;
+        stats->max_wait_time = queue->max_wait_time;
+        stats->average_latency = queue->average_latency;
+        result = g_list_prepend (result, stats);
+    }
+
+    return result;
+}
+
+static void
+async_job_stats_free (BaulDirectoryJobStats *stats)
+{
+    g_free (stats->filesystem_id);
+    g_free (stats);
+}
+
+void
+baul_directory_async_job_stats_list_free (GList *list)
+{
+    g_list_free_full (list, (GDestroyNotify) async_job_stats_free);
+}
+
 static void
 directory_count_cancel (BaulDirectory *directory)
 {
@@ -893,10 +1250,12 @@ set_file_unconfirmed (BaulFile *file, gboolean unconfirmed)
     if (unconfirmed)
     {
         directory->details->confirmed_file_count--;
+        g_hash_table_add (directory->details->unconfirmed_files, file);
     }
     else
     {
         directory->details->confirmed_file_count++;
+        g_hash_table_remove (directory->details->unconfirmed_files, file);
     }
 }
 
@@ -909,8 +1268,7 @@ show_hidden_files_changed_callback (gpointer callback_data G_GNUC_UNUSED)
 }
 
 static gboolean
-should_skip_file (BaulDirectory *directory G_GNUC_UNUSED,
-		  GFileInfo     *info)
+should_show_hidden_files (void)
 {
     static gboolean show_hidden_files_changed_callback_installed = FALSE;
 
@@ -927,7 +1285,14 @@ should_skip_file (BaulDirectory *directory G_GNUC_UNUSED,
         show_hidden_files_changed_callback (NULL);
     }
 
-    if (!show_hidden_files && g_file_info_get_is_hidden (info))
+    return show_hidden_files;
+}
+
+static gboolean
+should_skip_file (BaulDirectory *directory G_GNUC_UNUSED,
+		  GFileInfo     *info)
+{
+    if (!should_show_hidden_files () && g_file_info_get_is_hidden (info))
     {
         return TRUE;
     }
@@ -940,12 +1305,13 @@ dequeue_pending_idle_callback (gpointer callback_data)
 {
     BaulDirectory *directory;
     GList *pending_file_info;
-    GList *node, *next;
+    GList *node;
     BaulFile *file;
     GList *changed_files, *added_files;
     GFileInfo *file_info;
     const char *mimetype, *name;
     DirectoryLoadState *dir_load_state;
+    GList *unconfirmed_files;
 
     directory = BAUL_DIRECTORY (callback_data);
 
@@ -1032,24 +1398,23 @@ dequeue_pending_idle_callback (gpointer callback_data)
     }
 
     /* If we are done loading, then we assume that any unconfirmed
-         * files are gone.
+     * files are gone. Only those are visited, not the whole list.
      */
-    if (directory->details->directory_loaded)
+    if (directory->details->directory_loaded &&
+        g_hash_table_size (directory->details->unconfirmed_files) > 0)
     {
-        for (node = directory->details->file_list;
-                node != NULL; node = next)
+        /* Marking a file gone removes it from the set. */
+        unconfirmed_files = g_hash_table_get_keys (directory->details->unconfirmed_files);
+        for (node = unconfirmed_files; node != NULL; node = node->next)
         {
             file = BAUL_FILE (node->data);
-            next = node->next;
 
-            if (file->details->unconfirmed)
-            {
-                baul_file_ref (file);
-                changed_files = g_list_prepend (changed_files, file);
+            baul_file_ref (file);
+            changed_files = g_list_prepend (changed_files, file);
 
-                baul_file_mark_gone (file);
-            }
+            baul_file_mark_gone (file);
         }
+        g_list_free (unconfirmed_files);
     }
 
     /* Send the changed and added signals. */
@@ -1179,7 +1544,7 @@ static void
 directory_load_done (BaulDirectory *directory,
                      GError *error)
 {
-    GList *node;
+    GList *unconfirmed_files, *node;
 
     directory->details->directory_loaded = TRUE;
     directory->details->directory_loaded_sent_notification = FALSE;
@@ -1192,11 +1557,12 @@ directory_load_done (BaulDirectory *directory,
          * they won't be marked "gone" later -- we don't know enough
          * about them to know whether they are really gone.
          */
-        for (node = directory->details->file_list;
-                node != NULL; node = node->next)
+        unconfirmed_files = g_hash_table_get_keys (directory->details->unconfirmed_files);
+        for (node = unconfirmed_files; node != NULL; node = node->next)
         {
             set_file_unconfirmed (BAUL_FILE (node->data), FALSE);
         }
+        g_list_free (unconfirmed_files);
 
         baul_directory_emit_load_error (directory, error);
     }
@@ -2192,6 +2558,62 @@ directory_load_state_free (DirectoryLoadState *state)
     g_free (state);
 }
 
+static void
+free_file_info_list (gpointer list)
+{
+    g_list_free_full (list, g_object_unref);
+}
+
+/* Reads the next batch of files and digests them as far as possible
+ * in a thread, so the main loop only has to create the BaulFiles.
+ */
+static void
+load_more_files_thread (GTask        *task,
+                        gpointer      source_object,
+                        gpointer      task_data,
+                        GCancellable *cancellable)
+{
+    GList *files, *l;
+    GError *error;
+
+    error = NULL;
+    files = g_file_enumerator_next_files (G_FILE_ENUMERATOR (source_object),
+                                          GPOINTER_TO_INT (task_data),
+                                          cancellable,
+                                          &error);
+    if (error != NULL)
+    {
+        g_task_return_error (task, error);
+        return;
+    }
+
+    for (l = files; l != NULL; l = l->next)
+    {
+        baul_file_info_prepare (l->data);
+    }
+
+    g_task_return_pointer (task, files, free_file_info_list);
+}
+
+static void more_files_callback (GObject      *source_object,
+                                 GAsyncResult *res,
+                                 gpointer      user_data);
+
+static void
+directory_load_more_files (DirectoryLoadState *state)
+{
+    GTask *task;
+
+    task = g_task_new (state->enumerator, state->cancellable,
+                       more_files_callback, state);
+    g_task_set_task_data (task, GINT_TO_POINTER (state->batch_size), NULL);
+    g_task_run_in_thread (task, load_more_files_thread);
+    g_object_unref (task);
+
+    state->batch_size = MIN (state->batch_size * 2,
+                             DIRECTORY_LOAD_MAX_ITEMS_PER_CALLBACK);
+}
+
 static void
 more_files_callback (GObject      *source_object G_GNUC_UNUSED,
 		     GAsyncResult *res,
@@ -2218,8 +2640,7 @@ more_files_callback (GObject      *source_object G_GNUC_UNUSED,
     g_assert (directory->details->directory_load_in_progress == state);
 
     error = NULL;
-    files = g_file_enumerator_next_files_finish (state->enumerator,
-            res, &error);
+    files = g_task_propagate_pointer (G_TASK (res), &error);
 
     for (l = files; l != NULL; l = l->next)
     {
@@ -2235,12 +2656,7 @@ more_files_callback (GObject      *source_object G_GNUC_UNUSED,
     }
     else
     {
-        g_file_enumerator_next_files_async (state->enumerator,
-                                            DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
-                                            G_PRIORITY_DEFAULT,
-                                            state->cancellable,
-                                            more_files_callback,
-                                            state);
+        directory_load_more_files (state);
     }
 
     baul_directory_unref (directory);
@@ -2285,12 +2701,7 @@ enumerate_children_callback (GObject *source_object,
     else
     {
         state->enumerator = enumerator;
-        g_file_enumerator_next_files_async (state->enumerator,
-                                            DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
-                                            G_PRIORITY_DEFAULT,
-                                            state->cancellable,
-                                            more_files_callback,
-                                            state);
+        directory_load_more_files (state);
     }
 }
 
@@ -2326,6 +2737,7 @@ start_monitoring_file_list (BaulDirectory *directory)
     state->cancellable = g_cancellable_new ();
     state->load_mime_list_hash = istr_set_new ();
     state->load_file_count = 0;
+    state->batch_size = DIRECTORY_LOAD_ITEMS_PER_CALLBACK;
 
     g_assert (directory->details->location != NULL);
     state->load_directory_file =
@@ -2801,41 +3213,80 @@ directory_count_start (BaulDirectory *directory,
     g_object_unref (location);
 }
 
-static inline gboolean
-seen_inode (DeepCountState *state,
-            GFileInfo *info)
+typedef struct
 {
-    guint64 inode, inode2;
-    guint i;
+    guint64 device;
+    guint64 inode;
+} DeepCountInode;
 
-    inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+static guint
+deep_count_inode_hash (gconstpointer key)
+{
+    const DeepCountInode *id;
 
-    if (inode != 0)
-    {
-        for (i = 0; i < state->seen_deep_count_inodes->len; i++)
-        {
-            inode2 = g_array_index (state->seen_deep_count_inodes, guint64, i);
-            if (inode == inode2)
-            {
-                return TRUE;
-            }
-        }
-    }
+    id = key;
+    return g_int64_hash (&id->inode) ^ (g_int64_hash (&id->device) * 31);
+}
 
-    return FALSE;
+static gboolean
+deep_count_inode_equal (gconstpointer a,
+                        gconstpointer b)
+{
+    const DeepCountInode *id_a, *id_b;
+
+    id_a = a;
+    id_b = b;
+    return id_a->inode == id_b->inode && id_a->device == id_b->device;
 }
 
-static inline void
+/* Returns TRUE if the inode was already counted, and remembers it
+ * otherwise.
+ */
+static gboolean
 mark_inode_as_seen (DeepCountState *state,
-                    GFileInfo *info)
+                    guint64         device,
+                    guint64         inode)
 {
-    guint64 inode;
+    DeepCountInode id;
 
-    inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
-    if (inode != 0)
+    id.device = device;
+    id.inode = inode;
+
+    if (g_hash_table_contains (state->seen_deep_count_inodes, &id))
     {
-        g_array_append_val (state->seen_deep_count_inodes, inode);
+        return TRUE;
     }
+
+    g_hash_table_add (state->seen_deep_count_inodes,
+                      g_memdup2 (&id, sizeof (id)));
+    return FALSE;
+}
+
+/* Returns TRUE if the file is a hard link to something we already
+ * counted. Only files with more than one link can be seen twice, so
+ * the others are never stored.
+ */
+static gboolean
+seen_inode (DeepCountState *state,
+            GFileInfo *info)
+{
+    guint64 inode;
+
+    if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY ||
+        g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_NLINK) <= 1)
+    {
+        return FALSE;
+    }
+
+    inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+    if (inode == 0)
+    {
+        return FALSE;
+    }
+
+    return mark_inode_as_seen (state,
+                               g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE),
+                               inode);
 }
 
 static void
@@ -2851,10 +3302,6 @@ deep_count_one (DeepCountState *state,
     }
 
     is_seen_inode = seen_inode (state, info);
-    if (!is_seen_inode)
-    {
-        mark_inode_as_seen (state, info);
-    }
 
     file = state->directory->details->deep_count_file;
 
@@ -2914,8 +3361,12 @@ deep_count_state_free (DeepCountState *state)
         g_object_unref (state->deep_count_location);
     }
     g_list_free_full (state->deep_count_subdirectories, g_object_unref);
-    g_array_free (state->seen_deep_count_inodes, TRUE);
+    g_hash_table_destroy (state->seen_deep_count_inodes);
     g_free (state->fs_id);
+    g_queue_clear_full (&state->native_directories, g_free);
+    g_free (state->native_root);
+    g_mutex_clear (&state->mutex);
+    g_cond_clear (&state->cond);
     g_free (state);
 }
 
@@ -3078,7 +3529,9 @@ deep_count_load (DeepCountState *state, GFile *location)
                                      G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
                                      G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP ","
                                      G_FILE_ATTRIBUTE_ID_FILESYSTEM ","
-                                     G_FILE_ATTRIBUTE_UNIX_INODE,
+                                     G_FILE_ATTRIBUTE_UNIX_INODE ","
+                                     G_FILE_ATTRIBUTE_UNIX_NLINK ","
+                                     G_FILE_ATTRIBUTE_UNIX_DEVICE,
                                      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, /* flags */
                                      G_PRIORITY_LOW, /* prio */
                                      state->cancellable,
@@ -3086,6 +3539,400 @@ deep_count_load (DeepCountState *state, GFile *location)
                                      state);
 }
 
+/* Local directories are counted by a pool of worker threads that walk
+ * the tree with plain system calls, which is much faster than chaining
+ * GIO enumerations on the main loop. The totals are published to the
+ * file every DEEP_COUNT_PUBLISH_INTERVAL while the count runs.
+ */
+static GHashTable *
+read_hidden_names (int dir_fd)
+{
+    GHashTable *hidden;
+    GString *contents;
+    char buffer[4096];
+    char **lines;
+    ssize_t n_read;
+    int fd, i;
+
+    fd = openat (dir_fd, ".hidden", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    contents = g_string_new (NULL);
+    while ((n_read = read (fd, buffer, sizeof (buffer))) > 0)
+    {
+        g_string_append_len (contents, buffer, n_read);
+    }
+    close (fd);
+
+    hidden = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    lines = g_strsplit (contents->str, "\n", -1);
+    for (i = 0; lines[i] != NULL; i++)
+    {
+        if (lines[i][0] != '\0')
+        {
+            g_hash_table_add (hidden, lines[i]);
+        }
+        else
+        {
+            g_free (lines[i]);
+        }
+    }
+    g_free (lines);
+    g_string_free (contents, TRUE);
+
+    return hidden;
+}
+
+static gboolean
+deep_count_native_directory_cached (DeepCountState    *state,
+                                    const char        *path,
+                                    const struct stat *dir_statbuf,
+                                    DeepCountTotals   *totals,
+                                    GList            **subdirectories)
+{
+    BaulDeepCountCacheEntry entry;
+    int i;
+
+    if (!baul_deep_count_cache_lookup (path, dir_statbuf,
+                                       state->show_hidden_files, &entry))
+    {
+        return FALSE;
+    }
+
+    totals->directory_count += entry.directory_count;
+    totals->file_count += entry.file_count;
+    totals->size += entry.size;
+    totals->size_on_disk += entry.size_on_disk;
+
+    for (i = 0; entry.subdirectories[i] != NULL; i++)
+    {
+        *subdirectories = g_list_prepend (*subdirectories,
+                                          g_build_filename (path, entry.subdirectories[i], NULL));
+    }
+    g_strfreev (entry.subdirectories);
+
+    return TRUE;
+}
+
+static void
+deep_count_native_directory (DeepCountState  *state,
+                             const char      *path,
+                             DeepCountTotals *totals,
+                             GList          **subdirectories)
+{
+    DIR *dir;
+    struct dirent *entry;
+    struct stat statbuf, dir_statbuf;
+    GHashTable *hidden;
+    GPtrArray *subdirectory_names;
+    BaulDeepCountCacheEntry cache_entry;
+    const char *name;
+    gboolean seen, cacheable;
+    int fd;
+
+    fd = open (path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || fstat (fd, &dir_statbuf) != 0)
+    {
+        if (fd >= 0)
+        {
+            close (fd);
+        }
+        totals->unreadable_count += 1;
+        return;
+    }
+
+    /* Only descend into directories on the same filesystem. */
+    if (strcmp (path, state->native_root) == 0)
+    {
+        state->native_device = dir_statbuf.st_dev;
+    }
+
+    if (state->use_cache &&
+        deep_count_native_directory_cached (state, path, &dir_statbuf,
+                                            totals, subdirectories))
+    {
+        close (fd);
+        return;
+    }
+
+    dir = fdopendir (fd);
+    if (dir == NULL)
+    {
+        close (fd);
+        totals->unreadable_count += 1;
+        return;
+    }
+
+    hidden = state->show_hidden_files ? NULL : read_hidden_names (fd);
+    subdirectory_names = state->use_cache ? g_ptr_array_new_with_free_func (g_free) : NULL;
+    cacheable = state->use_cache;
+
+    while ((entry = readdir (dir)) != NULL &&
+           !g_cancellable_is_cancelled (state->cancellable))
+    {
+        name = entry->d_name;
+        if (strcmp (name, ".") == 0 || strcmp (name, "..") == 0)
+        {
+            continue;
+        }
+
+        /* Same rule as g_file_info_get_is_hidden () for local files. */
+        if (!state->show_hidden_files &&
+            (name[0] == '.' ||
+             (hidden != NULL && g_hash_table_contains (hidden, name))))
+        {
+            continue;
+        }
+
+        if (fstatat (fd, name, &statbuf, AT_SYMLINK_NOFOLLOW) != 0)
+        {
+            continue;
+        }
+
+        seen = FALSE;
+        if (S_ISDIR (statbuf.st_mode))
+        {
+            totals->directory_count += 1;
+
+            if (statbuf.st_dev == state->native_device)
+            {
+                *subdirectories = g_list_prepend (*subdirectories,
+                                                  g_build_filename (path, name, NULL));
+                if (subdirectory_names != NULL)
+                {
+                    g_ptr_array_add (subdirectory_names, g_strdup (name));
+                }
+            }
+        }
+        else
+        {
+            /* Even non-regular files count as files. */
+            totals->file_count += 1;
+
+            if (statbuf.st_nlink > 1)
+            {
+                /* Whether a hard link counts depends on what else was
+                 * seen during this count, so it can't be cached.
+                 */
+                cacheable = FALSE;
+
+                g_mutex_lock (&state->mutex);
+                seen = mark_inode_as_seen (state, statbuf.st_dev, statbuf.st_ino);
+                g_mutex_unlock (&state->mutex);
+            }
+        }
+
+        if (!seen)
+        {
+            totals->size += statbuf.st_size;
+            totals->size_on_disk += (goffset) statbuf.st_blocks * 512;
+        }
+    }
+
+    if (subdirectory_names != NULL)
+    {
+        if (cacheable && !g_cancellable_is_cancelled (state->cancellable))
+        {
+            g_ptr_array_add (subdirectory_names, NULL);
+            cache_entry.directory_count = totals->directory_count;
+            cache_entry.file_count = totals->file_count;
+            cache_entry.size = totals->size;
+            cache_entry.size_on_disk = totals->size_on_disk;
+            cache_entry.subdirectories = (char **) subdirectory_names->pdata;
+            baul_deep_count_cache_store (path, &dir_statbuf,
+                                         state->show_hidden_files, &cache_entry);
+        }
+        g_ptr_array_free (subdirectory_names, TRUE);
+    }
+
+    closedir (dir);
+
+    if (hidden != NULL)
+    {
+        g_hash_table_destroy (hidden);
+    }
+}
+
+static gboolean deep_count_native_done (gpointer user_data);
+
+static gpointer
+deep_count_native_worker (gpointer user_data)
+{
+    DeepCountState *state;
+    DeepCountTotals totals;
+    GList *subdirectories, *l;
+    char *path;
+    gboolean last;
+
+    state = user_data;
+
+    g_mutex_lock (&state->mutex);
+    while (!g_cancellable_is_cancelled (state->cancellable))
+    {
+        path = g_queue_pop_head (&state->native_directories);
+        if (path == NULL)
+        {
+            if (state->busy_workers == 0)
+            {
+                /* Nothing left to count and nobody will add more. */
+                break;
+            }
+
+            g_cond_wait_until (&state->cond, &state->mutex,
+                               g_get_monotonic_time () + 100 * G_TIME_SPAN_MILLISECOND);
+            continue;
+        }
+
+        state->busy_workers += 1;
+        g_mutex_unlock (&state->mutex);
+
+        memset (&totals, 0, sizeof (totals));
+        subdirectories = NULL;
+        deep_count_native_directory (state, path, &totals, &subdirectories);
+        g_free (path);
+
+        g_mutex_lock (&state->mutex);
+
+        /* Go depth first, like the GIO code path, to keep the queue short. */
+        for (l = subdirectories; l != NULL; l = l->next)
+        {
+            g_queue_push_head (&state->native_directories, l->data);
+        }
+        g_list_free (subdirectories);
+
+        state->native_totals.directory_count += totals.directory_count;
+        state->native_totals.file_count += totals.file_count;
+        state->native_totals.unreadable_count += totals.unreadable_count;
+        state->native_totals.size += totals.size;
+        state->native_totals.size_on_disk += totals.size_on_disk;
+
+        state->busy_workers -= 1;
+        g_cond_broadcast (&state->cond);
+    }
+
+    state->running_workers -= 1;
+    last = state->running_workers == 0;
+    g_cond_broadcast (&state->cond);
+    g_mutex_unlock (&state->mutex);
+
+    /* The state must not be touched once the last worker is done. */
+    if (last)
+    {
+        if (state->use_cache)
+        {
+            baul_deep_count_cache_save ();
+        }
+
+        g_idle_add (deep_count_native_done, state);
+    }
+
+    return NULL;
+}
+
+static void
+deep_count_native_publish (DeepCountState *state)
+{
+    BaulFile *file;
+
+    file = state->directory->details->deep_count_file;
+
+    g_mutex_lock (&state->mutex);
+    file->details->deep_directory_count = state->native_totals.directory_count;
+    file->details->deep_file_count = state->native_totals.file_count;
+    file->details->deep_unreadable_count = state->native_totals.unreadable_count;
+    file->details->deep_size = state->native_totals.size;
+    file->details->deep_size_on_disk = state->native_totals.size_on_disk;
+    g_mutex_unlock (&state->mutex);
+}
+
+static gboolean
+deep_count_native_publish_callback (gpointer user_data)
+{
+    DeepCountState *state;
+
+    state = user_data;
+
+    if (state->directory == NULL)
+    {
+        /* Operation was cancelled, the workers will free the state. */
+        state->publish_timeout_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+
+    deep_count_native_publish (state);
+    baul_file_updated_deep_count_in_progress (state->directory->details->deep_count_file);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+deep_count_native_done (gpointer user_data)
+{
+    DeepCountState *state;
+    BaulDirectory *directory;
+    BaulFile *file;
+
+    state = user_data;
+
+    if (state->publish_timeout_id != 0)
+    {
+        g_source_remove (state->publish_timeout_id);
+        state->publish_timeout_id = 0;
+    }
+
+    if (state->directory == NULL)
+    {
+        /* Operation was cancelled. Bail out */
+        deep_count_state_free (state);
+        return G_SOURCE_REMOVE;
+    }
+
+    directory = state->directory;
+    file = directory->details->deep_count_file;
+
+    deep_count_native_publish (state);
+
+    file->details->deep_counts_status = BAUL_REQUEST_DONE;
+    directory->details->deep_count_file = NULL;
+    directory->details->deep_count_in_progress = NULL;
+    deep_count_state_free (state);
+
+    baul_file_updated_deep_count_in_progress (file);
+    baul_file_changed (file);
+    async_job_end (directory, "deep count");
+    baul_directory_async_state_changed (directory);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+deep_count_native_start (DeepCountState *state,
+                         const char     *path)
+{
+    GThread *thread;
+    int n_workers, i;
+
+    state->native_root = g_strdup (path);
+    state->show_hidden_files = should_show_hidden_files ();
+    state->use_cache = baul_deep_count_cache_is_enabled ();
+    g_queue_push_tail (&state->native_directories, g_strdup (path));
+
+    n_workers = CLAMP ((int) g_get_num_processors (), 1, DEEP_COUNT_MAX_WORKERS);
+    state->running_workers = n_workers;
+    for (i = 0; i < n_workers; i++)
+    {
+        thread = g_thread_new ("baul-deep-count", deep_count_native_worker, state);
+        g_thread_unref (thread);
+    }
+
+    state->publish_timeout_id = g_timeout_add (DEEP_COUNT_PUBLISH_INTERVAL,
+                                               deep_count_native_publish_callback,
+                                               state);
+}
+
 static void
 deep_count_stop (BaulDirectory *directory)
 {
@@ -3139,6 +3986,7 @@ deep_count_start (BaulDirectory *directory,
 {
     GFile *location;
     DeepCountState *state;
+    char *path;
 
     if (directory->details->deep_count_in_progress != NULL)
     {
@@ -3179,19 +4027,33 @@ deep_count_start (BaulDirectory *directory,
     state = g_new0 (DeepCountState, 1);
     state->directory = directory;
     state->cancellable = g_cancellable_new ();
-    state->seen_deep_count_inodes = g_array_new (FALSE, TRUE, sizeof (guint64));
+    state->seen_deep_count_inodes = g_hash_table_new_full (deep_count_inode_hash,
+                                                           deep_count_inode_equal,
+                                                           g_free, NULL);
     state->fs_id = NULL;
+    g_mutex_init (&state->mutex);
+    g_cond_init (&state->cond);
+    g_queue_init (&state->native_directories);
 
     directory->details->deep_count_in_progress = state;
 
     location = baul_file_get_location (file);
-    g_file_query_info_async (location,
-                             G_FILE_ATTRIBUTE_ID_FILESYSTEM,
-                             G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                             G_PRIORITY_DEFAULT,
-                             NULL,
-                             deep_count_got_info,
-                             state);
+    path = g_file_is_native (location) ? g_file_get_path (location) : NULL;
+    if (path != NULL)
+    {
+        deep_count_native_start (state, path);
+        g_free (path);
+    }
+    else
+    {
+        g_file_query_info_async (location,
+                                 G_FILE_ATTRIBUTE_ID_FILESYSTEM,
+                                 G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                 G_PRIORITY_DEFAULT,
+                                 NULL,
+                                 deep_count_got_info,
+                                 state);
+    }
     g_object_unref (location);
 }
 
@@ -4231,9 +5093,32 @@ thumbnail_got_pixbuf (BaulDirectory *directory,
     baul_directory_unref (directory);
 }
 
+static void
+thumbnail_stop_decoding (ThumbnailState *state)
+{
+    if (state->loader != NULL)
+    {
+        gdk_pixbuf_loader_close (state->loader, NULL);
+        g_object_unref (state->loader);
+        state->loader = NULL;
+    }
+
+    if (state->stream != NULL)
+    {
+        g_input_stream_close_async (state->stream, G_PRIORITY_DEFAULT,
+                                    NULL, NULL, NULL);
+        g_object_unref (state->stream);
+        state->stream = NULL;
+    }
+
+    state->bytes_read = 0;
+}
+
 static void
 thumbnail_state_free (ThumbnailState *state)
 {
+    thumbnail_stop_decoding (state);
+    g_free (state->buffer);
     g_object_unref (state->cancellable);
     g_free (state);
 }
@@ -4272,48 +5157,56 @@ thumbnail_loader_size_prepared (GdkPixbufLoader *loader,
 }
 
 static GdkPixbuf *
-get_pixbuf_for_content (goffset file_len,
-                        char *file_contents)
+thumbnail_get_pixbuf (ThumbnailState *state)
 {
-    gboolean res;
-    GdkPixbuf *pixbuf, *pixbuf2;
-    GdkPixbufLoader *loader;
-    gsize chunk_len;
-    pixbuf = NULL;
+    GdkPixbuf *pixbuf;
 
-    loader = gdk_pixbuf_loader_new ();
-    g_signal_connect (loader, "size-prepared",
-                      G_CALLBACK (thumbnail_loader_size_prepared),
-                      NULL);
+    pixbuf = NULL;
 
-    /* For some reason we have to write in chunks, or gdk-pixbuf fails */
-    res = TRUE;
-    while (res && file_len > 0)
+    if (gdk_pixbuf_loader_close (state->loader, NULL) &&
+            gdk_pixbuf_loader_get_pixbuf (state->loader) != NULL)
     {
-        chunk_len = file_len;
-        res = gdk_pixbuf_loader_write (loader, (guchar *) file_contents, chunk_len, NULL);
-        file_contents += chunk_len;
-        file_len -= chunk_len;
+        pixbuf = gdk_pixbuf_apply_embedded_orientation (gdk_pixbuf_loader_get_pixbuf (state->loader));
     }
-    if (res)
-    {
-        res = gdk_pixbuf_loader_close (loader, NULL);
-    }
-    if (res)
-    {
-        pixbuf = g_object_ref (gdk_pixbuf_loader_get_pixbuf (loader));
-    }
-    g_object_unref (G_OBJECT (loader));
 
-    if (pixbuf)
-    {
-        pixbuf2 = gdk_pixbuf_apply_embedded_orientation (pixbuf);
-        g_object_unref (pixbuf);
-        pixbuf = pixbuf2;
-    }
+    g_object_unref (state->loader);
+    state->loader = NULL;
+
     return pixbuf;
 }
 
+static void thumbnail_open (ThumbnailState *state,
+                            GFile          *location);
+
+/* Falls back to the thumbnail if the original couldn't be used,
+ * otherwise hands the result to the file.
+ */
+static void
+thumbnail_finish (ThumbnailState *state,
+                  GdkPixbuf *pixbuf)
+{
+    GFile *location;
+
+    thumbnail_stop_decoding (state);
+
+    if (pixbuf == NULL && state->trying_original &&
+            state->file->details->thumbnail_path != NULL)
+    {
+        state->trying_original = FALSE;
+
+        location = g_file_new_for_path (state->file->details->thumbnail_path);
+        thumbnail_open (state, location);
+        g_object_unref (location);
+        return;
+    }
+
+    state->directory->details->thumbnail_state = NULL;
+    async_job_end (state->directory, "thumbnail");
+
+    thumbnail_got_pixbuf (state->directory, state->file, pixbuf, state->tried_original);
+
+    thumbnail_state_free (state);
+}
 
 static void
 thumbnail_read_callback (GObject *source_object,
@@ -4321,14 +5214,14 @@ thumbnail_read_callback (GObject *source_object,
                          gpointer user_data)
 {
     ThumbnailState *state;
-    gsize file_size;
-    char *file_contents;
-    gboolean result;
+    gssize bytes_read;
     BaulDirectory *directory;
-    GdkPixbuf *pixbuf;
 
     state = user_data;
 
+    bytes_read = g_input_stream_read_finish (G_INPUT_STREAM (source_object),
+                                             res, NULL);
+
     if (state->directory == NULL)
     {
         /* Operation was cancelled. Bail out */
@@ -4338,44 +5231,101 @@ thumbnail_read_callback (GObject *source_object,
 
     directory = baul_directory_ref (state->directory);
 
-    result = g_file_load_contents_finish (G_FILE (source_object),
-                                          res,
-                                          &file_contents, &file_size,
-                                          NULL, NULL);
-
-    pixbuf = NULL;
-    if (result)
+    if (bytes_read == 0)
     {
-        pixbuf = get_pixbuf_for_content (file_size, file_contents);
-        g_free (file_contents);
+        thumbnail_finish (state, thumbnail_get_pixbuf (state));
     }
+    else if (bytes_read < 0)
+    {
+        thumbnail_finish (state, NULL);
+    }
+    else
+    {
+        state->bytes_read += bytes_read;
 
-    if (pixbuf == NULL && state->trying_original)
+        /* The loader only keeps the downscaled image, so the chunk
+         * buffer is all the memory the file itself takes up.
+         */
+        if (!gdk_pixbuf_loader_write (state->loader, state->buffer, bytes_read, NULL))
+        {
+            thumbnail_finish (state, NULL);
+        }
+        else
+        {
+            g_input_stream_read_async (state->stream,
+                                       state->buffer,
+                                       THUMBNAIL_READ_CHUNK_SIZE,
+                                       G_PRIORITY_DEFAULT,
+                                       state->cancellable,
+                                       thumbnail_read_callback,
+                                       state);
+        }
+    }
+
+    baul_directory_unref (directory);
+}
+
+static void
+thumbnail_open_callback (GObject *source_object,
+                         GAsyncResult *res,
+                         gpointer user_data)
+{
+    ThumbnailState *state;
+    GFileInputStream *stream;
+    BaulDirectory *directory;
+
+    state = user_data;
+
+    stream = g_file_read_finish (G_FILE (source_object), res, NULL);
+
+    if (state->directory == NULL)
     {
-        GFile *location;
+        /* Operation was cancelled. Bail out */
+        if (stream != NULL)
+        {
+            g_object_unref (stream);
+        }
+        thumbnail_state_free (state);
+        return;
+    }
 
-        state->trying_original = FALSE;
+    directory = baul_directory_ref (state->directory);
 
-        location = g_file_new_for_path (state->file->details->thumbnail_path);
-        g_file_load_contents_async (location,
-                                    state->cancellable,
-                                    thumbnail_read_callback,
-                                    state);
-        g_object_unref (location);
+    if (stream == NULL)
+    {
+        thumbnail_finish (state, NULL);
     }
     else
     {
-        state->directory->details->thumbnail_state = NULL;
-        async_job_end (state->directory, "thumbnail");
-
-        thumbnail_got_pixbuf (state->directory, state->file, pixbuf, state->tried_original);
+        state->stream = G_INPUT_STREAM (stream);
+        state->loader = gdk_pixbuf_loader_new ();
+        g_signal_connect (state->loader, "size-prepared",
+                          G_CALLBACK (thumbnail_loader_size_prepared),
+                          NULL);
 
-        thumbnail_state_free (state);
+        g_input_stream_read_async (state->stream,
+                                   state->buffer,
+                                   THUMBNAIL_READ_CHUNK_SIZE,
+                                   G_PRIORITY_DEFAULT,
+                                   state->cancellable,
+                                   thumbnail_read_callback,
+                                   state);
     }
 
     baul_directory_unref (directory);
 }
 
+static void
+thumbnail_open (ThumbnailState *state,
+                GFile *location)
+{
+    g_file_read_async (location,
+                       G_PRIORITY_DEFAULT,
+                       state->cancellable,
+                       thumbnail_open_callback,
+                       state);
+}
+
 static void
 thumbnail_start (BaulDirectory *directory,
                  BaulFile *file,
@@ -4407,6 +5357,7 @@ thumbnail_start (BaulDirectory *directory,
     state->directory = directory;
     state->file = file;
     state->cancellable = g_cancellable_new ();
+    state->buffer = g_malloc (THUMBNAIL_READ_CHUNK_SIZE);
 
     if (file->details->thumbnail_wants_original)
     {
@@ -4421,10 +5372,7 @@ thumbnail_start (BaulDirectory *directory,
 
     directory->details->thumbnail_state = state;
 
-    g_file_load_contents_async (location,
-                                state->cancellable,
-                                thumbnail_read_callback,
-                                state);
+    thumbnail_open (state, location);
     g_object_unref (location);
 }
 
@@ -5094,10 +6042,7 @@ baul_directory_cancel (BaulDirectory *directory)
     filesystem_info_cancel (directory);
 
     /* We aren't waiting for anything any more. */
-    if (waiting_directories != NULL)
-    {
-        g_hash_table_remove (waiting_directories, directory);
-    }
+    async_job_queue_remove_waiting (directory);
 
     /* Check if any directories should wake up. */
     async_job_wake_up ();
@@ -46,6 +46,7 @@ typedef struct MimeListState MimeListState;
 typedef struct ThumbnailState ThumbnailState;
 typedef struct MountState MountState;
 typedef struct FilesystemInfoState FilesystemInfoState;
+typedef struct AsyncJobQueue AsyncJobQueue;
 
 typedef enum
 {
@@ -108,6 +109,7 @@ struct _BaulDirectoryPrivate
 
     GList *pending_file_info; /* list of CafeVFSFileInfo's that are pending */
     int confirmed_file_count;
+    GHashTable *unconfirmed_files; /* set of BaulFile's not seen again yet */
     guint dequeue_pending_idle_id;
 
     GList *new_files_in_progress; /* list of NewFilesState * */
@@ -141,8 +143,31 @@ struct _BaulDirectoryPrivate
 
     guint64 free_space; /* (guint)-1 for unknown */
     time_t free_space_read; /* The time free_space was updated, or 0 for never */
+
+    /* Async. job scheduling, see async_job_start (). */
+    AsyncJobQueue *async_job_queue;
+    int async_job_count;
+    GHashTable *async_job_start_times;
+    GList *async_job_waiting_link;
+    gboolean async_job_waiting_visible;
+    gint64 async_job_waiting_since;
 };
 
+/* Async. job scheduler counters for one filesystem. Times are in
+ * microseconds.
+ */
+typedef struct
+{
+    char *filesystem_id;
+    int running_jobs;
+    int max_jobs;
+    int queue_depth;
+    guint64 total_waits;
+    gint64 total_wait_time;
+    gint64 max_wait_time;
+    gint64 average_latency;
+} BaulDirectoryJobStats;
+
 BaulDirectory *baul_directory_get_existing                    (GFile                     *location);
 
 /* async. interface */
@@ -238,3 +263,5 @@ void               baul_directory_remove_file_from_work_queue     (BaulDirectory
 
 /* debugging functions */
 int                baul_directory_number_outstanding              (void);
+GList *            baul_directory_get_async_job_stats             (void);
+void               baul_directory_async_job_stats_list_free       (GList *list);
@@ -28,11 +28,13 @@
 #include <eel/eel-glib-extensions.h>
 #include <eel/eel-ctk-macros.h>
 
+#include "baul-deep-count-cache.h"
 #include "baul-directory-private.h"
 #include "baul-directory-notify.h"
 #include "baul-file-attributes.h"
 #include "baul-file-private.h"
 #include "baul-file-utilities.h"
+#include "baul-filename-index.h"
 #include "baul-search-directory.h"
 #include "baul-global-preferences.h"
 #include "baul-lib-self-check-functions.h"
@@ -115,6 +117,7 @@ baul_directory_init (BaulDirectory *directory)
 {
     directory->details = baul_directory_get_instance_private (directory);
     directory->details->file_hash = g_hash_table_new (g_str_hash, g_str_equal);
+    directory->details->unconfirmed_files = g_hash_table_new (NULL, NULL);
     directory->details->high_priority_queue = baul_file_queue_new ();
     directory->details->low_priority_queue = baul_file_queue_new ();
     directory->details->extension_queue = baul_file_queue_new ();
@@ -189,6 +192,7 @@ baul_directory_finalize (GObject *object)
 
     g_assert (directory->details->file_list == NULL);
     g_hash_table_destroy (directory->details->file_hash);
+    g_hash_table_destroy (directory->details->unconfirmed_files);
 
     baul_file_queue_destroy (directory->details->high_priority_queue);
     baul_file_queue_destroy (directory->details->low_priority_queue);
@@ -198,6 +202,11 @@ baul_directory_finalize (GObject *object)
     g_assert (directory->details->dequeue_pending_idle_id == 0);
     g_list_free_full (directory->details->pending_file_info, g_object_unref);
 
+    if (directory->details->async_job_start_times != NULL)
+    {
+        g_hash_table_destroy (directory->details->async_job_start_times);
+    }
+
     G_OBJECT_CLASS (baul_directory_parent_class)->finalize (object);
 }
 
@@ -620,6 +629,10 @@ baul_directory_remove_file (BaulDirectory *directory, BaulFile *file)
     {
         directory->details->confirmed_file_count--;
     }
+    else
+    {
+        g_hash_table_remove (directory->details->unconfirmed_files, file);
+    }
 
     /* Unref if we are monitoring. */
     if (baul_directory_is_file_list_monitored (directory))
@@ -877,6 +890,8 @@ baul_directory_notify_files_added (GList *files)
     {
         location = p->data;
 
+        baul_filename_index_notify_added (location);
+
         /* See if the directory is already known. */
         directory = get_parent_directory_if_exists (location);
         if (directory == NULL)
@@ -946,6 +961,27 @@ baul_directory_notify_files_added (GList *files)
     g_hash_table_destroy (parent_directories);
 }
 
+static void
+invalidate_deep_count_cache_for_parent (GFile *location)
+{
+    GFile *parent;
+    char *path;
+
+    parent = g_file_get_parent (location);
+    if (parent == NULL)
+    {
+        return;
+    }
+
+    path = g_file_get_path (parent);
+    if (path != NULL)
+    {
+        baul_deep_count_cache_invalidate (path);
+        g_free (path);
+    }
+    g_object_unref (parent);
+}
+
 void
 baul_directory_notify_files_changed (GList *files)
 {
@@ -953,15 +989,28 @@ baul_directory_notify_files_changed (GList *files)
     GList *node;
     GFile *location = NULL;
     BaulFile *file = NULL;
+    gboolean use_deep_count_cache;
 
     /* Make a list of changed files in each directory. */
     changed_lists = g_hash_table_new (NULL, NULL);
 
+    use_deep_count_cache = baul_deep_count_cache_is_enabled ();
+
     /* Go through all the notifications. */
     for (node = files; node != NULL; node = node->next)
     {
         location = node->data;
 
+        baul_filename_index_notify_changed (location);
+
+        /* Changing a file in place doesn't touch the mtime of its
+         * folder, so the cached size of the folder must go.
+         */
+        if (use_deep_count_cache)
+        {
+            invalidate_deep_count_cache_for_parent (location);
+        }
+
         /* Find the file. */
         file = baul_file_get_existing (location);
         if (file != NULL)
@@ -1005,6 +1054,8 @@ baul_directory_notify_files_removed (GList *files)
     {
         location = p->data;
 
+        baul_filename_index_notify_removed (location);
+
         /* Update file count for parent directory if anyone might care. */
         directory = get_parent_directory_if_exists (location);
         if (directory != NULL)
@@ -1222,6 +1273,8 @@ baul_directory_notify_files_moved (GList *file_pairs)
         from_location = pair->from;
         to_location = pair->to;
 
+        baul_filename_index_notify_moved (from_location, to_location);
+
         /* Handle overwriting a file. */
         file = baul_file_get_existing (to_location);
         if (file != NULL)
@@ -0,0 +1,438 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   baul-file-copy.c: Copying the contents of local files in the kernel.
+
+   Copyright (C) 2026 CAFE Desktop.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/* The contents are copied with the cheapest thing that works: a
+ * reflink, where the file system can share the blocks of the two
+ * files, then copy_file_range (), which lets the file system or the
+ * NFS server copy on its own side, then sendfile (), and plain reads
+ * and writes as a last resort. The holes of sparse files are skipped,
+ * so they stay holes in the copy.
+ *
+ * The size of the source is only used for the progress; the contents
+ * are copied until a read finds the end, so that files which grow
+ * meanwhile, or which don't know their size like the ones in /proc,
+ * are copied whole.
+ */
+
+#define _GNU_SOURCE
+
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
+#include <glib/gi18n.h>
+
+#include "baul-file-copy.h"
+
+/* Bytes handed to the kernel at a time; progress is reported and
+ * cancellation checked in between.
+ */
+#define COPY_CHUNK_SIZE (8 * 1024 * 1024)
+#define COPY_BUFFER_SIZE (1024 * 1024)
+
+typedef enum {
+	COPY_METHOD_COPY_FILE_RANGE,
+	COPY_METHOD_SENDFILE,
+	COPY_METHOD_READ_WRITE
+} CopyMethod;
+
+typedef struct {
+	int src_fd;
+	int dest_fd;
+	goffset size;
+	goffset copied;
+	gboolean at_end;
+	CopyMethod method;
+	char *buffer;
+	GCancellable *cancellable;
+	GFileProgressCallback progress_callback;
+	gpointer progress_callback_data;
+} CopyState;
+
+static void
+set_error_from_errno (GError **error,
+		      int errsv,
+		      const char *message)
+{
+	g_set_error (error, G_IO_ERROR,
+		     g_io_error_from_errno (errsv),
+		     "%s: %s", message, g_strerror (errsv));
+}
+
+static void
+report_progress (CopyState *state,
+		 goffset n_bytes)
+{
+	state->copied += n_bytes;
+	if (state->copied > state->size) {
+		/* The file grew */
+		state->size = state->copied;
+	}
+	if (state->progress_callback != NULL) {
+		state->progress_callback (state->copied, state->size,
+					  state->progress_callback_data);
+	}
+}
+
+static gboolean
+write_all (int fd,
+	   const char *buffer,
+	   gsize count,
+	   goffset offset,
+	   GError **error)
+{
+	gssize n_written;
+
+	while (count > 0) {
+		n_written = pwrite (fd, buffer, count, offset);
+		if (n_written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			set_error_from_errno (error, errno, _("Error writing to file"));
+			return FALSE;
+		}
+		buffer += n_written;
+		count -= n_written;
+		offset += n_written;
+	}
+
+	return TRUE;
+}
+
+/* Copies the bytes from offset up to end, which are at the same place
+ * in both files. Pass G_MAXOFFSET as end to copy up to the end of the
+ * file. Stops early without an error when a read finds the end, and
+ * takes that as the size of the file.
+ */
+static gboolean
+copy_extent (CopyState *state,
+	     goffset offset,
+	     goffset end,
+	     GError **error)
+{
+	gssize n_copied;
+	gsize chunk;
+	int errsv;
+#ifdef HAVE_COPY_FILE_RANGE
+	loff_t in_offset, out_offset;
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+	off_t in_offset_sendfile;
+#endif
+
+	while (offset < end) {
+		if (g_cancellable_set_error_if_cancelled (state->cancellable, error)) {
+			return FALSE;
+		}
+
+		chunk = MIN (end - offset, COPY_CHUNK_SIZE);
+		n_copied = -1;
+		errsv = 0;
+
+		switch (state->method) {
+		case COPY_METHOD_COPY_FILE_RANGE:
+#ifdef HAVE_COPY_FILE_RANGE
+			in_offset = offset;
+			out_offset = offset;
+			n_copied = copy_file_range (state->src_fd, &in_offset,
+						    state->dest_fd, &out_offset,
+						    chunk, 0);
+			errsv = errno;
+			if (n_copied < 0 &&
+			    (errsv == ENOSYS || errsv == EXDEV ||
+			     errsv == EINVAL || errsv == EOPNOTSUPP)) {
+				state->method = COPY_METHOD_SENDFILE;
+				continue;
+			}
+			break;
+#else
+			state->method = COPY_METHOD_SENDFILE;
+			continue;
+#endif
+		case COPY_METHOD_SENDFILE:
+#ifdef HAVE_SYS_SENDFILE_H
+			/* sendfile () writes at the file position */
+			if (lseek (state->dest_fd, offset, SEEK_SET) < 0) {
+				state->method = COPY_METHOD_READ_WRITE;
+				continue;
+			}
+			in_offset_sendfile = offset;
+			n_copied = sendfile (state->dest_fd, state->src_fd,
+					     &in_offset_sendfile, chunk);
+			errsv = errno;
+			if (n_copied < 0 &&
+			    (errsv == ENOSYS || errsv == EINVAL)) {
+				state->method = COPY_METHOD_READ_WRITE;
+				continue;
+			}
+			break;
+#else
+			state->method = COPY_METHOD_READ_WRITE;
+			continue;
+#endif
+		case COPY_METHOD_READ_WRITE:
+		default:
+			if (state->buffer == NULL) {
+				state->buffer = g_malloc (COPY_BUFFER_SIZE);
+			}
+			chunk = MIN (chunk, COPY_BUFFER_SIZE);
+			n_copied = pread (state->src_fd, state->buffer, chunk, offset);
+			errsv = errno;
+			if (n_copied > 0 &&
+			    !write_all (state->dest_fd, state->buffer, n_copied, offset, error)) {
+				return FALSE;
+			}
+			break;
+		}
+
+		if (n_copied < 0) {
+			if (errsv == EINTR) {
+				continue;
+			}
+			set_error_from_errno (error, errsv, _("Error copying file"));
+			return FALSE;
+		}
+
+		if (n_copied == 0) {
+			/* copy_file_range () and sendfile () also return 0
+			 * for files that don't know their size, like the
+			 * ones in /proc; only a read tells the end apart.
+			 */
+			if (state->method != COPY_METHOD_READ_WRITE) {
+				state->method = COPY_METHOD_READ_WRITE;
+				continue;
+			}
+			state->size = offset;
+			state->at_end = TRUE;
+			break;
+		}
+
+		offset += n_copied;
+		report_progress (state, n_copied);
+	}
+
+	return TRUE;
+}
+
+static gboolean
+copy_contents (CopyState *state,
+	       gboolean sparse,
+	       GError **error)
+{
+#ifdef SEEK_DATA
+	goffset offset, data, hole, end;
+
+	if (sparse) {
+		offset = 0;
+		while (!state->at_end) {
+			data = lseek (state->src_fd, offset, SEEK_DATA);
+			if (data < 0) {
+				if (errno == ENXIO) {
+					/* Only a hole is left */
+					break;
+				}
+				/* The file system can't tell */
+				return copy_extent (state, offset, G_MAXOFFSET, error);
+			}
+
+			hole = lseek (state->src_fd, data, SEEK_HOLE);
+			if (hole < 0) {
+				hole = G_MAXOFFSET;
+			}
+
+			report_progress (state, data - offset);
+			if (!copy_extent (state, data, hole, error)) {
+				return FALSE;
+			}
+			offset = state->at_end ? state->size : hole;
+		}
+
+		if (!state->at_end) {
+			end = lseek (state->src_fd, 0, SEEK_END);
+			state->size = MAX (end, offset);
+		}
+
+		/* Leaves a hole at the end, if there was one */
+		if (ftruncate (state->dest_fd, state->size) < 0) {
+			set_error_from_errno (error, errno, _("Error writing to file"));
+			return FALSE;
+		}
+		report_progress (state, state->size - offset);
+
+		return TRUE;
+	}
+#endif
+
+	return copy_extent (state, 0, G_MAXOFFSET, error);
+}
+
+static gboolean
+clone_contents (CopyState *state)
+{
+#ifdef FICLONE
+	if (ioctl (state->dest_fd, FICLONE, state->src_fd) == 0) {
+		report_progress (state, state->size);
+		return TRUE;
+	}
+#endif
+	return FALSE;
+}
+
+gboolean
+baul_file_copy_native (GFile                 *source,
+		       GFile                 *destination,
+		       GFileCopyFlags         flags,
+		       GCancellable          *cancellable,
+		       GFileProgressCallback  progress_callback,
+		       gpointer               progress_callback_data,
+		       GError               **error)
+{
+	CopyState state;
+	char *src_path, *dest_path;
+	struct stat statbuf;
+	gboolean res;
+	int open_flags, errsv;
+
+	src_path = NULL;
+	dest_path = NULL;
+	res = FALSE;
+	memset (&state, 0, sizeof (state));
+	state.src_fd = -1;
+	state.dest_fd = -1;
+
+	if (flags & G_FILE_COPY_OVERWRITE) {
+		/* g_file_copy () replaces the file safely */
+		goto not_supported;
+	}
+
+	/* gvfs gives paths into its FUSE mount for remote files too */
+	if (!g_file_is_native (source) || !g_file_is_native (destination)) {
+		goto not_supported;
+	}
+
+	src_path = g_file_get_path (source);
+	dest_path = g_file_get_path (destination);
+	if (src_path == NULL || dest_path == NULL) {
+		goto not_supported;
+	}
+
+	/* Checked before opening, so fifos and devices aren't opened */
+	if (((flags & G_FILE_COPY_NOFOLLOW_SYMLINKS) ?
+	     lstat (src_path, &statbuf) : stat (src_path, &statbuf)) < 0 ||
+	    !S_ISREG (statbuf.st_mode)) {
+		goto not_supported;
+	}
+
+	open_flags = O_RDONLY | O_CLOEXEC;
+	if (flags & G_FILE_COPY_NOFOLLOW_SYMLINKS) {
+		open_flags |= O_NOFOLLOW;
+	}
+	state.src_fd = open (src_path, open_flags);
+	if (state.src_fd < 0 ||
+	    fstat (state.src_fd, &statbuf) < 0 ||
+	    !S_ISREG (statbuf.st_mode)) {
+		goto not_supported;
+	}
+
+	/* The caller copies the permissions afterwards */
+	state.dest_fd = open (dest_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+	if (state.dest_fd < 0) {
+		errsv = errno;
+		if (errsv == EEXIST) {
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_EXISTS,
+					     _("Target file exists"));
+			goto out;
+		}
+		if (errsv == EINVAL) {
+			/* Like g_file_copy (), which takes this for a name
+			 * that isn't valid on the file system, e.g. FAT.
+			 */
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_FILENAME,
+					     _("Invalid filename"));
+			goto out;
+		}
+		/* Let g_file_copy () explain the rest */
+		goto not_supported;
+	}
+
+	state.size = statbuf.st_size;
+	state.method = COPY_METHOD_COPY_FILE_RANGE;
+	state.cancellable = cancellable;
+	state.progress_callback = progress_callback;
+	state.progress_callback_data = progress_callback_data;
+
+	if (!clone_contents (&state) &&
+	    !copy_contents (&state,
+			    (goffset) statbuf.st_blocks * 512 < state.size,
+			    error)) {
+		goto failed;
+	}
+
+	/* Write errors on NFS may only show up here */
+	errsv = close (state.dest_fd) < 0 ? errno : 0;
+	state.dest_fd = -1;
+	if (errsv != 0) {
+		set_error_from_errno (error, errsv, _("Error closing file"));
+		goto failed;
+	}
+
+	res = TRUE;
+	goto out;
+
+ not_supported:
+	g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+			     _("Operation not supported"));
+	goto out;
+
+ failed:
+	/* The file was created above, so it is ours to remove */
+	if (state.dest_fd >= 0) {
+		close (state.dest_fd);
+		state.dest_fd = -1;
+	}
+	unlink (dest_path);
+
+ out:
+	if (state.src_fd >= 0) {
+		close (state.src_fd);
+	}
+	if (state.dest_fd >= 0) {
+		close (state.dest_fd);
+	}
+	g_free (state.buffer);
+	g_free (src_path);
+	g_free (dest_path);
+
+	return res;
+}
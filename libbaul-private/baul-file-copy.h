@@ -0,0 +1,45 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   baul-file-copy.h: Copying the contents of local files in the kernel.
+
+   Copyright (C) 2026 CAFE Desktop.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef BAUL_FILE_COPY_H
+#define BAUL_FILE_COPY_H
+
+#include <gio/gio.h>
+
+/* Copies a local regular file to a new local file, without moving the
+ * data through user space where the kernel and file system allow it.
+ * Only the contents are copied; the caller copies the attributes.
+ *
+ * Fails with G_IO_ERROR_NOT_SUPPORTED, before touching anything, if
+ * the copy should be left to g_file_copy (): for files that aren't
+ * native or regular, or when asked to overwrite. Can be called from
+ * any thread.
+ */
+gboolean baul_file_copy_native (GFile                 *source,
+				GFile                 *destination,
+				GFileCopyFlags         flags,
+				GCancellable          *cancellable,
+				GFileProgressCallback  progress_callback,
+				gpointer               progress_callback_data,
+				GError               **error);
+
+#endif /* BAUL_FILE_COPY_H */
@@ -0,0 +1,330 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   baul-file-delete.c: Deleting local folders on several threads.
+
+   Copyright (C) 2026 CAFE Desktop.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/* Every folder is a task for a few worker threads. A task removes the
+ * files in its folder with unlinkat () and queues a task for each
+ * subfolder, so independent subtrees are deleted in parallel. A
+ * folder keeps a count of its own pass plus the subfolders still
+ * there; whoever brings it to zero removes the folder and goes on
+ * with its parent.
+ *
+ * Folders are opened and removed relative to their parent's file
+ * descriptor, so a folder that is swapped for a symlink halfway
+ * through can't lead the deletion somewhere else. A folder with
+ * subfolders keeps its descriptor open until they are gone. The tasks
+ * are taken depth first, like the native deep count does, so the
+ * open folders are about the ones on the paths the workers are
+ * walking down, not the whole width of the tree.
+ *
+ * The first thing that can't be deleted stops the workers the way
+ * cancellation does, so that GIO can deal with the rest one by one,
+ * like the deletion without the workers does.
+ */
+
+#include <config.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "baul-file-delete.h"
+
+#define DELETE_MAX_THREADS 8
+
+/* How often the progress callback is called, in microseconds */
+#define DELETE_PROGRESS_INTERVAL (100 * 1000)
+
+typedef struct DeleteDir DeleteDir;
+
+struct DeleteDir {
+	DeleteDir *parent;
+	/* Relative to the parent, or the whole path for the top folder */
+	char *name;
+	/* Open while subfolders need it, -1 otherwise */
+	int fd;
+	gint pending;
+};
+
+typedef struct {
+	GCancellable *cancellable;
+	gint n_deleted;
+	gint failed;
+
+	GMutex mutex;
+	GCond cond;
+	/* Folders to read, the most recently found first */
+	GQueue queue;
+	int busy_workers;
+	int running_workers;
+} DeleteState;
+
+/* Set on cancellation or after the first failure. */
+static gboolean
+delete_should_stop (DeleteState *state)
+{
+	return g_cancellable_is_cancelled (state->cancellable) ||
+		g_atomic_int_get (&state->failed);
+}
+
+static DeleteDir *
+delete_dir_new (DeleteDir *parent,
+		char *name)
+{
+	DeleteDir *dir;
+
+	dir = g_new0 (DeleteDir, 1);
+	dir->parent = parent;
+	dir->name = name;
+	dir->fd = -1;
+	dir->pending = 1;
+
+	return dir;
+}
+
+/* Drops one of the things dir waits for, and removes it and the
+ * parents it was the last one for. A parent stays open as long as
+ * one of its subfolders is there, so its descriptor can be used to
+ * remove them.
+ */
+static void
+delete_dir_unref (DeleteState *state,
+		  DeleteDir *dir)
+{
+	DeleteDir *parent;
+
+	while (g_atomic_int_dec_and_test (&dir->pending)) {
+		if (dir->fd >= 0) {
+			close (dir->fd);
+		}
+
+		parent = dir->parent;
+		if (delete_should_stop (state) ||
+		    unlinkat (parent != NULL ? parent->fd : AT_FDCWD,
+			      dir->name, AT_REMOVEDIR) < 0) {
+			g_atomic_int_set (&state->failed, TRUE);
+		} else {
+			g_atomic_int_inc (&state->n_deleted);
+		}
+
+		g_free (dir->name);
+		g_free (dir);
+
+		if (parent == NULL) {
+			return;
+		}
+		dir = parent;
+	}
+}
+
+static gboolean
+entry_is_dir (int dir_fd,
+	      struct dirent *entry)
+{
+	struct stat statbuf;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+	if (entry->d_type != DT_UNKNOWN) {
+		return entry->d_type == DT_DIR;
+	}
+#endif
+	return fstatat (dir_fd, entry->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) == 0 &&
+		S_ISDIR (statbuf.st_mode);
+}
+
+/* Deletes the files in dir, and returns its subfolders to be queued. */
+static GList *
+delete_dir_read (DeleteState *state,
+		 DeleteDir *dir)
+{
+	DeleteDir *subdir;
+	struct dirent *entry;
+	GList *subdirs;
+	DIR *dirp;
+	int fd, n_deleted;
+
+	if (delete_should_stop (state)) {
+		return NULL;
+	}
+
+	dir->fd = openat (dir->parent != NULL ? dir->parent->fd : AT_FDCWD, dir->name,
+			  O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	/* The directory stream gets a copy, so dir->fd outlives it */
+	fd = dir->fd < 0 ? -1 : fcntl (dir->fd, F_DUPFD_CLOEXEC, 0);
+	dirp = fd < 0 ? NULL : fdopendir (fd);
+	if (dirp == NULL) {
+		if (fd >= 0) {
+			close (fd);
+		}
+		g_atomic_int_set (&state->failed, TRUE);
+		return NULL;
+	}
+
+	subdirs = NULL;
+	n_deleted = 0;
+	while ((entry = readdir (dirp)) != NULL &&
+	       !delete_should_stop (state)) {
+		if (strcmp (entry->d_name, ".") == 0 ||
+		    strcmp (entry->d_name, "..") == 0) {
+			continue;
+		}
+
+		if (!entry_is_dir (dir->fd, entry)) {
+			if (unlinkat (dir->fd, entry->d_name, 0) == 0) {
+				n_deleted++;
+				continue;
+			}
+			if (errno != EISDIR && errno != EPERM) {
+				g_atomic_int_set (&state->failed, TRUE);
+				break;
+			}
+			/* It turned into a folder meanwhile */
+		}
+
+		subdir = delete_dir_new (dir, g_strdup (entry->d_name));
+		g_atomic_int_inc (&dir->pending);
+		subdirs = g_list_prepend (subdirs, subdir);
+	}
+
+	closedir (dirp);
+
+	if (subdirs == NULL) {
+		close (dir->fd);
+		dir->fd = -1;
+	}
+
+	/* Progress is only added up once per folder */
+	g_atomic_int_add (&state->n_deleted, n_deleted);
+
+	return subdirs;
+}
+
+static gpointer
+delete_worker (gpointer user_data)
+{
+	DeleteState *state;
+	DeleteDir *dir;
+	GList *subdirs, *l;
+
+	state = user_data;
+
+	g_mutex_lock (&state->mutex);
+	while (TRUE) {
+		dir = g_queue_pop_head (&state->queue);
+		if (dir == NULL) {
+			if (state->busy_workers == 0) {
+				/* Nothing left, and nobody will add more */
+				break;
+			}
+			g_cond_wait (&state->cond, &state->mutex);
+			continue;
+		}
+
+		state->busy_workers++;
+		g_mutex_unlock (&state->mutex);
+
+		/* Also when stopping, so every folder is freed */
+		subdirs = delete_dir_read (state, dir);
+		delete_dir_unref (state, dir);
+
+		g_mutex_lock (&state->mutex);
+		for (l = subdirs; l != NULL; l = l->next) {
+			g_queue_push_head (&state->queue, l->data);
+		}
+		g_list_free (subdirs);
+		state->busy_workers--;
+		g_cond_broadcast (&state->cond);
+	}
+
+	state->running_workers--;
+	g_cond_broadcast (&state->cond);
+	g_mutex_unlock (&state->mutex);
+
+	return NULL;
+}
+
+gboolean
+baul_file_delete_native (GFile                      *dir,
+			 GCancellable               *cancellable,
+			 BaulDeleteProgressCallback  progress_callback,
+			 gpointer                    callback_data)
+{
+	DeleteState state;
+	struct stat statbuf;
+	GThread **threads;
+	char *path;
+	gint64 report_time;
+	int n_threads, i;
+
+	path = g_file_get_path (dir);
+	if (path == NULL) {
+		return FALSE;
+	}
+	if (lstat (path, &statbuf) < 0 || !S_ISDIR (statbuf.st_mode)) {
+		g_free (path);
+		return FALSE;
+	}
+
+	memset (&state, 0, sizeof (state));
+	state.cancellable = cancellable;
+	g_mutex_init (&state.mutex);
+	g_cond_init (&state.cond);
+	g_queue_init (&state.queue);
+	g_queue_push_head (&state.queue, delete_dir_new (NULL, path));
+
+	n_threads = CLAMP ((int) g_get_num_processors (), 1, DELETE_MAX_THREADS);
+	state.running_workers = n_threads;
+	threads = g_new (GThread *, n_threads);
+	for (i = 0; i < n_threads; i++) {
+		threads[i] = g_thread_new ("baul-delete", delete_worker, &state);
+	}
+
+	g_mutex_lock (&state.mutex);
+	report_time = g_get_monotonic_time () + DELETE_PROGRESS_INTERVAL;
+	while (state.running_workers > 0) {
+		/* The workers wake us up often, so keep to the schedule */
+		if (!g_cond_wait_until (&state.cond, &state.mutex, report_time)) {
+			if (progress_callback != NULL) {
+				g_mutex_unlock (&state.mutex);
+				progress_callback (g_atomic_int_get (&state.n_deleted), callback_data);
+				g_mutex_lock (&state.mutex);
+			}
+			report_time = g_get_monotonic_time () + DELETE_PROGRESS_INTERVAL;
+		}
+	}
+	g_mutex_unlock (&state.mutex);
+
+	for (i = 0; i < n_threads; i++) {
+		g_thread_join (threads[i]);
+	}
+	g_free (threads);
+	g_mutex_clear (&state.mutex);
+	g_cond_clear (&state.cond);
+
+	if (progress_callback != NULL) {
+		progress_callback (g_atomic_int_get (&state.n_deleted), callback_data);
+	}
+
+	return !g_atomic_int_get (&state.failed);
+}
@@ -0,0 +1,46 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   baul-file-delete.h: Deleting local folders on several threads.
+
+   Copyright (C) 2026 CAFE Desktop.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef BAUL_FILE_DELETE_H
+#define BAUL_FILE_DELETE_H
+
+#include <gio/gio.h>
+
+/* Called on the calling thread, with the number of files and folders
+ * deleted so far.
+ */
+typedef void (* BaulDeleteProgressCallback) (int      n_deleted,
+					     gpointer callback_data);
+
+/* Deletes a local folder and everything in it, and blocks until done.
+ * Returns FALSE if dir isn't a native folder, on cancellation, or if
+ * anything in it could not be deleted. It stops at the first failure;
+ * what was deleted by then is gone, and the rest is left for the
+ * caller to deal with, e.g. with GIO and asking the user about the
+ * errors.
+ */
+gboolean baul_file_delete_native (GFile                      *dir,
+				  GCancellable               *cancellable,
+				  BaulDeleteProgressCallback  progress_callback,
+				  gpointer                    callback_data);
+
+#endif /* BAUL_FILE_DELETE_H */
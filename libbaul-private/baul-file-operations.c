@@ -34,6 +34,9 @@
 #include <math.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <glib/gi18n.h>
 #include <glib/gstdio.h>
@@ -64,6 +67,8 @@
 #include "baul-trash-monitor.h"
 #include "baul-file-utilities.h"
 #include "baul-file-conflict-dialog.h"
+#include "baul-file-copy.h"
+#include "baul-file-delete.h"
 #include "baul-undostack-manager.h"
 
 /* TODO: TESTING!!! */
@@ -86,6 +91,35 @@ typedef struct {
 	BaulUndoStackActionData* undo_redo_data;
 } CommonJob;
 
+/* Copies small files on worker threads while the job thread walks the
+ * source tree. See copy_pool_add().
+ */
+typedef struct {
+	GThreadPool *threads;
+	GAsyncQueue *done;
+	int n_in_flight;
+	GList *deferred_dirs;
+} CopyPool;
+
+/* Counts the files to copy or move on a thread of its own, while the
+ * job thread already works through them. See source_scan_start().
+ */
+typedef struct {
+	GList *files;
+	GCancellable *cancellable;
+	GThread *thread;
+
+	GMutex mutex;
+	int num_files;
+	goffset num_bytes;
+	gboolean done;
+
+	/* Only used on the job thread */
+	GFile *dest;
+	goffset space_limit;
+	gboolean space_checked;
+} SourceScan;
+
 typedef struct {
 	CommonJob common;
 	gboolean is_move;
@@ -97,6 +131,8 @@ typedef struct {
 	GHashTable *debuting_files;
 	BaulCopyCallback  done_callback;
 	gpointer done_callback_data;
+	CopyPool *pool;
+	SourceScan *scan;
 } CopyMoveJob;
 
 typedef struct {
@@ -163,6 +199,7 @@ typedef struct {
 	goffset num_bytes;
 	int num_files_since_progress;
 	OpKind op;
+	gboolean scanning;
 } SourceInfo;
 
 typedef struct {
@@ -176,6 +213,15 @@ typedef struct {
 #define SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE 15
 #define NSEC_PER_MICROSEC 1000
 
+/* Small copies are bound by latency rather than by the CPU, so the
+ * number of copy threads doesn't depend on the number of processors.
+ */
+#define COPY_POOL_MAX_THREADS 8
+#define COPY_POOL_MAX_IN_FLIGHT (4 * COPY_POOL_MAX_THREADS)
+#define COPY_POOL_MAX_FILE_SIZE (1024 * 1024)
+
+#define TRASH_BATCH_SIZE 256
+
 #define MAXIMUM_DISPLAYED_FILE_NAME_LENGTH 50
 
 #define IS_IO_ERROR(__error, KIND) (((__error)->domain == G_IO_ERROR && (__error)->code == G_IO_ERROR_ ## KIND))
@@ -1728,6 +1774,52 @@ delete_dir (CommonJob    *job,
 	}
 }
 
+typedef struct {
+	CommonJob *job;
+	SourceInfo *source_info;
+	TransferInfo *transfer_info;
+	int num_files;
+} DeleteProgressData;
+
+static void
+delete_native_progress_callback (int n_deleted,
+				 gpointer callback_data)
+{
+	DeleteProgressData *pdata;
+
+	pdata = callback_data;
+	pdata->transfer_info->num_files = pdata->num_files + n_deleted;
+	report_delete_progress (pdata->job, pdata->source_info, pdata->transfer_info);
+}
+
+/* Deletes local folders without GIO and on several threads. Anything
+ * it leaves behind is handled by delete_dir(), which asks the user.
+ */
+static gboolean
+delete_dir_native (CommonJob *job,
+		   GFile *dir,
+		   SourceInfo *source_info,
+		   TransferInfo *transfer_info)
+{
+	DeleteProgressData pdata;
+
+	/* Honour the files the user chose to skip while scanning */
+	if (job->skip_files != NULL ||
+	    job->skip_readdir_error != NULL ||
+	    !g_file_is_native (dir)) {
+		return FALSE;
+	}
+
+	pdata.job = job;
+	pdata.source_info = source_info;
+	pdata.transfer_info = transfer_info;
+	pdata.num_files = transfer_info->num_files;
+
+	return baul_file_delete_native (dir, job->cancellable,
+					delete_native_progress_callback,
+					&pdata);
+}
+
 static void
 delete_file (CommonJob *job, GFile *file,
 	     gboolean *skipped_file,
@@ -1754,6 +1846,10 @@ delete_file (CommonJob *job, GFile *file,
 
 	if (IS_IO_ERROR (error, NOT_EMPTY)) {
 		g_error_free (error);
+		if (delete_dir_native (job, file, source_info, transfer_info)) {
+			baul_file_changes_queue_file_removed (file);
+			return;
+		}
 		delete_dir (job, file,
 			    skipped_file,
 			    source_info, transfer_info,
@@ -1862,18 +1958,351 @@ report_trash_progress (CommonJob *job,
 }
 
 
+/* Files on the same file system as the trash in the home folder are
+ * trashed in batches, the way g_file_trash () does it for one file:
+ * the trash info files of a whole batch are written first, then the
+ * files are renamed into the trash, and the view hears about them in
+ * one go.
+ */
+typedef struct {
+	char *trash_dir;
+	char *files_dir;
+	char *info_dir;
+	dev_t dev;
+	GList *files;
+	GArray *mtimes;
+} TrashBatch;
+
+static TrashBatch *
+trash_batch_new (void)
+{
+	TrashBatch *batch;
+	struct stat statbuf;
+
+	batch = g_new0 (TrashBatch, 1);
+	batch->trash_dir = g_build_filename (g_get_user_data_dir (), "Trash", NULL);
+	batch->files_dir = g_build_filename (batch->trash_dir, "files", NULL);
+	batch->info_dir = g_build_filename (batch->trash_dir, "info", NULL);
+	batch->mtimes = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+	if (g_mkdir_with_parents (batch->files_dir, 0700) < 0 ||
+	    g_mkdir_with_parents (batch->info_dir, 0700) < 0 ||
+	    g_stat (batch->files_dir, &statbuf) < 0) {
+		g_free (batch->trash_dir);
+		g_free (batch->files_dir);
+		g_free (batch->info_dir);
+		g_array_free (batch->mtimes, TRUE);
+		g_free (batch);
+		return NULL;
+	}
+	batch->dev = statbuf.st_dev;
+
+	return batch;
+}
+
+static void
+trash_batch_free (TrashBatch *batch)
+{
+	g_assert (batch->files == NULL);
+
+	g_free (batch->trash_dir);
+	g_free (batch->files_dir);
+	g_free (batch->info_dir);
+	g_array_free (batch->mtimes, TRUE);
+	g_free (batch);
+}
+
+/* Returns FALSE for the files g_file_trash () has to take care of */
+static gboolean
+trash_batch_add (TrashBatch *batch,
+		 GFile *file)
+{
+	struct stat statbuf;
+	char *path;
+	guint64 mtime;
+	gboolean res;
+
+	path = g_file_get_path (file);
+	if (path == NULL) {
+		return FALSE;
+	}
+
+	res = g_lstat (path, &statbuf) == 0 &&
+		statbuf.st_dev == batch->dev &&
+		!g_str_has_prefix (path, batch->trash_dir);
+	g_free (path);
+
+	if (res) {
+		mtime = statbuf.st_mtime;
+		batch->files = g_list_prepend (batch->files, g_object_ref (file));
+		g_array_append_val (batch->mtimes, mtime);
+	}
+
+	return res;
+}
+
+static gboolean
+trash_batch_consume_changes (gpointer user_data G_GNUC_UNUSED)
+{
+	baul_file_changes_consume_changes (TRUE);
+	return FALSE;
+}
+
+static char *
+trash_batch_create_info (TrashBatch *batch,
+			 const char *path,
+			 const char *deletion_date,
+			 char **info_path)
+{
+	char *basename, *trash_name, *info_name, *escaped, *data;
+	int fd, i, errsv;
+	gboolean res;
+
+	basename = g_path_get_basename (path);
+	trash_name = NULL;
+	*info_path = NULL;
+	fd = -1;
+	errsv = EEXIST;
+
+	for (i = 1; fd < 0 && errsv == EEXIST; i++) {
+		g_free (trash_name);
+		g_free (*info_path);
+		trash_name = i == 1 ? g_strdup (basename) : g_strdup_printf ("%s.%d", basename, i);
+		info_name = g_strconcat (trash_name, ".trashinfo", NULL);
+		*info_path = g_build_filename (batch->info_dir, info_name, NULL);
+		g_free (info_name);
+
+		fd = g_open (*info_path, O_CREAT | O_EXCL | O_WRONLY, 0600);
+		errsv = errno;
+	}
+	g_free (basename);
+
+	if (fd < 0) {
+		g_free (trash_name);
+		g_free (*info_path);
+		*info_path = NULL;
+		return NULL;
+	}
+
+	escaped = g_uri_escape_string (path, "/", FALSE);
+	data = g_strdup_printf ("[Trash Info]\nPath=%s\nDeletionDate=%s\n",
+				escaped, deletion_date);
+	res = write (fd, data, strlen (data)) == (gssize) strlen (data);
+	res = close (fd) == 0 && res;
+	g_free (escaped);
+	g_free (data);
+
+	if (!res) {
+		g_unlink (*info_path);
+		g_free (*info_path);
+		*info_path = NULL;
+		g_free (trash_name);
+		return NULL;
+	}
+
+	return trash_name;
+}
+
+/* Returns the number of files trashed. The ones that could not be are
+ * added to failed, to go through g_file_trash ().
+ */
+static int
+trash_batch_flush (CommonJob *job,
+		   TrashBatch *batch,
+		   GList **failed)
+{
+	GList *files, *trashed, *l;
+	GArray *mtimes, *trashed_mtimes;
+	GDateTime *now;
+	char *deletion_date, *path, *trash_name, *trash_path;
+	char **info_paths, **trash_names;
+	int i, n_files, n_trashed;
+
+	if (batch->files == NULL) {
+		return 0;
+	}
+
+	files = g_list_reverse (batch->files);
+	batch->files = NULL;
+	mtimes = batch->mtimes;
+	batch->mtimes = g_array_new (FALSE, FALSE, sizeof (guint64));
+	n_files = mtimes->len;
+
+	now = g_date_time_new_now_local ();
+	deletion_date = g_date_time_format (now, "%Y-%m-%dT%H:%M:%S");
+	g_date_time_unref (now);
+
+	/* Write all the trash info files first... */
+	info_paths = g_new0 (char *, n_files);
+	trash_names = g_new0 (char *, n_files);
+	for (l = files, i = 0; l != NULL; l = l->next, i++) {
+		path = g_file_get_path (l->data);
+		trash_names[i] = trash_batch_create_info (batch, path, deletion_date,
+							  &info_paths[i]);
+		g_free (path);
+	}
+	g_free (deletion_date);
+
+	/* ...then move the files in */
+	trashed = NULL;
+	trashed_mtimes = g_array_sized_new (FALSE, FALSE, sizeof (guint64), n_files);
+	n_trashed = 0;
+	for (l = files, i = 0; l != NULL; l = l->next, i++) {
+		trash_name = trash_names[i];
+		if (trash_name != NULL && !job_aborted (job)) {
+			path = g_file_get_path (l->data);
+			trash_path = g_build_filename (batch->files_dir, trash_name, NULL);
+			if (g_rename (path, trash_path) == 0) {
+				baul_file_changes_queue_file_removed (l->data);
+				trashed = g_list_prepend (trashed, l->data);
+				g_array_append_val (trashed_mtimes,
+						    g_array_index (mtimes, guint64, i));
+				n_trashed++;
+				trash_name = NULL;
+			}
+			g_free (trash_path);
+			g_free (path);
+		}
+
+		if (trash_name != NULL || trash_names[i] == NULL) {
+			if (info_paths[i] != NULL) {
+				g_unlink (info_paths[i]);
+			}
+			if (!job_aborted (job)) {
+				*failed = g_list_prepend (*failed, g_object_ref (l->data));
+			}
+		}
+		g_free (trash_names[i]);
+		g_free (info_paths[i]);
+	}
+	g_free (trash_names);
+	g_free (info_paths);
+
+	// Start UNDO-REDO
+	trashed = g_list_reverse (trashed);
+	baul_undostack_manager_data_add_trashed_files (job->undo_redo_data, trashed,
+							   (guint64 *) trashed_mtimes->data);
+	// End UNDO-REDO
+
+	g_list_free (trashed);
+	g_array_free (trashed_mtimes, TRUE);
+	g_array_free (mtimes, TRUE);
+	g_list_free_full (files, g_object_unref);
+
+	if (n_trashed > 0) {
+		g_io_scheduler_job_send_to_mainloop_async (job->io_job,
+							   trash_batch_consume_changes,
+							   NULL,
+							   NULL);
+	}
+
+	return n_trashed;
+}
+
+static void
+trash_file (CommonJob *job,
+	    GFile *file,
+	    int *files_trashed,
+	    int *total_files,
+	    GList **to_delete,
+	    int *files_skipped)
+{
+	GError *error;
+	char *primary, *secondary, *details;
+	int response;
+	guint64 mtime;
+
+	error = NULL;
+
+	mtime = baul_undostack_manager_get_file_modification_time (file);
+
+	if (!g_file_trash (file, job->cancellable, &error)) {
+		if (job->skip_all_error) {
+			(*files_skipped)++;
+			goto skip;
+		}
+
+		if (job->delete_all) {
+			*to_delete = g_list_prepend (*to_delete, file);
+			goto skip;
+		}
+
+		primary = f (_("Cannot move file to trash, do you want to delete immediately?"));
+		secondary = f (_("The file \"%B\" cannot be moved to the trash."), file);
+		details = NULL;
+		if (!IS_IO_ERROR (error, NOT_SUPPORTED)) {
+			details = error->message;
+		}
+
+		response = run_question (job,
+					 primary,
+					 secondary,
+					 details,
+					 (*total_files - *files_trashed) > 1,
+					 CANCEL, SKIP_ALL, SKIP, DELETE_ALL, DELETE,
+					 NULL);
+
+		if (response == 0 || response == CTK_RESPONSE_DELETE_EVENT) {
+			((DeleteJob *) job)->user_cancel = TRUE;
+			abort_job (job);
+		} else if (response == 1) { /* skip all */
+			(*files_skipped)++;
+			job->skip_all_error = TRUE;
+		} else if (response == 2) { /* skip */
+			(*files_skipped)++;
+		} else if (response == 3) { /* delete all */
+			*to_delete = g_list_prepend (*to_delete, file);
+			job->delete_all = TRUE;
+		} else if (response == 4) { /* delete */
+			*to_delete = g_list_prepend (*to_delete, file);
+		}
+
+	skip:
+		g_error_free (error);
+		(*total_files)--;
+	} else {
+		baul_file_changes_queue_file_removed (file);
+
+		// Start UNDO-REDO
+		baul_undostack_manager_data_add_trashed_file (job->undo_redo_data, file, mtime);
+		// End UNDO-REDO
+
+		(*files_trashed)++;
+		report_trash_progress (job, *files_trashed, *total_files);
+	}
+}
+
+static void
+trash_files_flush (CommonJob *job,
+		   TrashBatch *batch,
+		   int *files_trashed,
+		   int *total_files,
+		   GList **to_delete,
+		   int *files_skipped)
+{
+	GList *failed, *l;
+
+	failed = NULL;
+	*files_trashed += trash_batch_flush (job, batch, &failed);
+	report_trash_progress (job, *files_trashed, *total_files);
+
+	/* g_file_trash () reports the errors */
+	failed = g_list_reverse (failed);
+	for (l = failed; l != NULL && !job_aborted (job); l = l->next) {
+		trash_file (job, l->data, files_trashed, total_files,
+			    to_delete, files_skipped);
+	}
+	g_list_free_full (failed, g_object_unref);
+}
+
 static void
 trash_files (CommonJob *job, GList *files, int *files_skipped)
 {
 	GList *l;
 	GFile *file;
 	GList *to_delete;
-	GError *error;
+	TrashBatch *batch;
 	int total_files, files_trashed;
-	char *primary, *secondary, *details;
-	int response;
-
-	guint64 mtime;
 
 	if (job_aborted (job)) {
 		return;
@@ -1884,6 +2313,8 @@ trash_files (CommonJob *job, GList *files, int *files_skipped)
 
 	report_trash_progress (job, files_trashed, total_files);
 
+	batch = trash_batch_new ();
+
 	to_delete = NULL;
 	for (l = files;
 	     l != NULL && !job_aborted (job);
@@ -1892,64 +2323,22 @@ trash_files (CommonJob *job, GList *files, int *files_skipped)
 
 		file = l->data;
 
-		error = NULL;
-
-		mtime = baul_undostack_manager_get_file_modification_time (file);
-
-		if (!g_file_trash (file, job->cancellable, &error)) {
-			if (job->skip_all_error) {
-				(*files_skipped)++;
-				goto skip;
-			}
-
-			if (job->delete_all) {
-				to_delete = g_list_prepend (to_delete, file);
-				goto skip;
-			}
-
-			primary = f (_("Cannot move file to trash, do you want to delete immediately?"));
-			secondary = f (_("The file \"%B\" cannot be moved to the trash."), file);
-			details = NULL;
-			if (!IS_IO_ERROR (error, NOT_SUPPORTED)) {
-				details = error->message;
-			}
-
-			response = run_question (job,
-						 primary,
-						 secondary,
-						 details,
-						 (total_files - files_trashed) > 1,
-						 CANCEL, SKIP_ALL, SKIP, DELETE_ALL, DELETE,
-						 NULL);
-
-			if (response == 0 || response == CTK_RESPONSE_DELETE_EVENT) {
-				((DeleteJob *) job)->user_cancel = TRUE;
-				abort_job (job);
-			} else if (response == 1) { /* skip all */
-				(*files_skipped)++;
-				job->skip_all_error = TRUE;
-			} else if (response == 2) { /* skip */
-				(*files_skipped)++;
-			} else if (response == 3) { /* delete all */
-				to_delete = g_list_prepend (to_delete, file);
-				job->delete_all = TRUE;
-			} else if (response == 4) { /* delete */
-				to_delete = g_list_prepend (to_delete, file);
+		if (batch != NULL && trash_batch_add (batch, file)) {
+			if (batch->mtimes->len >= TRASH_BATCH_SIZE) {
+				trash_files_flush (job, batch, &files_trashed, &total_files,
+						   &to_delete, files_skipped);
 			}
+			continue;
+		}
 
-		skip:
-			g_error_free (error);
-			total_files--;
-		} else {
-			baul_file_changes_queue_file_removed (file);
-
-			// Start UNDO-REDO
-			baul_undostack_manager_data_add_trashed_file (job->undo_redo_data, file, mtime);
-			// End UNDO-REDO
+		trash_file (job, file, &files_trashed, &total_files,
+			    &to_delete, files_skipped);
+	}
 
-			files_trashed++;
-			report_trash_progress (job, files_trashed, total_files);
-		}
+	if (batch != NULL) {
+		trash_files_flush (job, batch, &files_trashed, &total_files,
+				   &to_delete, files_skipped);
+		trash_batch_free (batch);
 	}
 
 	if (to_delete) {
@@ -2840,6 +3229,30 @@ scan_sources (GList *files,
 	report_count_progress (job, source_info);
 }
 
+static int
+run_not_enough_space_warning (CommonJob *job,
+			      GFile *dest,
+			      guint64 free_size,
+			      goffset required_size)
+{
+	char *primary, *secondary, *details;
+
+	primary = f (_("Error while copying to \"%B\"."), dest);
+	secondary = f(_("There is not enough space on the destination. Try to remove files to make space."));
+
+	details = f (_("There is %S available, but %S is required."), free_size, required_size);
+
+	return run_warning (job,
+			    primary,
+			    secondary,
+			    details,
+			    FALSE,
+			    CANCEL,
+			    COPY_FORCE,
+			    RETRY,
+			    NULL);
+}
+
 static void
 verify_destination (CommonJob *job,
 		    GFile *dest,
@@ -2948,20 +3361,8 @@ verify_destination (CommonJob *job,
 							      G_FILE_ATTRIBUTE_FILESYSTEM_FREE);
 
 		if (free_size < required_size) {
-			primary = f (_("Error while copying to \"%B\"."), dest);
-			secondary = f(_("There is not enough space on the destination. Try to remove files to make space."));
-
-			details = f (_("There is %S available, but %S is required."), free_size, required_size);
-
-			response = run_warning (job,
-						primary,
-						secondary,
-						details,
-						FALSE,
-						CANCEL,
-						COPY_FORCE,
-						RETRY,
-						NULL);
+			response = run_not_enough_space_warning (job, dest,
+								 free_size, required_size);
 
 			if (response == 0 || response == CTK_RESPONSE_DELETE_EVENT) {
 				abort_job (job);
@@ -2998,42 +3399,286 @@ verify_destination (CommonJob *job,
 }
 
 static void
-report_copy_progress (CopyMoveJob *copy_job,
-		      SourceInfo *source_info,
-		      TransferInfo *transfer_info)
+source_scan_add (SourceScan *scan,
+		 int num_files,
+		 goffset num_bytes)
 {
-	int files_left;
-	goffset total_size;
-	double elapsed, transfer_rate;
-	guint64 now;
-	CommonJob *job;
-	gboolean is_move;
-
-	job = (CommonJob *)copy_job;
-
-	is_move = copy_job->is_move;
+	g_mutex_lock (&scan->mutex);
+	scan->num_files += num_files;
+	scan->num_bytes += num_bytes;
+	g_mutex_unlock (&scan->mutex);
+}
 
-	now = g_get_monotonic_time ();
+static void
+source_scan_dir (SourceScan *scan,
+		 GFile *dir,
+		 GQueue *dirs)
+{
+	GFileEnumerator *enumerator;
+	GFileInfo *info;
+	int num_files;
+	goffset num_bytes;
 
-	if (transfer_info->last_report_time != 0 &&
-	    ABS ((gint64)(transfer_info->last_report_time - now)) < 100 * NSEC_PER_MICROSEC) {
+	enumerator = g_file_enumerate_children (dir,
+						G_FILE_ATTRIBUTE_STANDARD_NAME","
+						G_FILE_ATTRIBUTE_STANDARD_TYPE","
+						G_FILE_ATTRIBUTE_STANDARD_SIZE,
+						G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+						scan->cancellable,
+						NULL);
+	if (enumerator == NULL) {
 		return;
 	}
-	transfer_info->last_report_time = now;
-
-	files_left = source_info->num_files - transfer_info->num_files;
 
-	/* Races and whatnot could cause this to be negative... */
-	if (files_left < 0) {
-		files_left = 1;
-	}
+	num_files = 0;
+	num_bytes = 0;
+	while ((info = g_file_enumerator_next_file (enumerator, scan->cancellable, NULL)) != NULL) {
+		num_files++;
+		num_bytes += g_file_info_get_size (info);
+
+		if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+			/* Push to head, since we want depth-first */
+			g_queue_push_head (dirs, g_file_get_child (dir, g_file_info_get_name (info)));
+		}
+		g_object_unref (info);
+
+		if (num_files == 100) {
+			source_scan_add (scan, num_files, num_bytes);
+			num_files = 0;
+			num_bytes = 0;
+		}
+	}
+	source_scan_add (scan, num_files, num_bytes);
+
+	g_file_enumerator_close (enumerator, scan->cancellable, NULL);
+	g_object_unref (enumerator);
+}
+
+/* Errors are ignored here, the job runs into the same ones and asks
+ * the user about them.
+ */
+static gpointer
+source_scan_thread (gpointer data)
+{
+	SourceScan *scan;
+	GFileInfo *info;
+	GQueue *dirs;
+	GFile *dir;
+	GList *l;
+
+	scan = data;
+	dirs = g_queue_new ();
+
+	for (l = scan->files;
+	     l != NULL && !g_cancellable_is_cancelled (scan->cancellable);
+	     l = l->next) {
+		info = g_file_query_info (l->data,
+					  G_FILE_ATTRIBUTE_STANDARD_TYPE","
+					  G_FILE_ATTRIBUTE_STANDARD_SIZE,
+					  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+					  scan->cancellable,
+					  NULL);
+		if (info == NULL) {
+			continue;
+		}
+
+		source_scan_add (scan, 1, g_file_info_get_size (info));
+		if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+			g_queue_push_head (dirs, g_object_ref (l->data));
+		}
+		g_object_unref (info);
+
+		while (!g_cancellable_is_cancelled (scan->cancellable) &&
+		       (dir = g_queue_pop_head (dirs)) != NULL) {
+			source_scan_dir (scan, dir, dirs);
+			g_object_unref (dir);
+		}
+	}
+
+	g_queue_free_full (dirs, g_object_unref);
+
+	g_mutex_lock (&scan->mutex);
+	scan->done = TRUE;
+	g_mutex_unlock (&scan->mutex);
+
+	return NULL;
+}
+
+/* Instead of counting all the files before starting, the job starts
+ * right away and the totals in source_info grow while the scan goes
+ * on. The space on dest is checked as they grow, by
+ * source_scan_check_space().
+ */
+static void
+source_scan_start (CopyMoveJob *job,
+		   GList *files,
+		   GFile *dest,
+		   OpKind kind,
+		   SourceInfo *source_info)
+{
+	SourceScan *scan;
+
+	memset (source_info, 0, sizeof (SourceInfo));
+	source_info->op = kind;
+	source_info->scanning = TRUE;
+
+	scan = g_new0 (SourceScan, 1);
+	scan->files = g_list_copy_deep (files, (GCopyFunc) g_object_ref, NULL);
+	scan->cancellable = g_cancellable_new ();
+	g_mutex_init (&scan->mutex);
+	scan->dest = g_object_ref (dest);
+
+	scan->thread = g_thread_new ("baul-source-scan", source_scan_thread, scan);
+
+	job->scan = scan;
+}
+
+static void
+source_scan_stop (CopyMoveJob *job)
+{
+	SourceScan *scan;
+
+	scan = job->scan;
+	if (scan == NULL) {
+		return;
+	}
+
+	g_cancellable_cancel (scan->cancellable);
+	g_thread_join (scan->thread);
+
+	g_list_free_full (scan->files, g_object_unref);
+	g_object_unref (scan->cancellable);
+	g_mutex_clear (&scan->mutex);
+	g_object_unref (scan->dest);
+	g_free (scan);
+
+	job->scan = NULL;
+}
+
+static void
+source_scan_update (SourceScan *scan,
+		    SourceInfo *source_info)
+{
+	g_mutex_lock (&scan->mutex);
+	source_info->num_files = scan->num_files;
+	source_info->num_bytes = scan->num_bytes;
+	source_info->scanning = !scan->done;
+	g_mutex_unlock (&scan->mutex);
+}
+
+/* Called between files. The free space is only looked up again when
+ * the files found so far may not fit into what was free last time,
+ * and once more when the scan is done.
+ */
+static void
+source_scan_check_space (CopyMoveJob *job,
+			 SourceInfo *source_info,
+			 TransferInfo *transfer_info)
+{
+	SourceScan *scan;
+	CommonJob *common;
+	GFileInfo *fsinfo;
+	guint64 free_size;
+	goffset required_size;
+	int response;
+
+	scan = job->scan;
+	common = (CommonJob *)job;
+
+	if (scan == NULL || scan->space_checked) {
+		return;
+	}
+
+	source_scan_update (scan, source_info);
+	if (source_info->scanning &&
+	    source_info->num_bytes <= scan->space_limit) {
+		return;
+	}
+
+ retry:
+	fsinfo = g_file_query_filesystem_info (scan->dest,
+					       G_FILE_ATTRIBUTE_FILESYSTEM_FREE,
+					       common->cancellable,
+					       NULL);
+	if (fsinfo == NULL ||
+	    !g_file_info_has_attribute (fsinfo, G_FILE_ATTRIBUTE_FILESYSTEM_FREE)) {
+		/* Not all file systems can tell */
+		scan->space_checked = TRUE;
+		if (fsinfo != NULL) {
+			g_object_unref (fsinfo);
+		}
+		return;
+	}
+
+	free_size = g_file_info_get_attribute_uint64 (fsinfo,
+						      G_FILE_ATTRIBUTE_FILESYSTEM_FREE);
+	g_object_unref (fsinfo);
+
+	/* What is copied from now on takes from the free space */
+	required_size = source_info->num_bytes - transfer_info->num_bytes;
+	scan->space_limit = free_size + transfer_info->num_bytes;
+
+	if (required_size > 0 && free_size < (guint64) required_size) {
+		response = run_not_enough_space_warning (common, scan->dest,
+							 free_size, required_size);
+
+		if (response == 0 || response == CTK_RESPONSE_DELETE_EVENT) {
+			abort_job (common);
+		} else if (response == 2) {
+			source_scan_update (scan, source_info);
+			goto retry;
+		} else if (response == 1) {
+			/* We are forced to copy, so stop asking */
+			scan->space_checked = TRUE;
+		} else {
+			g_assert_not_reached ();
+		}
+	} else if (!source_info->scanning) {
+		scan->space_checked = TRUE;
+	}
+}
+
+static void
+report_copy_progress (CopyMoveJob *copy_job,
+		      SourceInfo *source_info,
+		      TransferInfo *transfer_info)
+{
+	int files_left;
+	goffset total_size;
+	double elapsed, transfer_rate;
+	guint64 now;
+	CommonJob *job;
+	gboolean is_move;
+
+	job = (CommonJob *)copy_job;
+
+	is_move = copy_job->is_move;
+
+	now = g_get_monotonic_time ();
+
+	if (transfer_info->last_report_time != 0 &&
+	    ABS ((gint64)(transfer_info->last_report_time - now)) < 100 * NSEC_PER_MICROSEC) {
+		return;
+	}
+	transfer_info->last_report_time = now;
+
+	if (copy_job->scan != NULL) {
+		source_scan_update (copy_job->scan, source_info);
+	}
+
+	files_left = source_info->num_files - transfer_info->num_files;
+
+	/* Races and whatnot could cause this to be negative... */
+	if (files_left < 0) {
+		files_left = 1;
+	}
 
 	if (files_left != transfer_info->last_reported_files_left ||
 	    transfer_info->last_reported_files_left == 0) {
 		/* Avoid changing this unless files_left changed since last time */
 		transfer_info->last_reported_files_left = files_left;
 
-		if (source_info->num_files == 1) {
+		if (source_info->num_files == 1 && !source_info->scanning) {
 			if (copy_job->destination != NULL) {
 				baul_progress_info_take_status (job->progress,
 								    f (is_move ?
@@ -3099,8 +3744,10 @@ report_copy_progress (CopyMoveJob *copy_job,
 		transfer_rate = transfer_info->num_bytes / elapsed;
 	}
 
-	if (elapsed < SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE &&
-	    transfer_rate > 0) {
+	/* No time left while the total is still growing */
+	if ((elapsed < SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE &&
+	     transfer_rate > 0) ||
+	    source_info->scanning) {
 		char *s;
 		/* Translators: %S will expand to a size like "2 bytes" or "3 MB", so something like "4 kb of 4 MB" */
 		s = f (_("%S of %S"), transfer_info->num_bytes, total_size);
@@ -3542,6 +4189,324 @@ create_dest_dir (CommonJob *job,
 	return CREATE_DEST_DIR_SUCCESS;
 }
 
+/* Like g_file_copy (), but lets the kernel copy the data of local files */
+static gboolean
+copy_file_contents (GFile *src,
+		    GFile *dest,
+		    GFileCopyFlags flags,
+		    GCancellable *cancellable,
+		    GFileProgressCallback progress_callback,
+		    gpointer progress_callback_data,
+		    GError **error)
+{
+	GError *native_error;
+
+	native_error = NULL;
+	if (baul_file_copy_native (src, dest, flags, cancellable,
+				   progress_callback, progress_callback_data,
+				   &native_error)) {
+		return TRUE;
+	}
+
+	if (!IS_IO_ERROR (native_error, NOT_SUPPORTED)) {
+		g_propagate_error (error, native_error);
+		return FALSE;
+	}
+	g_error_free (native_error);
+
+	return g_file_copy (src, dest, flags, cancellable,
+			    progress_callback, progress_callback_data,
+			    error);
+}
+
+typedef struct {
+	GFile *src;
+	GFile *dest;
+	GFile *dest_dir;
+	GFileCopyFlags flags;
+	goffset size;
+	gboolean same_fs;
+	gboolean readonly_source_fs;
+	GCancellable *cancellable;
+	gboolean res;
+	GError *error;
+} CopyTask;
+
+typedef struct {
+	GFile *src;
+	GFile *dest;
+	GFileCopyFlags flags;
+} DeferredAttributes;
+
+static void
+copy_task_free (CopyTask *task)
+{
+	g_object_unref (task->src);
+	g_object_unref (task->dest);
+	g_object_unref (task->dest_dir);
+	g_object_unref (task->cancellable);
+	if (task->error != NULL) {
+		g_error_free (task->error);
+	}
+	g_free (task);
+}
+
+static void
+deferred_attributes_free (DeferredAttributes *deferred)
+{
+	g_object_unref (deferred->src);
+	g_object_unref (deferred->dest);
+	g_free (deferred);
+}
+
+/* Runs on a copy thread. Everything that touches the job happens back
+ * on the job thread, in copy_pool_finish_task().
+ */
+static void
+copy_pool_run_task (gpointer data,
+		    gpointer user_data)
+{
+	CopyTask *task;
+	CopyPool *pool;
+
+	task = data;
+	pool = user_data;
+
+	task->res = copy_file_contents (task->src, task->dest,
+					task->flags,
+					task->cancellable,
+					NULL, NULL,
+					&task->error);
+	if (task->res) {
+		/* Ignore errors here. Failure to copy metadata is not a hard error */
+		g_file_copy_attributes (task->src, task->dest,
+					task->flags | G_FILE_COPY_ALL_METADATA,
+					task->cancellable, NULL);
+	}
+
+	g_async_queue_push (pool->done, task);
+}
+
+static CopyPool *
+copy_pool_new (void)
+{
+	CopyPool *pool;
+
+	pool = g_new0 (CopyPool, 1);
+	pool->done = g_async_queue_new ();
+	pool->threads = g_thread_pool_new (copy_pool_run_task, pool,
+					   COPY_POOL_MAX_THREADS, FALSE, NULL);
+
+	return pool;
+}
+
+static void
+copy_pool_free (CopyPool *pool)
+{
+	g_assert (pool->n_in_flight == 0);
+
+	g_thread_pool_free (pool->threads, FALSE, TRUE);
+	g_async_queue_unref (pool->done);
+	g_list_free_full (pool->deferred_dirs, (GDestroyNotify) deferred_attributes_free);
+	g_free (pool);
+}
+
+/* Only plain copies of small local files go through the pool, the
+ * rest is left to copy_move_file() on the job thread.
+ */
+static gboolean
+copy_pool_can_take (CopyMoveJob *copy_job,
+		    GFile *src,
+		    GFileInfo *info,
+		    GFile *dest_dir)
+{
+	return copy_job->pool != NULL &&
+		g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR &&
+		g_file_info_get_size (info) <= COPY_POOL_MAX_FILE_SIZE &&
+		g_file_is_native (src) &&
+		!should_skip_file ((CommonJob *) copy_job, src) &&
+		/* Trusted desktop files need to be marked as such */
+		(copy_job->desktop_location == NULL ||
+		 !g_file_equal (copy_job->desktop_location, dest_dir));
+}
+
+static void
+report_copy_file_error (CommonJob *job,
+			GFile *src,
+			GFile *dest_dir,
+			GError *error,
+			SourceInfo *source_info,
+			TransferInfo *transfer_info)
+{
+	char *primary, *secondary, *details;
+	int response;
+
+	if (job->skip_all_error) {
+		return;
+	}
+	primary = f (_("Error while copying \"%B\"."), src);
+	secondary = f (_("There was an error copying the file into %F."), dest_dir);
+	details = error->message;
+
+	response = run_warning (job,
+				primary,
+				secondary,
+				details,
+				(source_info->num_files - transfer_info->num_files) > 1,
+				CANCEL, SKIP_ALL, SKIP,
+				NULL);
+
+	if (response == 0 || response == CTK_RESPONSE_DELETE_EVENT) {
+		abort_job (job);
+	} else if (response == 1) { /* skip all */
+		job->skip_all_error = TRUE;
+	} else if (response == 2) { /* skip */
+		/* do nothing */
+	} else {
+		g_assert_not_reached ();
+	}
+}
+
+/* Waits for one copy to come back and does the bookkeeping
+ * copy_move_file() would have done for it.
+ */
+static void
+copy_pool_finish_task (CopyMoveJob *copy_job,
+		       SourceInfo *source_info,
+		       TransferInfo *transfer_info)
+{
+	CopyPool *pool;
+	CopyTask *task;
+	CommonJob *job;
+	char *dest_fs_type;
+	gboolean skipped_file;
+
+	job = (CommonJob *)copy_job;
+	pool = copy_job->pool;
+
+	task = g_async_queue_pop (pool->done);
+	pool->n_in_flight--;
+
+	if (task->res) {
+		transfer_info->num_bytes += task->size;
+		transfer_info->num_files ++;
+		report_copy_progress (copy_job, source_info, transfer_info);
+
+		baul_file_changes_queue_file_added (task->dest);
+
+		// Start UNDO-REDO
+		baul_undostack_manager_data_add_origin_target_pair (job->undo_redo_data, task->src, task->dest);
+		// End UNDO-REDO
+	} else if (IS_IO_ERROR (task->error, CANCELLED) ||
+		   job_aborted (job)) {
+		/* Nothing to do */
+	} else if (IS_IO_ERROR (task->error, EXISTS) ||
+		   IS_IO_ERROR (task->error, INVALID_FILENAME) ||
+		   IS_IO_ERROR (task->error, WOULD_RECURSE) ||
+		   IS_IO_ERROR (task->error, WOULD_MERGE)) {
+		/* Nothing has been written, so let copy_move_file() start
+		 * over. Its conflict dialog is the only one up at a time,
+		 * and the copies already queued go on meanwhile.
+		 */
+		dest_fs_type = NULL;
+		skipped_file = FALSE;
+		copy_move_file (copy_job, task->src, task->dest_dir,
+				task->same_fs, FALSE, &dest_fs_type,
+				source_info, transfer_info,
+				NULL, NULL, FALSE, &skipped_file,
+				task->readonly_source_fs, FALSE);
+		g_free (dest_fs_type);
+	} else {
+		report_copy_file_error (job, task->src, task->dest_dir, task->error,
+					source_info, transfer_info);
+	}
+
+	copy_task_free (task);
+}
+
+static void
+copy_pool_add (CopyMoveJob *copy_job,
+	       GFile *src,
+	       GFileInfo *info,
+	       GFile *dest_dir,
+	       gboolean same_fs,
+	       const char *dest_fs_type,
+	       gboolean readonly_source_fs,
+	       SourceInfo *source_info,
+	       TransferInfo *transfer_info)
+{
+	CopyPool *pool;
+	CopyTask *task;
+
+	pool = copy_job->pool;
+
+	while (pool->n_in_flight >= COPY_POOL_MAX_IN_FLIGHT) {
+		copy_pool_finish_task (copy_job, source_info, transfer_info);
+	}
+
+	task = g_new0 (CopyTask, 1);
+	task->src = g_object_ref (src);
+	task->dest = get_target_file (src, dest_dir, dest_fs_type, same_fs);
+	task->dest_dir = g_object_ref (dest_dir);
+	task->flags = G_FILE_COPY_NOFOLLOW_SYMLINKS;
+	if (readonly_source_fs) {
+		task->flags |= G_FILE_COPY_TARGET_DEFAULT_PERMS;
+	}
+	task->size = g_file_info_get_size (info);
+	task->same_fs = same_fs;
+	task->readonly_source_fs = readonly_source_fs;
+	task->cancellable = g_object_ref (copy_job->common.cancellable);
+
+	pool->n_in_flight++;
+	g_thread_pool_push (pool->threads, task, NULL);
+}
+
+/* The attributes of a folder are copied once all the files in it are
+ * there, or writing the files would change its modification time, and
+ * a read-only folder could not be filled at all.
+ */
+static void
+copy_pool_defer_attributes (CopyPool *pool,
+			    GFile *src,
+			    GFile *dest,
+			    GFileCopyFlags flags)
+{
+	DeferredAttributes *deferred;
+
+	deferred = g_new0 (DeferredAttributes, 1);
+	deferred->src = g_object_ref (src);
+	deferred->dest = g_object_ref (dest);
+	deferred->flags = flags;
+
+	pool->deferred_dirs = g_list_prepend (pool->deferred_dirs, deferred);
+}
+
+static void
+copy_pool_drain (CopyMoveJob *copy_job,
+		 SourceInfo *source_info,
+		 TransferInfo *transfer_info)
+{
+	CopyPool *pool;
+	DeferredAttributes *deferred;
+	GList *l;
+
+	pool = copy_job->pool;
+
+	while (pool->n_in_flight > 0) {
+		copy_pool_finish_task (copy_job, source_info, transfer_info);
+	}
+
+	for (l = pool->deferred_dirs; l != NULL; l = l->next) {
+		deferred = l->data;
+		/* Ignore errors here. Failure to copy metadata is not a hard error */
+		g_file_copy_attributes (deferred->src, deferred->dest,
+					deferred->flags,
+					copy_job->common.cancellable, NULL);
+	}
+	g_list_free_full (pool->deferred_dirs, (GDestroyNotify) deferred_attributes_free);
+	pool->deferred_dirs = NULL;
+}
+
 /* a return value of FALSE means retry, i.e.
  * the destination has changed and the source
  * is expected to re-try the preceeding
@@ -3608,6 +4573,10 @@ copy_move_directory (CopyMoveJob *copy_job,
  retry:
 	error = NULL;
 	enumerator = g_file_enumerate_children (src,
+						copy_job->pool != NULL ?
+						G_FILE_ATTRIBUTE_STANDARD_NAME ","
+						G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+						G_FILE_ATTRIBUTE_STANDARD_SIZE :
 						G_FILE_ATTRIBUTE_STANDARD_NAME,
 						G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
 						job->cancellable,
@@ -3619,15 +4588,21 @@ copy_move_directory (CopyMoveJob *copy_job,
 		while (!job_aborted (job) &&
 		       (info = nextinfo) != NULL) {
 			baul_progress_info_get_ready (job->progress);
+			source_scan_check_space (copy_job, source_info, transfer_info);
 
 			nextinfo = g_file_enumerator_next_file (enumerator, job->cancellable, skip_error?NULL:&error);
 			src_file = g_file_get_child (src,
 						     g_file_info_get_name (info));
 
 			last_item = (last_item_above) && (!nextinfo);
-			copy_move_file (copy_job, src_file, *dest, same_fs, FALSE, &dest_fs_type,
-					source_info, transfer_info, NULL, NULL, FALSE, &local_skipped_file,
-					readonly_source_fs, last_item);
+			if (copy_pool_can_take (copy_job, src_file, info, *dest)) {
+				copy_pool_add (copy_job, src_file, info, *dest, same_fs, dest_fs_type,
+					       readonly_source_fs, source_info, transfer_info);
+			} else {
+				copy_move_file (copy_job, src_file, *dest, same_fs, FALSE, &dest_fs_type,
+						source_info, transfer_info, NULL, NULL, FALSE, &local_skipped_file,
+						readonly_source_fs, last_item);
+			}
 			g_object_unref (src_file);
 			g_object_unref (info);
 		}
@@ -3725,10 +4700,14 @@ copy_move_directory (CopyMoveJob *copy_job,
 	if (create_dest) {
 		flags = (readonly_source_fs) ? G_FILE_COPY_NOFOLLOW_SYMLINKS | G_FILE_COPY_TARGET_DEFAULT_PERMS
 					     : G_FILE_COPY_NOFOLLOW_SYMLINKS | G_FILE_COPY_ALL_METADATA;
-		/* Ignore errors here. Failure to copy metadata is not a hard error */
-		g_file_copy_attributes (src, *dest,
-					flags,
-					job->cancellable, NULL);
+		if (copy_job->pool != NULL) {
+			copy_pool_defer_attributes (copy_job->pool, src, *dest, flags);
+		} else {
+			/* Ignore errors here. Failure to copy metadata is not a hard error */
+			g_file_copy_attributes (src, *dest,
+						flags,
+						job->cancellable, NULL);
+		}
 	}
 
 	if (!job_aborted (job) && copy_job->is_move &&
@@ -4271,12 +5250,12 @@ copy_move_file (CopyMoveJob *copy_job,
 				   &pdata,
 				   &error);
 	} else {
-		res = g_file_copy (src, dest,
-				   flags,
-				   job->cancellable,
-				   copy_file_progress_callback,
-				   &pdata,
-				   &error);
+		res = copy_file_contents (src, dest,
+					  flags,
+					  job->cancellable,
+					  copy_file_progress_callback,
+					  &pdata,
+					  &error);
 	}
 
 	if (res) {
@@ -4509,33 +5488,9 @@ copy_move_file (CopyMoveJob *copy_job,
 
 	/* Other error */
 	else {
-		if (job->skip_all_error) {
-			g_error_free (error);
-			goto out;
-		}
-		primary = f (_("Error while copying \"%B\"."), src);
-		secondary = f (_("There was an error copying the file into %F."), dest_dir);
-		details = error->message;
-
-		response = run_warning (job,
-					primary,
-					secondary,
-					details,
-					(source_info->num_files - transfer_info->num_files) > 1,
-					CANCEL, SKIP_ALL, SKIP,
-					NULL);
-
+		report_copy_file_error (job, src, dest_dir, error,
+					source_info, transfer_info);
 		g_error_free (error);
-
-		if (response == 0 || response == CTK_RESPONSE_DELETE_EVENT) {
-			abort_job (job);
-		} else if (response == 1) { /* skip all */
-			job->skip_all_error = TRUE;
-		} else if (response == 2) { /* skip */
-			/* do nothing */
-		} else {
-			g_assert_not_reached ();
-		}
 	}
  out:
 	*skipped_file = TRUE; /* Or aborted, but same-same */
@@ -4587,6 +5542,7 @@ copy_files (CopyMoveJob *job,
 	     l != NULL && !job_aborted (common);
 	     l = l->next) {
 		baul_progress_info_get_ready (common->progress);
+		source_scan_check_space (job, source_info, transfer_info);
 
 		src = l->data;
 
@@ -4624,6 +5580,10 @@ copy_files (CopyMoveJob *job,
 		i++;
 	}
 
+	if (job->pool != NULL) {
+		copy_pool_drain (job, source_info, transfer_info);
+	}
+
 	g_free (dest_fs_type);
 }
 
@@ -4673,14 +5633,6 @@ copy_job (GIOSchedulerJob *io_job,
 
 	baul_progress_info_start (job->common.progress);
 
-	scan_sources (job->files,
-		      &source_info,
-		      common,
-		      OP_KIND_COPY);
-	if (job_aborted (common)) {
-		goto aborted;
-	}
-
 	if (job->destination) {
 		dest = g_object_ref (job->destination);
 	} else {
@@ -4690,15 +5642,24 @@ copy_job (GIOSchedulerJob *io_job,
 		dest = g_file_get_parent (job->files->data);
 	}
 
+	/* The space is checked while the sources are scanned */
 	verify_destination (&job->common,
 			    dest,
 			    &dest_fs_id,
-			    source_info.num_bytes);
-	g_object_unref (dest);
+			    -1);
 	if (job_aborted (common)) {
+		g_object_unref (dest);
 		goto aborted;
 	}
 
+	source_scan_start (job, job->files, dest, OP_KIND_COPY, &source_info);
+
+	/* Local and NFS folders both show up as native files */
+	if (g_file_is_native (dest)) {
+		job->pool = copy_pool_new ();
+	}
+	g_object_unref (dest);
+
 	g_timer_start (job->common.time);
 
 	memset (&transfer_info, 0, sizeof (transfer_info));
@@ -4706,6 +5667,13 @@ copy_job (GIOSchedulerJob *io_job,
 		    dest_fs_id,
 		    &source_info, &transfer_info);
 
+	source_scan_stop (job);
+
+	if (job->pool != NULL) {
+		copy_pool_free (job->pool);
+		job->pool = NULL;
+	}
+
  aborted:
 
 	g_free (dest_fs_id);
@@ -5149,6 +6117,7 @@ move_files (CopyMoveJob *job,
 	     l != NULL && !job_aborted (common);
 	     l = l->next) {
 		baul_progress_info_get_ready (common->progress);
+		source_scan_check_space (job, source_info, transfer_info);
 
 		fallback = l->data;
 		src = fallback->file;
@@ -5239,34 +6208,21 @@ move_job (GIOSchedulerJob *io_job,
 	}
 
 	/* The rest we need to do deep copy + delete behind on,
-	   so scan for size */
+	   so scan for size while doing it */
 
 	fallback_files = get_files_from_fallbacks (fallbacks);
-	scan_sources (fallback_files,
-		      &source_info,
-		      common,
-		      OP_KIND_MOVE);
-
+	source_scan_start (job, fallback_files, job->destination,
+			   OP_KIND_MOVE, &source_info);
 	g_list_free (fallback_files);
 
-	if (job_aborted (common)) {
-		goto aborted;
-	}
-
-	verify_destination (&job->common,
-			    job->destination,
-			    NULL,
-			    source_info.num_bytes);
-	if (job_aborted (common)) {
-		goto aborted;
-	}
-
 	memset (&transfer_info, 0, sizeof (transfer_info));
 	move_files (job,
 		    fallbacks,
 		    dest_fs_id, &dest_fs_type,
 		    &source_info, &transfer_info);
 
+	source_scan_stop (job);
+
  aborted:
     	g_list_free_full (fallbacks, g_free);
 
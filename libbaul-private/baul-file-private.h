@@ -137,6 +137,13 @@ struct _BaulFilePrivate
        to speed up compare_by_emblems. */
     BaulFileSortByEmblemCache *compare_by_emblem_cache;
 
+    /* Formatted string attributes by attribute quark, and the collation
+       key of the type description, to speed up list view redraws and
+       sorting. Forgotten whenever the file changes. */
+    GHashTable *string_attribute_cache;
+    guint string_attribute_cache_generation;
+    char *type_collation_key;
+
     /* BaulInfoProviders that need to be run for this file */
     GList *pending_info_providers;
 
@@ -283,6 +290,7 @@ gboolean      baul_file_set_display_name               (BaulFile           *file
         const char             *display_name,
         const char             *edit_name,
         gboolean                custom);
+void          baul_file_info_prepare                   (GFileInfo              *info);
 void          baul_file_set_mount                      (BaulFile           *file,
         GMount                 *mount);
 
@@ -118,6 +118,9 @@ enum {
 
 static int date_format_pref;
 
+/* Bumped to make every cached string attribute stale at once. */
+static guint string_attribute_cache_generation = 1;
+
 static guint signals[LAST_SIGNAL] = { 0 };
 
 static GHashTable *symbolic_links;
@@ -163,6 +166,10 @@ static gboolean update_info_and_name                         (BaulFile
 							      GFileInfo             *info);
 static const char * baul_file_peek_display_name (BaulFile *file);
 static const char * baul_file_peek_display_name_collation_key (BaulFile *file);
+static gboolean string_attribute_can_be_cached (GQuark attribute_q);
+static const char * peek_string_attribute_q (BaulFile *file,
+					     GQuark attribute_q,
+					     char **allocated);
 static void file_mount_unmounted (GMount *mount,  gpointer data);
 static void metadata_hash_free (GHashTable *hash);
 
@@ -202,11 +209,41 @@ baul_file_constructor (GType                  type,
   return object;
 }
 
-gboolean
-baul_file_set_display_name (BaulFile *file,
-				const char *display_name,
-				const char *edit_name,
-				gboolean custom)
+static GQuark
+get_collation_key_quark (void)
+{
+	return g_quark_from_static_string ("baul-display-name-collation-key");
+}
+
+/**
+ * baul_file_info_prepare:
+ * @info: a #GFileInfo that will be given to baul_file_update_info ()
+ *
+ * Does the expensive parts of digesting @info that don't need the
+ * #BaulFile, such as computing the collation key of the display name.
+ * Unlike the rest of the #BaulFile API this is safe to call from any
+ * thread, as long as nobody else is using @info yet.
+ **/
+void
+baul_file_info_prepare (GFileInfo *info)
+{
+	const char *display_name;
+
+	display_name = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME);
+	if (display_name != NULL && *display_name != 0) {
+		g_object_set_qdata_full (G_OBJECT (info),
+					 get_collation_key_quark (),
+					 g_utf8_collate_key_for_filename (display_name, -1),
+					 g_free);
+	}
+}
+
+static gboolean
+set_display_name (BaulFile *file,
+		  const char *display_name,
+		  const char *edit_name,
+		  gboolean custom,
+		  const char *collation_key)
 {
 	gboolean changed;
 
@@ -247,7 +284,11 @@ baul_file_set_display_name (BaulFile *file,
 		}
 
 		g_free (file->details->display_name_collation_key);
-		file->details->display_name_collation_key = g_utf8_collate_key_for_filename (display_name, -1);
+		if (collation_key != NULL) {
+			file->details->display_name_collation_key = g_strdup (collation_key);
+		} else {
+			file->details->display_name_collation_key = g_utf8_collate_key_for_filename (display_name, -1);
+		}
 	}
 
 	if (eel_strcmp (file->details->edit_name, edit_name) != 0) {
@@ -265,6 +306,15 @@ baul_file_set_display_name (BaulFile *file,
 	return changed;
 }
 
+gboolean
+baul_file_set_display_name (BaulFile *file,
+				const char *display_name,
+				const char *edit_name,
+				gboolean custom)
+{
+	return set_display_name (file, display_name, edit_name, custom, NULL);
+}
+
 static void
 baul_file_clear_display_name (BaulFile *file)
 {
@@ -842,6 +892,11 @@ finalize (GObject *object)
 		g_hash_table_destroy (file->details->extension_attributes);
 	}
 
+	if (file->details->string_attribute_cache) {
+		g_hash_table_destroy (file->details->string_attribute_cache);
+	}
+	g_free (file->details->type_collation_key);
+
 	if (file->details->metadata) {
 		metadata_hash_free (file->details->metadata);
 	}
@@ -2094,6 +2149,17 @@ update_links_if_target (BaulFile *target_file)
 	baul_file_list_free (link_files);
 }
 
+static void
+forget_string_attributes (BaulFile *file)
+{
+	if (file->details->string_attribute_cache != NULL) {
+		g_hash_table_remove_all (file->details->string_attribute_cache);
+	}
+
+	g_free (file->details->type_collation_key);
+	file->details->type_collation_key = NULL;
+}
+
 static gboolean
 update_info_internal (BaulFile *file,
 		      GFileInfo *info,
@@ -2148,10 +2214,12 @@ update_info_internal (BaulFile *file,
 	}
 	file->details->got_file_info = TRUE;
 
-	changed |= baul_file_set_display_name (file,
-						  g_file_info_get_display_name (info),
-						  g_file_info_get_edit_name (info),
-						  FALSE);
+	changed |= set_display_name (file,
+				     g_file_info_get_display_name (info),
+				     g_file_info_get_edit_name (info),
+				     FALSE,
+				     g_object_get_qdata (G_OBJECT (info),
+							 get_collation_key_quark ()));
 
 	file_type = g_file_info_get_file_type (info);
 	if (file->details->type != file_type) {
@@ -2544,6 +2612,8 @@ update_info_internal (BaulFile *file,
 	}
 
 	if (changed) {
+		forget_string_attributes (file);
+
 		add_to_link_hash_table (file);
 
 		update_links_if_target (file);
@@ -3098,14 +3168,25 @@ compare_by_emblems (BaulFile *file_1, BaulFile *file_2)
 	return 0;
 }
 
+static const char *
+get_type_collation_key (BaulFile *file)
+{
+	char *type_string;
+
+	if (file->details->type_collation_key == NULL) {
+		type_string = baul_file_get_type_as_string (file);
+		file->details->type_collation_key = g_utf8_collate_key (type_string, -1);
+		g_free (type_string);
+	}
+
+	return file->details->type_collation_key;
+}
+
 static int
 compare_by_type (BaulFile *file_1, BaulFile *file_2)
 {
 	gboolean is_directory_1;
 	gboolean is_directory_2;
-	char *type_string_1;
-	char *type_string_2;
-	int result;
 
 	/* Directories go first. Then, if mime types are identical,
 	 * don't bother getting strings (for speed). This assumes
@@ -3134,15 +3215,8 @@ compare_by_type (BaulFile *file_1, BaulFile *file_2)
 		return 0;
 	}
 
-	type_string_1 = baul_file_get_type_as_string (file_1);
-	type_string_2 = baul_file_get_type_as_string (file_2);
-
-	result = g_utf8_collate (type_string_1, type_string_2);
-
-	g_free (type_string_1);
-	g_free (type_string_2);
-
-	return result;
+	return strcmp (get_type_collation_key (file_1),
+		       get_type_collation_key (file_2));
 }
 
 static int
@@ -3596,20 +3670,24 @@ baul_file_compare_for_sort_by_attribute_q   (BaulFile                   *file_1,
 	result = baul_file_compare_for_sort_internal (file_1, file_2, directories_first, reversed);
 
 	if (result == 0) {
-		char *value_1;
-		char *value_2;
-
-		value_1 = baul_file_get_string_attribute_q (file_1,
-								attribute);
-		value_2 = baul_file_get_string_attribute_q (file_2,
-								attribute);
+		const char *value_1;
+		const char *value_2;
+		char *allocated_1;
+		char *allocated_2;
+
+		value_1 = peek_string_attribute_q (file_1,
+						   attribute,
+						   &allocated_1);
+		value_2 = peek_string_attribute_q (file_2,
+						   attribute,
+						   &allocated_2);
 
 		if (value_1 != NULL && value_2 != NULL) {
 			result = strcmp (value_1, value_2);
 		}
 
-		g_free (value_1);
-		g_free (value_2);
+		g_free (allocated_1);
+		g_free (allocated_2);
 
 		if (reversed) {
 			result = -result;
@@ -3632,6 +3710,61 @@ baul_file_compare_for_sort_by_attribute     (BaulFile                   *file_1,
 							      reversed);
 }
 
+gboolean
+baul_file_prepare_for_sort (BaulFile *file,
+			    BaulFileSortType sort_type)
+{
+	/* Most sorts fall back on the display name. */
+	baul_file_peek_display_name (file);
+
+	switch (sort_type) {
+	case BAUL_FILE_SORT_NONE:
+		return FALSE;
+	case BAUL_FILE_SORT_BY_TYPE:
+		get_type_collation_key (file);
+		return TRUE;
+	case BAUL_FILE_SORT_BY_SIZE:
+	case BAUL_FILE_SORT_BY_SIZE_ON_DISK:
+	case BAUL_FILE_SORT_BY_EMBLEMS:
+		/* Directory item counts and emblems are looked up on demand. */
+		return FALSE;
+	default:
+		return TRUE;
+	}
+}
+
+gboolean
+baul_file_prepare_for_sort_by_attribute_q (BaulFile *file,
+					   GQuark attribute)
+{
+	char *allocated;
+
+	if (attribute == attribute_type_q) {
+		return baul_file_prepare_for_sort (file, BAUL_FILE_SORT_BY_TYPE);
+	} else if (attribute == attribute_size_q ||
+		   attribute == attribute_size_on_disk_q ||
+		   attribute == attribute_emblems_q) {
+		return FALSE;
+	} else if (attribute == 0 || attribute == attribute_name_q ||
+		   attribute == attribute_extension_q ||
+		   attribute == attribute_modification_date_q || attribute == attribute_date_modified_q ||
+		   attribute == attribute_accessed_date_q || attribute == attribute_date_accessed_q ||
+		   attribute == attribute_trashed_on_q) {
+		return baul_file_prepare_for_sort (file, BAUL_FILE_SORT_BY_DISPLAY_NAME);
+	}
+
+	/* it is a normal attribute, compared by strings */
+
+	if (!string_attribute_can_be_cached (attribute)) {
+		return FALSE;
+	}
+
+	peek_string_attribute_q (file, attribute, &allocated);
+	g_assert (allocated == NULL);
+
+	return TRUE;
+}
+
 
 /**
  * baul_file_compare_name:
@@ -6493,8 +6626,8 @@ baul_file_get_deep_directory_count_as_string (BaulFile *file)
  * if the value is unknown or @attribute_name is not supported.
  *
  **/
-char *
-baul_file_get_string_attribute_q (BaulFile *file, GQuark attribute_q)
+static char *
+get_string_attribute_q_uncached (BaulFile *file, GQuark attribute_q)
 {
 	char *extension_attribute;
 
@@ -6606,6 +6739,87 @@ baul_file_get_string_attribute_q (BaulFile *file, GQuark attribute_q)
 	return g_strdup (extension_attribute);
 }
 
+static gboolean
+string_attribute_can_be_cached (GQuark attribute_q)
+{
+	/* Deep counts grow without change notifications, the free space
+	 * is not a property of the file, and informal dates such as
+	 * "Yesterday" change with the current time.
+	 */
+	if (attribute_q == attribute_deep_size_q ||
+	    attribute_q == attribute_deep_size_on_disk_q ||
+	    attribute_q == attribute_deep_file_count_q ||
+	    attribute_q == attribute_deep_directory_count_q ||
+	    attribute_q == attribute_deep_total_count_q ||
+	    attribute_q == attribute_free_space_q) {
+		return FALSE;
+	}
+
+	if (attribute_q == attribute_date_modified_q ||
+	    attribute_q == attribute_date_changed_q ||
+	    attribute_q == attribute_date_accessed_q ||
+	    attribute_q == attribute_trashed_on_q ||
+	    attribute_q == attribute_date_permissions_q) {
+		return date_format_pref != BAUL_DATE_FORMAT_INFORMAL;
+	}
+
+	return TRUE;
+}
+
+/* Returns the string attribute, or NULL if it is unknown. The result
+ * belongs to the file's cache and stays valid until the file changes;
+ * values that can't be cached are returned in @allocated as well and
+ * must be freed by the caller.
+ */
+static const char *
+peek_string_attribute_q (BaulFile *file, GQuark attribute_q, char **allocated)
+{
+	GHashTable *cache;
+	gpointer value;
+	char *result;
+
+	*allocated = NULL;
+
+	if (!string_attribute_can_be_cached (attribute_q)) {
+		*allocated = get_string_attribute_q_uncached (file, attribute_q);
+		return *allocated;
+	}
+
+	cache = file->details->string_attribute_cache;
+	if (cache == NULL) {
+		cache = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					       NULL,
+					       (GDestroyNotify)g_free);
+		file->details->string_attribute_cache = cache;
+	} else if (file->details->string_attribute_cache_generation != string_attribute_cache_generation) {
+		g_hash_table_remove_all (cache);
+	}
+	file->details->string_attribute_cache_generation = string_attribute_cache_generation;
+
+	if (g_hash_table_lookup_extended (cache, GINT_TO_POINTER (attribute_q), NULL, &value)) {
+		return value;
+	}
+
+	result = get_string_attribute_q_uncached (file, attribute_q);
+	g_hash_table_insert (cache, GINT_TO_POINTER (attribute_q), result);
+
+	return result;
+}
+
+char *
+baul_file_get_string_attribute_q (BaulFile *file, GQuark attribute_q)
+{
+	const char *result;
+	char *allocated;
+
+	result = peek_string_attribute_q (file, attribute_q, &allocated);
+	if (allocated != NULL) {
+		return allocated;
+	}
+
+	return g_strdup (result);
+}
+
 char *
 baul_file_get_string_attribute (BaulFile *file, const char *attribute_name)
 {
@@ -7743,6 +7957,7 @@ baul_file_emit_changed (BaulFile *file)
 	 */
 	g_free (file->details->compare_by_emblem_cache);
 	file->details->compare_by_emblem_cache = NULL;
+	forget_string_attributes (file);
 
 	/* Send out a signal. */
 	g_signal_emit (file, signals[CHANGED], 0, file);
@@ -8563,6 +8778,15 @@ mime_type_data_changed_callback (GObject *signaller G_GNUC_UNUSED,
 	emit_change_signals_for_all_files_in_all_directories ();
 }
 
+static void
+string_attribute_preferences_changed_callback (GSettings *settings G_GNUC_UNUSED,
+					       const char *key G_GNUC_UNUSED,
+					       gpointer user_data G_GNUC_UNUSED)
+{
+	/* Sizes, dates and counts are formatted according to preferences. */
+	string_attribute_cache_generation++;
+}
+
 static void
 icon_theme_changed_callback (CtkIconTheme *icon_theme G_GNUC_UNUSED,
 			     gpointer      user_data G_GNUC_UNUSED)
@@ -8641,6 +8865,10 @@ baul_file_class_init (BaulFileClass *class)
 	eel_g_settings_add_auto_enum (baul_preferences,
 				                  BAUL_PREFERENCES_DATE_FORMAT,
 				                  &date_format_pref);
+	g_signal_connect (baul_preferences,
+			  "changed",
+			  G_CALLBACK (string_attribute_preferences_changed_callback),
+			  NULL);
 
 	thumbnail_limit_changed_callback (NULL);
 	g_signal_connect_swapped (baul_preferences,
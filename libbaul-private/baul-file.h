@@ -427,6 +427,14 @@ int                     baul_file_compare_for_sort_by_attribute_q   (BaulFile
         GQuark                          attribute,
         gboolean                        directories_first,
         gboolean                        reversed);
+/* Computes ahead of time what the comparisons above need. Returns
+ * TRUE if they then only read the file and can run in other threads
+ * until the file changes.
+ */
+gboolean                baul_file_prepare_for_sort                  (BaulFile                   *file,
+        BaulFileSortType            sort_type);
+gboolean                baul_file_prepare_for_sort_by_attribute_q   (BaulFile                   *file,
+        GQuark                          attribute);
 gboolean                baul_file_is_date_sort_attribute_q          (GQuark                          attribute);
 
 int                     baul_file_compare_display_name              (BaulFile                   *file_1,
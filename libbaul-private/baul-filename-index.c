@@ -0,0 +1,1612 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   baul-filename-index.c: Persistent index of the file names below
+   some local folders.
+
+   Copyright (C) 2026 CAFE Desktop.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/* The index is a tree of entries, one per file, stored in a single
+ * array and linked by position. Every entry keeps its name, its name
+ * lowercased the way search words are, and the few attributes a query
+ * can ask for. The lowercased names are also indexed by their byte
+ * trigrams, so a search only has to look at the files whose names
+ * contain the rarest trigram of the search words.
+ *
+ * The index is built by a thread, saved in the user cache directory
+ * and loaded from there at the next start. Afterwards it only changes
+ * on the main thread, from the notifications baul gets about files
+ * being added, changed, removed and moved. Entries are never taken out
+ * of the array; removed ones are only flagged, and a moved file gets a
+ * new entry, so that the trigram lists stay sorted and free of
+ * duplicates. Both are dropped the next time the index is saved.
+ *
+ * Changes baul doesn't see are picked up by rescanning the folders in
+ * the background: at the start if the saved index is older than
+ * INDEX_MAX_AGE, and a while after a folder showed up whose contents
+ * the index doesn't know, like one copied in by another program.
+ * Searches are answered from the old index until the new one is
+ * ready.
+ *
+ * The scan stays on the filesystem of each folder, so drives and
+ * network shares mounted below it are not indexed.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include <eel/eel-debug.h>
+
+#include "baul-filename-index.h"
+#include "baul-global-preferences.h"
+
+#define INDEX_MAGIC "BAULFNI1"
+#define INDEX_MAGIC_LENGTH 8
+#define INDEX_HEADER_LENGTH 32
+
+#define INDEX_NONE G_MAXUINT32
+
+/* A saved index younger than this (in seconds) is not rescanned. */
+#define INDEX_MAX_AGE (15 * 60)
+
+/* How long to wait for more changes before a rescan, in seconds. */
+#define INDEX_RESCAN_DELAY 60
+
+/* Number of candidates a search looks at per step. */
+#define SEARCH_STEP_SIZE 20000
+
+#define ENTRY_DIRECTORY (1 << 0)
+#define ENTRY_REMOVED   (1 << 1)
+
+#define TRIGRAM(p) (((guint32) (guchar) (p)[0] << 16) | \
+		    ((guint32) (guchar) (p)[1] << 8) | \
+		    (guint32) (guchar) (p)[2])
+
+typedef struct
+{
+    guint32 parent;
+    guint32 first_child;
+    guint32 next_sibling;
+    guint32 flags;
+    gint64 size;
+    gint64 mtime;
+    const char *content_type; /* interned */
+    const char *name; /* the whole path for the roots */
+    const char *lower_name;
+} IndexEntry;
+
+typedef struct
+{
+    int ref_count;
+    char **roots;
+    guint32 *root_ids;
+    GArray *entries;
+    GStringChunk *names;
+    GHashTable *trigrams; /* trigram -> GArray of positions */
+    gint64 build_time;
+} NameIndex;
+
+/* On-disk entry, followed by the NUL terminated name. Entries are
+ * stored parents first, and refer to each other by their position in
+ * the file.
+ */
+typedef struct
+{
+    guint32 parent;
+    guint32 flags;
+    gint64 size;
+    gint64 mtime;
+    guint32 content_type;
+    guint32 name_length;
+} EntryRecord;
+
+typedef enum
+{
+    CHANGE_ADDED,
+    CHANGE_REMOVED,
+    CHANGE_MOVED
+} IndexChangeType;
+
+typedef struct
+{
+    IndexChangeType type;
+    char *path;
+    char *new_path;
+} IndexChange;
+
+typedef struct
+{
+    char **roots;
+    guint generation;
+    gboolean load_saved;
+} IndexBuild;
+
+typedef struct
+{
+    NameIndex *name_index;
+    guint generation;
+    gboolean finished;
+} IndexReady;
+
+struct BaulFilenameIndexSearch
+{
+    NameIndex *name_index;
+    char **words;
+    GList *mime_types;
+    gint64 timestamp;
+    gint64 size;
+    guint32 location;
+    GArray *candidates; /* NULL to look at every entry */
+    gboolean no_candidates;
+    guint position;
+};
+
+/* Only used on the main thread. */
+static gboolean index_initialized;
+static NameIndex *current_index;
+static gboolean index_building;
+static gboolean index_complete;
+static guint index_generation;
+static guint index_rescan_id;
+static GQueue pending_changes = G_QUEUE_INIT;
+
+#define INDEX_ENTRY(name_index, id) (&g_array_index ((name_index)->entries, IndexEntry, (id)))
+
+static char *
+get_index_filename (void)
+{
+    return g_build_filename (g_get_user_cache_dir (), "baul", "filename-index", NULL);
+}
+
+/* Lowercases a file name the same way the words of a query are.
+ * Returns NULL if the name is lowercase ASCII already.
+ */
+static char *
+make_lower_name (const char *name)
+{
+    const char *p;
+    char *display_name, *normalized, *lower;
+
+    for (p = name; *p != '\0'; p++)
+    {
+        if ((*p & 0x80) || g_ascii_isupper (*p))
+        {
+            break;
+        }
+    }
+    if (*p == '\0')
+    {
+        return NULL;
+    }
+
+    display_name = g_filename_display_name (name);
+    normalized = g_utf8_normalize (display_name, -1, G_NORMALIZE_NFD);
+    lower = g_utf8_strdown (normalized != NULL ? normalized : display_name, -1);
+    g_free (normalized);
+    g_free (display_name);
+
+    return lower;
+}
+
+static const char *
+guess_content_type (const char *name,
+                    gboolean    is_directory)
+{
+    const char *interned;
+    char *content_type;
+
+    if (is_directory)
+    {
+        return g_intern_static_string ("inode/directory");
+    }
+
+    content_type = g_content_type_guess (name, NULL, 0, NULL);
+    interned = g_intern_string (content_type);
+    g_free (content_type);
+
+    return interned;
+}
+
+static NameIndex *
+name_index_new (char **roots)
+{
+    NameIndex *name_index;
+    guint i, n_roots;
+
+    n_roots = g_strv_length (roots);
+
+    name_index = g_new0 (NameIndex, 1);
+    name_index->ref_count = 1;
+    name_index->roots = g_strdupv (roots);
+    name_index->root_ids = g_new (guint32, n_roots);
+    for (i = 0; i < n_roots; i++)
+    {
+        name_index->root_ids[i] = INDEX_NONE;
+    }
+    name_index->entries = g_array_new (FALSE, FALSE, sizeof (IndexEntry));
+    name_index->names = g_string_chunk_new (64 * 1024);
+    name_index->trigrams = g_hash_table_new_full (NULL, NULL, NULL,
+                                                  (GDestroyNotify) g_array_unref);
+
+    return name_index;
+}
+
+static NameIndex *
+name_index_ref (NameIndex *name_index)
+{
+    name_index->ref_count++;
+
+    return name_index;
+}
+
+static void
+name_index_unref (NameIndex *name_index)
+{
+    if (--name_index->ref_count > 0)
+    {
+        return;
+    }
+
+    g_strfreev (name_index->roots);
+    g_free (name_index->root_ids);
+    g_array_free (name_index->entries, TRUE);
+    g_string_chunk_free (name_index->names);
+    g_hash_table_destroy (name_index->trigrams);
+    g_free (name_index);
+}
+
+static void
+name_index_add_trigrams (NameIndex  *name_index,
+                         guint32     id,
+                         const char *lower_name)
+{
+    GArray *positions;
+    const char *p;
+    gpointer key;
+
+    if (strlen (lower_name) < 3)
+    {
+        return;
+    }
+
+    for (p = lower_name; p[2] != '\0'; p++)
+    {
+        key = GUINT_TO_POINTER (TRIGRAM (p));
+        positions = g_hash_table_lookup (name_index->trigrams, key);
+        if (positions == NULL)
+        {
+            positions = g_array_new (FALSE, FALSE, sizeof (guint32));
+            g_hash_table_insert (name_index->trigrams, key, positions);
+        }
+
+        /* The same trigram can appear more than once in a name. */
+        if (positions->len == 0 ||
+            g_array_index (positions, guint32, positions->len - 1) != id)
+        {
+            g_array_append_val (positions, id);
+        }
+    }
+}
+
+static guint32
+name_index_add (NameIndex  *name_index,
+                guint32     parent,
+                const char *name,
+                guint32     flags,
+                gint64      size,
+                gint64      mtime,
+                const char *content_type)
+{
+    IndexEntry entry, *parent_entry;
+    char *lower_name;
+    guint32 id;
+
+    id = name_index->entries->len;
+
+    entry.parent = parent;
+    entry.first_child = INDEX_NONE;
+    entry.next_sibling = INDEX_NONE;
+    entry.flags = flags;
+    entry.size = size;
+    entry.mtime = mtime;
+    entry.content_type = content_type;
+    entry.name = g_string_chunk_insert (name_index->names, name);
+
+    lower_name = make_lower_name (name);
+    entry.lower_name = lower_name != NULL ?
+                       g_string_chunk_insert (name_index->names, lower_name) : entry.name;
+    g_free (lower_name);
+
+    if (parent != INDEX_NONE)
+    {
+        parent_entry = INDEX_ENTRY (name_index, parent);
+        entry.next_sibling = parent_entry->first_child;
+        parent_entry->first_child = id;
+    }
+
+    g_array_append_val (name_index->entries, entry);
+    name_index_add_trigrams (name_index, id, entry.lower_name);
+
+    return id;
+}
+
+static guint32
+name_index_add_stat (NameIndex         *name_index,
+                     guint32            parent,
+                     const char        *name,
+                     const struct stat *statbuf)
+{
+    gboolean is_directory;
+
+    is_directory = S_ISDIR (statbuf->st_mode);
+
+    return name_index_add (name_index, parent, name,
+                           is_directory ? ENTRY_DIRECTORY : 0,
+                           statbuf->st_size, statbuf->st_mtime,
+                           guess_content_type (name, is_directory));
+}
+
+static void
+name_index_unlink (NameIndex *name_index,
+                   guint32    id)
+{
+    IndexEntry *entry;
+    guint32 *link;
+
+    entry = INDEX_ENTRY (name_index, id);
+    if (entry->parent == INDEX_NONE)
+    {
+        return;
+    }
+
+    link = &INDEX_ENTRY (name_index, entry->parent)->first_child;
+    while (*link != INDEX_NONE)
+    {
+        if (*link == id)
+        {
+            *link = entry->next_sibling;
+            break;
+        }
+        link = &INDEX_ENTRY (name_index, *link)->next_sibling;
+    }
+    entry->next_sibling = INDEX_NONE;
+}
+
+/* Flags an entry and everything below it as removed. */
+static void
+name_index_remove (NameIndex *name_index,
+                   guint32    id)
+{
+    IndexEntry *entry;
+    GArray *stack;
+    guint32 child;
+
+    name_index_unlink (name_index, id);
+
+    stack = g_array_new (FALSE, FALSE, sizeof (guint32));
+    g_array_append_val (stack, id);
+    while (stack->len > 0)
+    {
+        id = g_array_index (stack, guint32, stack->len - 1);
+        g_array_set_size (stack, stack->len - 1);
+
+        entry = INDEX_ENTRY (name_index, id);
+        entry->flags |= ENTRY_REMOVED;
+        for (child = entry->first_child; child != INDEX_NONE;
+             child = INDEX_ENTRY (name_index, child)->next_sibling)
+        {
+            g_array_append_val (stack, child);
+        }
+    }
+    g_array_free (stack, TRUE);
+}
+
+static guint32
+name_index_find_child (NameIndex  *name_index,
+                       guint32     parent,
+                       const char *name)
+{
+    guint32 child;
+
+    for (child = INDEX_ENTRY (name_index, parent)->first_child; child != INDEX_NONE;
+         child = INDEX_ENTRY (name_index, child)->next_sibling)
+    {
+        if (strcmp (INDEX_ENTRY (name_index, child)->name, name) == 0)
+        {
+            return child;
+        }
+    }
+
+    return INDEX_NONE;
+}
+
+static guint32
+name_index_lookup_path (NameIndex  *name_index,
+                        const char *path)
+{
+    char **components;
+    guint32 id;
+    gsize root_length;
+    int i;
+
+    id = INDEX_NONE;
+    for (i = 0; name_index->roots[i] != NULL; i++)
+    {
+        root_length = strlen (name_index->roots[i]);
+        if (strncmp (path, name_index->roots[i], root_length) == 0 &&
+            (root_length == 1 || path[root_length] == '\0' || path[root_length] == '/'))
+        {
+            id = name_index->root_ids[i];
+            break;
+        }
+    }
+
+    if (id == INDEX_NONE)
+    {
+        return INDEX_NONE;
+    }
+
+    components = g_strsplit (path + root_length, "/", -1);
+    for (i = 0; components[i] != NULL && id != INDEX_NONE; i++)
+    {
+        if (components[i][0] != '\0')
+        {
+            id = name_index_find_child (name_index, id, components[i]);
+        }
+    }
+    g_strfreev (components);
+
+    return id;
+}
+
+static char *
+name_index_get_path (NameIndex *name_index,
+                     guint32    id)
+{
+    GArray *chain;
+    GString *path;
+    const char *name;
+    guint i;
+
+    chain = g_array_new (FALSE, FALSE, sizeof (guint32));
+    for (; id != INDEX_NONE; id = INDEX_ENTRY (name_index, id)->parent)
+    {
+        g_array_append_val (chain, id);
+    }
+
+    path = g_string_new (NULL);
+    for (i = chain->len; i > 0; i--)
+    {
+        name = INDEX_ENTRY (name_index, g_array_index (chain, guint32, i - 1))->name;
+        if (path->len > 0 && path->str[path->len - 1] != '/')
+        {
+            g_string_append_c (path, '/');
+        }
+        g_string_append (path, name);
+    }
+    g_array_free (chain, TRUE);
+
+    return g_string_free (path, FALSE);
+}
+
+/* Runs in the build thread. */
+static void
+name_index_scan_root (NameIndex *name_index,
+                      guint      root)
+{
+    struct stat statbuf;
+    struct dirent *dirent;
+    GArray *directories;
+    guint32 id, child;
+    dev_t device;
+    char *path;
+    DIR *dir;
+
+    if (stat (name_index->roots[root], &statbuf) != 0 || !S_ISDIR (statbuf.st_mode))
+    {
+        return;
+    }
+    device = statbuf.st_dev;
+
+    id = name_index_add_stat (name_index, INDEX_NONE, name_index->roots[root], &statbuf);
+    name_index->root_ids[root] = id;
+
+    directories = g_array_new (FALSE, FALSE, sizeof (guint32));
+    g_array_append_val (directories, id);
+    while (directories->len > 0)
+    {
+        id = g_array_index (directories, guint32, directories->len - 1);
+        g_array_set_size (directories, directories->len - 1);
+
+        path = name_index_get_path (name_index, id);
+        dir = opendir (path);
+        g_free (path);
+        if (dir == NULL)
+        {
+            continue;
+        }
+
+        while ((dirent = readdir (dir)) != NULL)
+        {
+            /* Hidden files are not searched, and neither are "." and "..". */
+            if (dirent->d_name[0] == '.')
+            {
+                continue;
+            }
+
+            if (fstatat (dirfd (dir), dirent->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) != 0 ||
+                statbuf.st_dev != device)
+            {
+                continue;
+            }
+
+            child = name_index_add_stat (name_index, id, dirent->d_name, &statbuf);
+            if (S_ISDIR (statbuf.st_mode))
+            {
+                g_array_append_val (directories, child);
+            }
+        }
+        closedir (dir);
+    }
+    g_array_free (directories, TRUE);
+}
+
+/* Runs in the build thread. */
+static void
+name_index_save (NameIndex *name_index)
+{
+    static const char padding[4] = { 0 };
+    GByteArray *data, *records;
+    GHashTable *types;
+    GPtrArray *type_list;
+    GArray *stack;
+    IndexEntry *entry;
+    EntryRecord record;
+    guint32 *positions;
+    guint32 id, child, n_entries, n_roots, n_types, length;
+    char *filename, *dirname;
+    guint i;
+
+    positions = g_new (guint32, name_index->entries->len);
+    types = g_hash_table_new (NULL, NULL);
+    type_list = g_ptr_array_new ();
+    records = g_byte_array_new ();
+    stack = g_array_new (FALSE, FALSE, sizeof (guint32));
+    n_entries = 0;
+
+    n_roots = g_strv_length (name_index->roots);
+    for (i = n_roots; i > 0; i--)
+    {
+        if (name_index->root_ids[i - 1] != INDEX_NONE)
+        {
+            g_array_append_val (stack, name_index->root_ids[i - 1]);
+        }
+    }
+
+    while (stack->len > 0)
+    {
+        id = g_array_index (stack, guint32, stack->len - 1);
+        g_array_set_size (stack, stack->len - 1);
+        entry = INDEX_ENTRY (name_index, id);
+
+        if (!g_hash_table_contains (types, entry->content_type))
+        {
+            g_hash_table_insert (types, (gpointer) entry->content_type,
+                                 GUINT_TO_POINTER (type_list->len));
+            g_ptr_array_add (type_list, (gpointer) entry->content_type);
+        }
+
+        positions[id] = n_entries++;
+        record.parent = entry->parent == INDEX_NONE ? INDEX_NONE : positions[entry->parent];
+        record.flags = entry->flags & ENTRY_DIRECTORY;
+        record.size = entry->size;
+        record.mtime = entry->mtime;
+        record.content_type = GPOINTER_TO_UINT (g_hash_table_lookup (types, entry->content_type));
+        record.name_length = strlen (entry->name);
+        g_byte_array_append (records, (const guint8 *) &record, sizeof (record));
+        g_byte_array_append (records, (const guint8 *) entry->name, record.name_length + 1);
+
+        for (child = entry->first_child; child != INDEX_NONE;
+             child = INDEX_ENTRY (name_index, child)->next_sibling)
+        {
+            g_array_append_val (stack, child);
+        }
+    }
+
+    n_types = type_list->len;
+    data = g_byte_array_sized_new (INDEX_HEADER_LENGTH + records->len);
+    g_byte_array_append (data, (const guint8 *) INDEX_MAGIC, INDEX_MAGIC_LENGTH);
+    g_byte_array_append (data, (const guint8 *) &n_roots, sizeof (n_roots));
+    g_byte_array_append (data, (const guint8 *) &n_types, sizeof (n_types));
+    g_byte_array_append (data, (const guint8 *) &name_index->build_time, sizeof (gint64));
+    g_byte_array_append (data, (const guint8 *) &n_entries, sizeof (n_entries));
+    g_byte_array_append (data, (const guint8 *) padding, 4);
+
+    for (i = 0; i < n_roots; i++)
+    {
+        length = strlen (name_index->roots[i]);
+        g_byte_array_append (data, (const guint8 *) &length, sizeof (length));
+        g_byte_array_append (data, (const guint8 *) name_index->roots[i], length + 1);
+    }
+    for (i = 0; i < n_types; i++)
+    {
+        length = strlen (g_ptr_array_index (type_list, i));
+        g_byte_array_append (data, (const guint8 *) &length, sizeof (length));
+        g_byte_array_append (data, g_ptr_array_index (type_list, i), length + 1);
+    }
+    g_byte_array_append (data, records->data, records->len);
+
+    filename = get_index_filename ();
+    dirname = g_path_get_dirname (filename);
+    g_mkdir_with_parents (dirname, 0700);
+    g_file_set_contents (filename, (const char *) data->data, data->len, NULL);
+    g_free (dirname);
+    g_free (filename);
+
+    g_byte_array_free (data, TRUE);
+    g_byte_array_free (records, TRUE);
+    g_array_free (stack, TRUE);
+    g_ptr_array_free (type_list, TRUE);
+    g_hash_table_destroy (types);
+    g_free (positions);
+}
+
+/* Reads a length prefixed, NUL terminated string. */
+static const char *
+read_string (const char *data,
+             gsize       length,
+             gsize      *offset)
+{
+    const char *string;
+    guint32 string_length;
+
+    if (*offset + sizeof (string_length) > length)
+    {
+        return NULL;
+    }
+    memcpy (&string_length, data + *offset, sizeof (string_length));
+    *offset += sizeof (string_length);
+
+    if (*offset + string_length + 1 > length || data[*offset + string_length] != '\0')
+    {
+        return NULL;
+    }
+    string = data + *offset;
+    *offset += string_length + 1;
+
+    return string;
+}
+
+/* Runs in the build thread. Returns NULL unless the saved index is
+ * for the same folders.
+ */
+static NameIndex *
+name_index_load (char **roots)
+{
+    GMappedFile *mapped_file;
+    NameIndex *name_index;
+    EntryRecord record;
+    const char **types;
+    const char *data, *string;
+    guint32 *ids;
+    guint32 n_roots, n_types, n_entries, i, j, parent;
+    gint64 build_time;
+    gsize length, offset;
+    char *filename;
+    gboolean valid;
+
+    filename = get_index_filename ();
+    mapped_file = g_mapped_file_new (filename, FALSE, NULL);
+    g_free (filename);
+    if (mapped_file == NULL)
+    {
+        return NULL;
+    }
+
+    data = g_mapped_file_get_contents (mapped_file);
+    length = g_mapped_file_get_length (mapped_file);
+
+    if (length < INDEX_HEADER_LENGTH || memcmp (data, INDEX_MAGIC, INDEX_MAGIC_LENGTH) != 0)
+    {
+        g_mapped_file_unref (mapped_file);
+        return NULL;
+    }
+
+    memcpy (&n_roots, data + 8, sizeof (n_roots));
+    memcpy (&n_types, data + 12, sizeof (n_types));
+    memcpy (&build_time, data + 16, sizeof (build_time));
+    memcpy (&n_entries, data + 24, sizeof (n_entries));
+    offset = INDEX_HEADER_LENGTH;
+
+    valid = n_roots == g_strv_length (roots);
+    for (i = 0; valid && i < n_roots; i++)
+    {
+        string = read_string (data, length, &offset);
+        valid = string != NULL && strcmp (string, roots[i]) == 0;
+    }
+
+    types = NULL;
+    if (valid && n_types <= length)
+    {
+        types = g_new (const char *, n_types);
+        for (i = 0; valid && i < n_types; i++)
+        {
+            string = read_string (data, length, &offset);
+            valid = string != NULL;
+            if (valid)
+            {
+                types[i] = g_intern_string (string);
+            }
+        }
+    }
+
+    if (!valid || types == NULL || n_entries > length / sizeof (record))
+    {
+        g_free (types);
+        g_mapped_file_unref (mapped_file);
+        return NULL;
+    }
+
+    name_index = name_index_new (roots);
+    name_index->build_time = build_time;
+    ids = g_new (guint32, n_entries);
+
+    for (i = 0; valid && i < n_entries; i++)
+    {
+        valid = offset + sizeof (record) <= length;
+        if (!valid)
+        {
+            break;
+        }
+        memcpy (&record, data + offset, sizeof (record));
+        offset += sizeof (record);
+
+        valid = offset + record.name_length + 1 <= length &&
+                data[offset + record.name_length] == '\0' &&
+                record.content_type < n_types &&
+                (record.parent == INDEX_NONE || record.parent < i);
+        if (!valid)
+        {
+            break;
+        }
+        string = data + offset;
+        offset += record.name_length + 1;
+
+        parent = record.parent == INDEX_NONE ? INDEX_NONE : ids[record.parent];
+        ids[i] = name_index_add (name_index, parent, string,
+                                 record.flags & ENTRY_DIRECTORY,
+                                 record.size, record.mtime,
+                                 types[record.content_type]);
+
+        if (parent == INDEX_NONE)
+        {
+            valid = FALSE;
+            for (j = 0; j < n_roots; j++)
+            {
+                if (strcmp (string, roots[j]) == 0)
+                {
+                    name_index->root_ids[j] = ids[i];
+                    valid = TRUE;
+                }
+            }
+        }
+    }
+
+    g_free (ids);
+    g_free (types);
+    g_mapped_file_unref (mapped_file);
+
+    if (!valid)
+    {
+        name_index_unref (name_index);
+        return NULL;
+    }
+
+    return name_index;
+}
+
+static void
+index_change_free (IndexChange *change)
+{
+    g_free (change->path);
+    g_free (change->new_path);
+    g_free (change);
+}
+
+/* Adds a file that appeared, or refreshes the attributes of one that
+ * is already known. Returns TRUE if a folder was added whose contents
+ * are not known.
+ */
+static gboolean
+name_index_update_path (NameIndex  *name_index,
+                        const char *path)
+{
+    struct stat statbuf;
+    IndexEntry *entry;
+    char *dirname, *basename;
+    guint32 parent, id;
+    gboolean new_directory;
+
+    new_directory = FALSE;
+    dirname = g_path_get_dirname (path);
+    basename = g_path_get_basename (path);
+
+    parent = basename[0] == '.' ? INDEX_NONE : name_index_lookup_path (name_index, dirname);
+    if (parent != INDEX_NONE && lstat (path, &statbuf) == 0)
+    {
+        id = name_index_find_child (name_index, parent, basename);
+        if (id != INDEX_NONE &&
+            (INDEX_ENTRY (name_index, id)->flags & ENTRY_DIRECTORY) != (S_ISDIR (statbuf.st_mode) ? ENTRY_DIRECTORY : 0))
+        {
+            name_index_remove (name_index, id);
+            id = INDEX_NONE;
+        }
+
+        if (id == INDEX_NONE)
+        {
+            /* A folder copied in as a whole by another program only
+             * gets its own entry here; its contents are found by the
+             * next rescan.
+             */
+            name_index_add_stat (name_index, parent, basename, &statbuf);
+            new_directory = S_ISDIR (statbuf.st_mode);
+        }
+        else
+        {
+            entry = INDEX_ENTRY (name_index, id);
+            entry->size = statbuf.st_size;
+            entry->mtime = statbuf.st_mtime;
+        }
+    }
+
+    g_free (dirname);
+    g_free (basename);
+
+    return new_directory;
+}
+
+static void
+name_index_remove_path (NameIndex  *name_index,
+                        const char *path)
+{
+    guint32 id;
+
+    id = name_index_lookup_path (name_index, path);
+    if (id != INDEX_NONE && INDEX_ENTRY (name_index, id)->parent != INDEX_NONE)
+    {
+        name_index_remove (name_index, id);
+    }
+}
+
+/* A moved entry is replaced by a new one, and its children are handed
+ * over to that, so nothing below a moved folder needs to be re-read.
+ * Returns TRUE like name_index_update_path ().
+ */
+static gboolean
+name_index_move_path (NameIndex  *name_index,
+                      const char *path,
+                      const char *new_path)
+{
+    IndexEntry *entry, *new_entry;
+    char *dirname, *basename;
+    guint32 id, new_parent, new_id, existing, child;
+
+    id = name_index_lookup_path (name_index, path);
+    if (id == INDEX_NONE || INDEX_ENTRY (name_index, id)->parent == INDEX_NONE)
+    {
+        return name_index_update_path (name_index, new_path);
+    }
+
+    dirname = g_path_get_dirname (new_path);
+    basename = g_path_get_basename (new_path);
+
+    new_parent = basename[0] == '.' ? INDEX_NONE : name_index_lookup_path (name_index, dirname);
+    if (new_parent == INDEX_NONE)
+    {
+        name_index_remove (name_index, id);
+    }
+    else
+    {
+        existing = name_index_find_child (name_index, new_parent, basename);
+        if (existing != INDEX_NONE && existing != id)
+        {
+            name_index_remove (name_index, existing);
+        }
+
+        name_index_unlink (name_index, id);
+
+        entry = INDEX_ENTRY (name_index, id);
+        new_id = name_index_add (name_index, new_parent, basename, entry->flags,
+                                 entry->size, entry->mtime,
+                                 guess_content_type (basename, entry->flags & ENTRY_DIRECTORY));
+
+        /* Adding may have moved the array. */
+        entry = INDEX_ENTRY (name_index, id);
+        new_entry = INDEX_ENTRY (name_index, new_id);
+        new_entry->first_child = entry->first_child;
+        for (child = entry->first_child; child != INDEX_NONE;
+             child = INDEX_ENTRY (name_index, child)->next_sibling)
+        {
+            INDEX_ENTRY (name_index, child)->parent = new_id;
+        }
+        entry->first_child = INDEX_NONE;
+        entry->flags |= ENTRY_REMOVED;
+    }
+
+    g_free (dirname);
+    g_free (basename);
+
+    return FALSE;
+}
+
+/* Returns TRUE if the index needs a rescan to catch up. */
+static gboolean
+apply_change (NameIndex   *name_index,
+              IndexChange *change)
+{
+    switch (change->type)
+    {
+    case CHANGE_ADDED:
+        return name_index_update_path (name_index, change->path);
+    case CHANGE_REMOVED:
+        name_index_remove_path (name_index, change->path);
+        break;
+    case CHANGE_MOVED:
+        return name_index_move_path (name_index, change->path, change->new_path);
+    }
+
+    return FALSE;
+}
+
+static gboolean
+index_ready_idle (gpointer user_data)
+{
+    IndexReady *ready;
+    IndexChange *change;
+    GList *l;
+
+    ready = user_data;
+
+    if (ready->generation != index_generation)
+    {
+        /* The configured folders changed in the meantime. */
+        name_index_unref (ready->name_index);
+        g_free (ready);
+        return FALSE;
+    }
+
+    if (current_index != NULL)
+    {
+        name_index_unref (current_index);
+    }
+    current_index = ready->name_index;
+
+    /* Replay what happened while the index was being read. */
+    for (l = pending_changes.head; l != NULL; l = l->next)
+    {
+        change = l->data;
+        apply_change (current_index, change);
+    }
+
+    if (ready->finished)
+    {
+        index_building = FALSE;
+        index_complete = TRUE;
+        g_queue_foreach (&pending_changes, (GFunc) index_change_free, NULL);
+        g_queue_clear (&pending_changes);
+    }
+
+    g_free (ready);
+
+    return FALSE;
+}
+
+static void
+post_index (NameIndex *name_index,
+            guint      generation,
+            gboolean   finished)
+{
+    IndexReady *ready;
+
+    ready = g_new (IndexReady, 1);
+    ready->name_index = name_index;
+    ready->generation = generation;
+    ready->finished = finished;
+    g_idle_add (index_ready_idle, ready);
+}
+
+static gpointer
+index_build_thread (gpointer user_data)
+{
+    IndexBuild *build;
+    NameIndex *name_index;
+    gint64 now;
+    guint i;
+
+    build = user_data;
+    now = g_get_real_time () / G_USEC_PER_SEC;
+
+    /* Answer searches from the saved index while rescanning. */
+    name_index = build->load_saved ? name_index_load (build->roots) : NULL;
+    if (name_index != NULL)
+    {
+        if (now - name_index->build_time < INDEX_MAX_AGE)
+        {
+            post_index (name_index, build->generation, TRUE);
+            goto out;
+        }
+        post_index (name_index, build->generation, FALSE);
+    }
+
+    name_index = name_index_new (build->roots);
+    name_index->build_time = now;
+    for (i = 0; build->roots[i] != NULL; i++)
+    {
+        name_index_scan_root (name_index, i);
+    }
+    name_index_save (name_index);
+    post_index (name_index, build->generation, TRUE);
+
+out:
+    g_strfreev (build->roots);
+    g_free (build);
+
+    return NULL;
+}
+
+/* Returns the configured folders as absolute canonical paths, without
+ * folders that are inside other ones, or NULL if there are none.
+ */
+static char **
+get_configured_roots (void)
+{
+    GPtrArray *roots;
+    char **configured;
+    char *path;
+    guint i, j;
+    gsize length;
+    gboolean nested;
+
+    configured = g_settings_get_strv (baul_preferences, BAUL_PREFERENCES_SEARCH_INDEX_ROOTS);
+    roots = g_ptr_array_new ();
+
+    for (i = 0; configured[i] != NULL; i++)
+    {
+        if (configured[i][0] == '~')
+        {
+            path = g_build_filename (g_get_home_dir (), configured[i] + 1, NULL);
+        }
+        else if (g_path_is_absolute (configured[i]))
+        {
+            path = g_strdup (configured[i]);
+        }
+        else
+        {
+            continue;
+        }
+        g_ptr_array_add (roots, g_canonicalize_filename (path, NULL));
+        g_free (path);
+    }
+    g_strfreev (configured);
+
+    for (i = 0; i < roots->len; )
+    {
+        nested = FALSE;
+        for (j = 0; j < roots->len && !nested; j++)
+        {
+            length = strlen (g_ptr_array_index (roots, j));
+            if (i != j &&
+                strncmp (g_ptr_array_index (roots, i), g_ptr_array_index (roots, j), length) == 0)
+            {
+                const char *rest = (const char *) g_ptr_array_index (roots, i) + length;
+
+                /* Of two equal entries, keep the first. */
+                nested = (rest[0] == '\0' && j < i) || rest[0] == '/' || length == 1;
+            }
+        }
+
+        if (nested)
+        {
+            g_free (g_ptr_array_index (roots, i));
+            g_ptr_array_remove_index (roots, i);
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    if (roots->len == 0)
+    {
+        g_ptr_array_free (roots, TRUE);
+        return NULL;
+    }
+
+    g_ptr_array_add (roots, NULL);
+
+    return (char **) g_ptr_array_free (roots, FALSE);
+}
+
+static void
+index_start_build (char     **roots,
+                   gboolean   load_saved)
+{
+    IndexBuild *build;
+    GThread *thread;
+
+    build = g_new (IndexBuild, 1);
+    build->roots = roots;
+    build->generation = index_generation;
+    build->load_saved = load_saved;
+    index_building = TRUE;
+
+    thread = g_thread_new ("baul-filename-index", index_build_thread, build);
+    g_thread_unref (thread);
+}
+
+static void index_schedule_rescan (void);
+
+static gboolean
+index_rescan_timeout (gpointer user_data G_GNUC_UNUSED)
+{
+    index_rescan_id = 0;
+
+    /* A build that is already running may have missed the changes. */
+    if (index_building)
+    {
+        index_schedule_rescan ();
+    }
+    else if (current_index != NULL)
+    {
+        /* The current index keeps answering searches meanwhile. */
+        index_start_build (g_strdupv (current_index->roots), FALSE);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Waits for a burst of changes to end before rescanning. */
+static void
+index_schedule_rescan (void)
+{
+    if (index_rescan_id != 0)
+    {
+        g_source_remove (index_rescan_id);
+    }
+    index_rescan_id = g_timeout_add_seconds (INDEX_RESCAN_DELAY, index_rescan_timeout, NULL);
+}
+
+static void
+index_restart (void)
+{
+    char **roots;
+
+    index_generation++;
+    index_building = FALSE;
+    index_complete = FALSE;
+    if (index_rescan_id != 0)
+    {
+        g_source_remove (index_rescan_id);
+        index_rescan_id = 0;
+    }
+    if (current_index != NULL)
+    {
+        name_index_unref (current_index);
+        current_index = NULL;
+    }
+    g_queue_foreach (&pending_changes, (GFunc) index_change_free, NULL);
+    g_queue_clear (&pending_changes);
+
+    roots = get_configured_roots ();
+    if (roots == NULL)
+    {
+        return;
+    }
+
+    index_start_build (roots, TRUE);
+}
+
+static void
+free_index_at_shutdown (void)
+{
+    index_generation++;
+    if (index_rescan_id != 0)
+    {
+        g_source_remove (index_rescan_id);
+        index_rescan_id = 0;
+    }
+    if (current_index != NULL)
+    {
+        name_index_unref (current_index);
+        current_index = NULL;
+    }
+    g_queue_foreach (&pending_changes, (GFunc) index_change_free, NULL);
+    g_queue_clear (&pending_changes);
+}
+
+void
+baul_filename_index_init (void)
+{
+    if (index_initialized)
+    {
+        return;
+    }
+    index_initialized = TRUE;
+
+    g_signal_connect_swapped (baul_preferences,
+                              "changed::" BAUL_PREFERENCES_SEARCH_INDEX_ROOTS,
+                              G_CALLBACK (index_restart),
+                              NULL);
+    eel_debug_call_at_shutdown (free_index_at_shutdown);
+
+    index_restart ();
+}
+
+gboolean
+baul_filename_index_is_enabled (void)
+{
+    baul_filename_index_init ();
+
+    return current_index != NULL || index_building;
+}
+
+static void
+queue_change (IndexChangeType type,
+              GFile          *location,
+              GFile          *new_location)
+{
+    IndexChange *change;
+    char *path, *new_path;
+
+    if (current_index == NULL && !index_building)
+    {
+        return;
+    }
+
+    path = g_file_get_path (location);
+    if (path == NULL)
+    {
+        return;
+    }
+
+    new_path = NULL;
+    if (new_location != NULL)
+    {
+        new_path = g_file_get_path (new_location);
+        if (new_path == NULL)
+        {
+            type = CHANGE_REMOVED;
+        }
+    }
+
+    change = g_new (IndexChange, 1);
+    change->type = type;
+    change->path = path;
+    change->new_path = new_path;
+
+    if (current_index != NULL &&
+        apply_change (current_index, change))
+    {
+        index_schedule_rescan ();
+    }
+
+    /* Changes may not be in the index that is still being built, so
+     * they are applied to it again once it is done.
+     */
+    if (index_building)
+    {
+        g_queue_push_tail (&pending_changes, change);
+    }
+    else
+    {
+        index_change_free (change);
+    }
+}
+
+void
+baul_filename_index_notify_added (GFile *location)
+{
+    queue_change (CHANGE_ADDED, location, NULL);
+}
+
+void
+baul_filename_index_notify_changed (GFile *location)
+{
+    queue_change (CHANGE_ADDED, location, NULL);
+}
+
+void
+baul_filename_index_notify_removed (GFile *location)
+{
+    queue_change (CHANGE_REMOVED, location, NULL);
+}
+
+void
+baul_filename_index_notify_moved (GFile *from,
+                                  GFile *to)
+{
+    queue_change (CHANGE_MOVED, from, to);
+}
+
+/* Returns FALSE if the current index can't answer the query. The
+ * location is INDEX_NONE for a query that searches all the roots.
+ */
+static gboolean
+get_query_location (BaulQuery *query,
+                    guint32   *location)
+{
+    char *uri, *contained_text, *path;
+    GList *tags;
+
+    if (current_index == NULL)
+    {
+        return FALSE;
+    }
+
+    /* Neither the contents nor the tags of files are indexed. */
+    contained_text = baul_query_get_contained_text (query);
+    tags = baul_query_get_tags (query);
+    if ((contained_text != NULL && contained_text[0] != '\0') || tags != NULL)
+    {
+        g_free (contained_text);
+        g_list_free_full (tags, g_free);
+        return FALSE;
+    }
+    g_free (contained_text);
+
+    *location = INDEX_NONE;
+    uri = baul_query_get_location (query);
+    if (uri != NULL)
+    {
+        path = g_filename_from_uri (uri, NULL, NULL);
+        g_free (uri);
+        if (path == NULL)
+        {
+            return FALSE;
+        }
+
+        *location = name_index_lookup_path (current_index, path);
+        g_free (path);
+        if (*location == INDEX_NONE)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+gboolean
+baul_filename_index_can_search (BaulQuery *query)
+{
+    guint32 location;
+
+    /* Until the first build is done, the index may miss files. A
+     * rescan keeps the complete index it started from.
+     */
+    if (current_index == NULL || !index_complete)
+    {
+        return FALSE;
+    }
+
+    return query == NULL || get_query_location (query, &location);
+}
+
+BaulFilenameIndexSearch *
+baul_filename_index_search_new (BaulQuery *query)
+{
+    BaulFilenameIndexSearch *search;
+    GArray *positions, *rarest;
+    char *text, *normalized, *lower;
+    guint32 location;
+    const char *p;
+    int i;
+
+    if (!get_query_location (query, &location))
+    {
+        return NULL;
+    }
+
+    search = g_new0 (BaulFilenameIndexSearch, 1);
+    search->name_index = name_index_ref (current_index);
+    search->location = location;
+    search->mime_types = baul_query_get_mime_types (query);
+    search->timestamp = baul_query_get_timestamp (query);
+    search->size = baul_query_get_size (query);
+
+    text = baul_query_get_text (query);
+    normalized = g_utf8_normalize (text, -1, G_NORMALIZE_NFD);
+    lower = g_utf8_strdown (normalized, -1);
+    search->words = g_strsplit (lower, " ", -1);
+    g_free (text);
+    g_free (normalized);
+    g_free (lower);
+
+    /* Only look at the names that have the rarest trigram of the words
+     * in them.
+     */
+    rarest = NULL;
+    for (i = 0; search->words[i] != NULL && !search->no_candidates; i++)
+    {
+        if (strlen (search->words[i]) < 3)
+        {
+            continue;
+        }
+
+        for (p = search->words[i]; p[2] != '\0'; p++)
+        {
+            positions = g_hash_table_lookup (current_index->trigrams,
+                                             GUINT_TO_POINTER (TRIGRAM (p)));
+            if (positions == NULL)
+            {
+                search->no_candidates = TRUE;
+                break;
+            }
+
+            if (rarest == NULL || positions->len < rarest->len)
+            {
+                rarest = positions;
+            }
+        }
+    }
+
+    if (rarest != NULL && !search->no_candidates)
+    {
+        search->candidates = g_array_ref (rarest);
+    }
+
+    return search;
+}
+
+static gboolean
+search_matches (BaulFilenameIndexSearch *search,
+                guint32                  id)
+{
+    NameIndex *name_index;
+    IndexEntry *entry;
+    guint32 ancestor;
+    gboolean hit;
+    GList *l;
+    int i;
+
+    name_index = search->name_index;
+    entry = INDEX_ENTRY (name_index, id);
+
+    if ((entry->flags & ENTRY_REMOVED) || entry->parent == INDEX_NONE)
+    {
+        return FALSE;
+    }
+
+    for (i = 0; search->words[i] != NULL; i++)
+    {
+        if (strstr (entry->lower_name, search->words[i]) == NULL)
+        {
+            return FALSE;
+        }
+    }
+
+    if (search->location != INDEX_NONE)
+    {
+        ancestor = entry->parent;
+        while (ancestor != INDEX_NONE && ancestor != search->location)
+        {
+            ancestor = INDEX_ENTRY (name_index, ancestor)->parent;
+        }
+
+        if (ancestor == INDEX_NONE)
+        {
+            return FALSE;
+        }
+    }
+
+    if (search->mime_types != NULL)
+    {
+        hit = FALSE;
+        for (l = search->mime_types; l != NULL; l = l->next)
+        {
+            if (g_content_type_equals (entry->content_type, l->data))
+            {
+                hit = TRUE;
+                break;
+            }
+        }
+
+        if (!hit)
+        {
+            return FALSE;
+        }
+    }
+
+    if (search->timestamp > 0 && search->timestamp < entry->mtime)
+    {
+        return FALSE;
+    }
+    if (search->timestamp < 0 && entry->mtime < ABS (search->timestamp))
+    {
+        return FALSE;
+    }
+
+    if (search->size > 0 && entry->size < search->size)
+    {
+        return FALSE;
+    }
+    if (search->size < 0 && ABS (search->size) < entry->size)
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+gboolean
+baul_filename_index_search_step (BaulFilenameIndexSearch  *search,
+                                 GList                   **hits)
+{
+    guint n_candidates, end;
+    guint32 id;
+    char *path, *uri;
+
+    if (search->no_candidates)
+    {
+        return FALSE;
+    }
+
+    /* Both can grow while the search runs; new files are found too. */
+    n_candidates = search->candidates != NULL ?
+                   search->candidates->len : search->name_index->entries->len;
+
+    end = MIN (n_candidates, search->position + SEARCH_STEP_SIZE);
+    for (; search->position < end; search->position++)
+    {
+        id = search->candidates != NULL ?
+             g_array_index (search->candidates, guint32, search->position) : search->position;
+
+        if (search_matches (search, id))
+        {
+            path = name_index_get_path (search->name_index, id);
+            uri = g_filename_to_uri (path, NULL, NULL);
+            if (uri != NULL)
+            {
+                *hits = g_list_prepend (*hits, uri);
+            }
+            g_free (path);
+        }
+    }
+
+    return search->position < n_candidates;
+}
+
+void
+baul_filename_index_search_free (BaulFilenameIndexSearch *search)
+{
+    if (search->candidates != NULL)
+    {
+        g_array_unref (search->candidates);
+    }
+    g_list_free_full (search->mime_types, g_free);
+    g_strfreev (search->words);
+    name_index_unref (search->name_index);
+    g_free (search);
+}
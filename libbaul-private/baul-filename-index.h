@@ -0,0 +1,66 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   baul-filename-index.h: Persistent index of the file names below
+   some local folders.
+
+   Copyright (C) 2026 CAFE Desktop.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef BAUL_FILENAME_INDEX_H
+#define BAUL_FILENAME_INDEX_H
+
+#include <gio/gio.h>
+
+#include "baul-query.h"
+
+typedef struct BaulFilenameIndexSearch BaulFilenameIndexSearch;
+
+/* Everything here must be called from the main thread. */
+
+/* Starts loading or building the index in the background, if any
+ * folders are configured to be indexed.
+ */
+void                     baul_filename_index_init           (void);
+gboolean                 baul_filename_index_is_enabled     (void);
+
+/* Keep the index up to date with the changes baul sees. */
+void                     baul_filename_index_notify_added   (GFile *location);
+void                     baul_filename_index_notify_changed (GFile *location);
+void                     baul_filename_index_notify_removed (GFile *location);
+void                     baul_filename_index_notify_moved   (GFile *from,
+							     GFile *to);
+
+/* Whether a search for the query would find everything, without
+ * falling back to looking at the files: the index is complete and
+ * covers the location of the query. A NULL query stands for one over
+ * all the indexed folders.
+ */
+gboolean                 baul_filename_index_can_search     (BaulQuery               *query);
+
+/* Returns NULL if the query can't be answered from the index, for
+ * example because it searches outside the indexed folders or looks at
+ * the contents of files. Otherwise call search_step () until it
+ * returns FALSE; each call looks at a bounded number of files and
+ * prepends the URIs of the hits to the list.
+ */
+BaulFilenameIndexSearch *baul_filename_index_search_new     (BaulQuery               *query);
+gboolean                 baul_filename_index_search_step    (BaulFilenameIndexSearch *search,
+							     GList                  **hits);
+void                     baul_filename_index_search_free    (BaulFilenameIndexSearch *search);
+
+#endif /* BAUL_FILENAME_INDEX_H */
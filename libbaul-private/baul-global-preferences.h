@@ -186,8 +186,11 @@ typedef enum
 
 #define BAUL_PREFERENCES_SHOW_TEXT_IN_ICONS		    "show-icon-text"
 #define BAUL_PREFERENCES_SHOW_DIRECTORY_ITEM_COUNTS "show-directory-item-counts"
+#define BAUL_PREFERENCES_DEEP_COUNT_CACHE		"deep-count-cache"
 #define BAUL_PREFERENCES_SHOW_IMAGE_FILE_THUMBNAILS	"show-image-thumbnails"
 #define BAUL_PREFERENCES_IMAGE_FILE_THUMBNAIL_LIMIT	"thumbnail-limit"
+#define BAUL_PREFERENCES_SEARCH_TEXT_SIZE_LIMIT	"search-text-size-limit"
+#define BAUL_PREFERENCES_SEARCH_INDEX_ROOTS	"search-index-roots"
 #define BAUL_PREFERENCES_PREVIEW_SOUND		        "preview-sound"
 
     typedef enum
@@ -93,6 +93,10 @@ struct _BaulIconCanvasItemPrivate
     GdkPixbuf *pixbuf;
     cairo_surface_t *rendered_surface;
     GList *emblem_pixbufs;
+
+    /* Size reserved for the image while there is none, in pixels. */
+    int placeholder_width;
+    int placeholder_height;
     char *editable_text;		/* Text that can be modified by a renaming function */
     char *additional_text;		/* Text that cannot be modifed, such as file size, etc. */
     CdkPoint *attach_points;
@@ -226,6 +230,8 @@ static void     draw_pixbuf                          (GdkPixbuf
 static PangoLayout *get_label_layout                 (PangoLayout               **layout,
     						      BaulIconCanvasItem        *item,
     						      const char                *text);
+static PangoAlignment get_label_alignment            (BaulIconContainer         *container);
+static PangoFontDescription *get_label_font_description (BaulIconContainer     *container);
 
 static gboolean hit_test_stretch_handle              (BaulIconCanvasItem        *item,
     						      EelIRect                  canvas_rect,
@@ -522,10 +528,19 @@ get_scaled_icon_size (BaulIconCanvasItem *item,
         pixbuf = item->details->pixbuf;
     }
 
+    if (pixbuf == NULL)
+    {
+        if (width)
+            *width = (item == NULL) ? 0 : (item->details->placeholder_width / scale);
+        if (height)
+            *height = (item == NULL) ? 0 : (item->details->placeholder_height / scale);
+        return;
+    }
+
     if (width)
-        *width = (pixbuf == NULL) ? 0 : (gdk_pixbuf_get_width (pixbuf) / scale);
+        *width = gdk_pixbuf_get_width (pixbuf) / scale;
     if (height)
-        *height = (pixbuf == NULL) ? 0 : (gdk_pixbuf_get_height (pixbuf) / scale);
+        *height = gdk_pixbuf_get_height (pixbuf) / scale;
 }
 
 cairo_surface_t *
@@ -576,12 +591,15 @@ baul_icon_canvas_item_get_drag_surface (BaulIconCanvasItem *item)
 
     cr = cairo_create (surface);
 
-    drag_surface = cdk_cairo_surface_create_from_pixbuf (item->details->pixbuf,
-                                                         ctk_widget_get_scale_factor (CTK_WIDGET (canvas)),
-                                                         ctk_widget_get_window (CTK_WIDGET (canvas)));
-    ctk_render_icon_surface (context, cr, drag_surface,
-                             item_offset_x, item_offset_y);
-    cairo_surface_destroy (drag_surface);
+    if (item->details->pixbuf != NULL)
+    {
+        drag_surface = cdk_cairo_surface_create_from_pixbuf (item->details->pixbuf,
+                                                             ctk_widget_get_scale_factor (CTK_WIDGET (canvas)),
+                                                             ctk_widget_get_window (CTK_WIDGET (canvas)));
+        ctk_render_icon_surface (context, cr, drag_surface,
+                                 item_offset_x, item_offset_y);
+        cairo_surface_destroy (drag_surface);
+    }
 
     get_scaled_icon_size (item, &pix_width, &pix_height);
 
@@ -644,11 +662,67 @@ baul_icon_canvas_item_set_image (BaulIconCanvasItem *item,
     }
 
     details->pixbuf = image;
+    details->placeholder_width = 0;
+    details->placeholder_height = 0;
 
     baul_icon_canvas_item_invalidate_bounds_cache (item);
     eel_canvas_item_request_update (EEL_CANVAS_ITEM (item));
 }
 
+/* Drops the image, leaving an empty space of the given size in pixels
+ * where it would be.
+ */
+void
+baul_icon_canvas_item_set_image_placeholder (BaulIconCanvasItem *item,
+        int width,
+        int height)
+{
+    BaulIconCanvasItemPrivate *details;
+
+    g_return_if_fail (BAUL_IS_ICON_CANVAS_ITEM (item));
+
+    details = item->details;
+    if (details->pixbuf == NULL &&
+            details->placeholder_width == width &&
+            details->placeholder_height == height)
+    {
+        return;
+    }
+
+    baul_icon_canvas_item_set_image (item, NULL);
+    details->placeholder_width = width;
+    details->placeholder_height = height;
+}
+
+/* Drops the image to save memory, but keeps its space, so that the
+ * item stays the same size until it gets an image again.
+ */
+void
+baul_icon_canvas_item_release_image (BaulIconCanvasItem *item)
+{
+    BaulIconCanvasItemPrivate *details;
+
+    g_return_if_fail (BAUL_IS_ICON_CANVAS_ITEM (item));
+
+    details = item->details;
+    if (details->pixbuf == NULL)
+    {
+        return;
+    }
+
+    details->placeholder_width = gdk_pixbuf_get_width (details->pixbuf);
+    details->placeholder_height = gdk_pixbuf_get_height (details->pixbuf);
+
+    g_object_unref (details->pixbuf);
+    details->pixbuf = NULL;
+
+    if (details->rendered_surface != NULL)
+    {
+        cairo_surface_destroy (details->rendered_surface);
+        details->rendered_surface = NULL;
+    }
+}
+
 void
 baul_icon_canvas_item_set_emblems (BaulIconCanvasItem *item,
                                    GList *emblem_pixbufs)
@@ -1044,36 +1118,28 @@ prepare_pango_layout_width (BaulIconCanvasItem *item,
     }
 }
 
-static void
-prepare_pango_layout_for_measure_entire_text (BaulIconCanvasItem *item,
-        PangoLayout *layout)
+static int
+get_label_height_for_entire_text (BaulIconCanvasItem *item)
 {
     BaulIconContainer *container;
 
-    prepare_pango_layout_width (item, layout);
-
     container = BAUL_ICON_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
 
     if (IS_COMPACT_VIEW (container))
     {
-        pango_layout_set_height (layout, -1);
-    }
-    else
-    {
-        pango_layout_set_height (layout, G_MININT);
+        return -1;
     }
+
+    return G_MININT;
 }
 
-static void
-prepare_pango_layout_for_draw (BaulIconCanvasItem *item,
-                               PangoLayout *layout)
+static int
+get_label_height_for_draw (BaulIconCanvasItem *item)
 {
     BaulIconCanvasItemPrivate *details;
     BaulIconContainer *container;
     gboolean needs_highlight;
 
-    prepare_pango_layout_width (item, layout);
-
     container = BAUL_ICON_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
     details = item->details;
 
@@ -1081,7 +1147,7 @@ prepare_pango_layout_for_draw (BaulIconCanvasItem *item,
 
     if (IS_COMPACT_VIEW (container))
     {
-        pango_layout_set_height (layout, -1);
+        return -1;
     }
     else if (needs_highlight ||
              details->is_highlighted_as_keyboard_focus ||
@@ -1089,7 +1155,7 @@ prepare_pango_layout_for_draw (BaulIconCanvasItem *item,
              container->details->label_position == BAUL_ICON_LABEL_POSITION_BESIDE)
     {
         /* VOODOO-TODO, cf. compute_text_rectangle() */
-        pango_layout_set_height (layout, G_MININT);
+        return G_MININT;
     }
     else
     {
@@ -1097,8 +1163,198 @@ prepare_pango_layout_for_draw (BaulIconCanvasItem *item,
          * the layout height already fits into max. layout lines. But pango should figure this
          * out itself (which it doesn't ATM).
          */
-        pango_layout_set_height (layout,
-                                 baul_icon_container_get_max_layout_lines_for_pango (container));
+        return baul_icon_container_get_max_layout_lines_for_pango (container);
+    }
+}
+
+static void
+prepare_pango_layout_for_draw (BaulIconCanvasItem *item,
+                               PangoLayout *layout)
+{
+    prepare_pango_layout_width (item, layout);
+    pango_layout_set_height (layout, get_label_height_for_draw (item));
+}
+
+/* Label measurements are shared by all icon canvas items. Folders tend
+ * to have many labels with the same text, and going back to a zoom
+ * level shouldn't mean shaping every label again.
+ */
+#define LABEL_MEASUREMENT_CACHE_SIZE 8192
+
+typedef struct
+{
+    /* What was measured. */
+    char *text;
+    PangoFontDescription *font;
+    double resolution;
+    int width;
+    int height;
+    PangoAlignment alignment;
+    int max_layout_lines;
+
+    int text_width;
+    int text_height;
+    int text_dx;
+    int text_height_for_layout;
+} LabelMeasurement;
+
+static GHashTable *label_measurements;
+
+static guint
+label_measurement_hash (gconstpointer p)
+{
+    const LabelMeasurement *measurement;
+    guint hash;
+
+    measurement = p;
+
+    hash = g_str_hash (measurement->text);
+    hash = hash * 31 + pango_font_description_hash (measurement->font);
+    hash = hash * 31 + (guint) measurement->width;
+    hash = hash * 31 + (guint) measurement->height;
+    hash = hash * 31 + (guint) measurement->max_layout_lines;
+
+    return hash;
+}
+
+static gboolean
+label_measurement_equal (gconstpointer a,
+                         gconstpointer b)
+{
+    const LabelMeasurement *measurement_a, *measurement_b;
+
+    measurement_a = a;
+    measurement_b = b;
+
+    return measurement_a->width == measurement_b->width &&
+           measurement_a->height == measurement_b->height &&
+           measurement_a->max_layout_lines == measurement_b->max_layout_lines &&
+           measurement_a->alignment == measurement_b->alignment &&
+           measurement_a->resolution == measurement_b->resolution &&
+           strcmp (measurement_a->text, measurement_b->text) == 0 &&
+           pango_font_description_equal (measurement_a->font, measurement_b->font);
+}
+
+static void
+label_measurement_free (gpointer p)
+{
+    LabelMeasurement *measurement;
+
+    measurement = p;
+
+    g_free (measurement->text);
+    pango_font_description_free (measurement->font);
+    g_free (measurement);
+}
+
+/* Forgets all label measurements, for when something the cache isn't
+ * keyed on, like the font options, has changed.
+ */
+void
+baul_icon_canvas_item_clear_label_measurements (void)
+{
+    if (label_measurements != NULL)
+    {
+        g_hash_table_remove_all (label_measurements);
+    }
+}
+
+/* Measures @text laid out with the given pango height, and with
+ * @max_layout_lines, if positive, for the height used by the layout.
+ * The PangoLayout is only made if the measurement isn't cached yet.
+ */
+static void
+measure_label_layout (BaulIconCanvasItem *item,
+                      PangoLayout **layout_cache,
+                      const char *text,
+                      PangoFontDescription *font,
+                      int height,
+                      int max_layout_lines,
+                      int *width_out,
+                      int *height_out,
+                      int *dx_out,
+                      int *height_for_layout_out)
+{
+    BaulIconContainer *container;
+    LabelMeasurement key, *measurement;
+    PangoLayout *layout;
+    double max_text_width;
+
+    container = BAUL_ICON_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
+    max_text_width = baul_icon_canvas_item_get_max_text_width (item);
+
+    key.text = (char *) text;
+    key.font = font;
+    key.resolution = pango_cairo_context_get_resolution (ctk_widget_get_pango_context (CTK_WIDGET (container)));
+    key.width = max_text_width < 0 ? -1 : floor (max_text_width) * PANGO_SCALE;
+    key.height = height;
+    key.alignment = get_label_alignment (container);
+    key.max_layout_lines = max_layout_lines;
+
+    if (label_measurements == NULL)
+    {
+        label_measurements = g_hash_table_new_full (label_measurement_hash,
+                                                    label_measurement_equal,
+                                                    label_measurement_free,
+                                                    NULL);
+    }
+
+    measurement = g_hash_table_lookup (label_measurements, &key);
+
+    if (measurement == NULL)
+    {
+        layout = get_label_layout (layout_cache, item, text);
+        prepare_pango_layout_width (item, layout);
+        pango_layout_set_height (layout, height);
+
+        measurement = g_new (LabelMeasurement, 1);
+        *measurement = key;
+        measurement->text = g_strdup (text);
+        measurement->font = pango_font_description_copy (font);
+
+        layout_get_full_size (layout,
+                              &measurement->text_width,
+                              &measurement->text_height,
+                              &measurement->text_dx);
+        if (max_layout_lines > 0)
+        {
+            layout_get_size_for_layout (layout,
+                                        max_layout_lines,
+                                        measurement->text_height,
+                                        &measurement->text_height_for_layout);
+        }
+        else
+        {
+            measurement->text_height_for_layout = measurement->text_height;
+        }
+
+        g_object_unref (layout);
+
+        /* Names in big folders are mostly different, so instead of
+         * keeping track of what was used last just start over.
+         */
+        if (g_hash_table_size (label_measurements) >= LABEL_MEASUREMENT_CACHE_SIZE)
+        {
+            g_hash_table_remove_all (label_measurements);
+        }
+        g_hash_table_add (label_measurements, measurement);
+    }
+
+    if (width_out != NULL)
+    {
+        *width_out = measurement->text_width;
+    }
+    if (height_out != NULL)
+    {
+        *height_out = measurement->text_height;
+    }
+    if (dx_out != NULL)
+    {
+        *dx_out = measurement->text_dx;
+    }
+    if (height_for_layout_out != NULL)
+    {
+        *height_for_layout_out = measurement->text_height_for_layout;
     }
 }
 
@@ -1109,9 +1365,9 @@ measure_label_text (BaulIconCanvasItem *item)
     BaulIconContainer *container;
     gint editable_height, editable_height_for_layout, editable_height_for_entire_text, editable_width, editable_dx;
     gint additional_height, additional_width, additional_dx;
-    PangoLayout *editable_layout;
-    PangoLayout *additional_layout;
+    PangoFontDescription *font;
     gboolean have_editable, have_additional;
+    int height_for_draw;
 
     /* check to see if the cached values are still valid; if so, there's
      * no work necessary
@@ -1156,8 +1412,8 @@ measure_label_text (BaulIconCanvasItem *item)
     additional_dx = 0;
 
     container = BAUL_ICON_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
-    editable_layout = NULL;
-    additional_layout = NULL;
+    font = get_label_font_description (container);
+    height_for_draw = get_label_height_for_draw (item);
 
     if (have_editable)
     {
@@ -1165,33 +1421,37 @@ measure_label_text (BaulIconCanvasItem *item)
          * then, measure text height applicable for layout: editable_height_for_layout
          * next, measure actually displayed height: editable_height
          */
-        editable_layout = get_label_layout (&details->editable_text_layout, item, details->editable_text);
-
-        prepare_pango_layout_for_measure_entire_text (item, editable_layout);
-        layout_get_full_size (editable_layout,
+        measure_label_layout (item, &details->editable_text_layout,
+                              details->editable_text, font,
+                              get_label_height_for_entire_text (item),
+                              baul_icon_container_get_max_layout_lines (container),
                               NULL,
                               &editable_height_for_entire_text,
-                              NULL);
-        layout_get_size_for_layout (editable_layout,
-                                    baul_icon_container_get_max_layout_lines (container),
-                                    editable_height_for_entire_text,
-                                    &editable_height_for_layout);
+                              NULL,
+                              &editable_height_for_layout);
 
-        prepare_pango_layout_for_draw (item, editable_layout);
-        layout_get_full_size (editable_layout,
+        measure_label_layout (item, &details->editable_text_layout,
+                              details->editable_text, font,
+                              height_for_draw, 0,
                               &editable_width,
                               &editable_height,
-                              &editable_dx);
+                              &editable_dx,
+                              NULL);
     }
 
     if (have_additional)
     {
-        additional_layout = get_label_layout (&details->additional_text_layout, item, details->additional_text);
-        prepare_pango_layout_for_draw (item, additional_layout);
-        layout_get_full_size (additional_layout,
-                              &additional_width, &additional_height, &additional_dx);
+        measure_label_layout (item, &details->additional_text_layout,
+                              details->additional_text, font,
+                              height_for_draw, 0,
+                              &additional_width,
+                              &additional_height,
+                              &additional_dx,
+                              NULL);
     }
 
+    pango_font_description_free (font);
+
     details->editable_text_height = editable_height;
 
     if (editable_width > additional_width)
@@ -1228,16 +1488,6 @@ measure_label_text (BaulIconCanvasItem *item)
 
     /* extra to make it look nicer */
     details->text_width += TEXT_BACK_PADDING_X*2;
-
-    if (editable_layout)
-    {
-        g_object_unref (editable_layout);
-    }
-
-    if (additional_layout)
-    {
-        g_object_unref (additional_layout);
-    }
 }
 
 static void
@@ -1971,6 +2221,46 @@ baul_icon_canvas_item_draw (EelCanvasItem  *item,
 	  g_ascii_isdigit (*(p+2))))
 
 
+static PangoAlignment
+get_label_alignment (BaulIconContainer *container)
+{
+    if (container->details->label_position == BAUL_ICON_LABEL_POSITION_BESIDE)
+    {
+        if (!baul_icon_container_is_layout_rtl (container))
+        {
+            return PANGO_ALIGN_LEFT;
+        }
+        else
+        {
+            return PANGO_ALIGN_RIGHT;
+        }
+    }
+
+    return PANGO_ALIGN_CENTER;
+}
+
+static PangoFontDescription *
+get_label_font_description (BaulIconContainer *container)
+{
+    PangoContext *context;
+    PangoFontDescription *desc;
+
+    if (container->details->font)
+    {
+        desc = pango_font_description_from_string (container->details->font);
+    }
+    else
+    {
+        context = ctk_widget_get_pango_context (CTK_WIDGET (container));
+        desc = pango_font_description_copy (pango_context_get_font_description (context));
+        pango_font_description_set_size (desc,
+                                         pango_font_description_get_size (desc) +
+                                         container->details->font_size_table [container->details->zoom_level]);
+    }
+
+    return desc;
+}
+
 static PangoLayout *
 create_label_layout (BaulIconCanvasItem *item,
                      const char *text)
@@ -2001,7 +2291,8 @@ create_label_layout (BaulIconCanvasItem *item,
         GString *str;
         const char *p;
 
-        str = g_string_new (NULL);
+        /* Leave room for a few zero width spaces. */
+        str = g_string_sized_new (strlen (text) + 4 * strlen (ZERO_WIDTH_SPACE));
 
         for (p = text; *p != '\0'; p++)
         {
@@ -2022,22 +2313,7 @@ create_label_layout (BaulIconCanvasItem *item,
 
     pango_layout_set_text (layout, zeroified_text, -1);
     pango_layout_set_auto_dir (layout, FALSE);
-
-    if (container->details->label_position == BAUL_ICON_LABEL_POSITION_BESIDE)
-    {
-        if (!baul_icon_container_is_layout_rtl (container))
-        {
-            pango_layout_set_alignment (layout, PANGO_ALIGN_LEFT);
-        }
-        else
-        {
-            pango_layout_set_alignment (layout, PANGO_ALIGN_RIGHT);
-        }
-    }
-    else
-    {
-        pango_layout_set_alignment (layout, PANGO_ALIGN_CENTER);
-    }
+    pango_layout_set_alignment (layout, get_label_alignment (container));
 
     pango_layout_set_spacing (layout, LABEL_LINE_SPACING);
     pango_layout_set_wrap (layout, PANGO_WRAP_WORD_CHAR);
@@ -2047,18 +2323,7 @@ create_label_layout (BaulIconCanvasItem *item,
     pango_layout_set_attributes (layout, attr_list);
     #endif
 
-    /* Create a font description */
-    if (container->details->font)
-    {
-        desc = pango_font_description_from_string (container->details->font);
-    }
-    else
-    {
-        desc = pango_font_description_copy (pango_context_get_font_description (context));
-        pango_font_description_set_size (desc,
-                                         pango_font_description_get_size (desc) +
-                                         container->details->font_size_table [container->details->zoom_level]);
-    }
+    desc = get_label_font_description (container);
     pango_layout_set_font_description (layout, desc);
     pango_font_description_free (desc);
     g_free (zeroified_text);
@@ -3291,11 +3556,8 @@ baul_icon_canvas_item_accessible_get_offset_at_point (AtkText	 *text,
 
     item = BAUL_ICON_CANVAS_ITEM (atk_gobject_accessible_get_object (ATK_GOBJECT_ACCESSIBLE (text)));
 
-    if (item->details->pixbuf)
-    {
-        get_scaled_icon_size (item, NULL, &height);
-        y -= height;
-    }
+    get_scaled_icon_size (item, NULL, &height);
+    y -= height;
     have_editable = item->details->editable_text != NULL &&
                     item->details->editable_text[0] != '\0';
     have_additional = item->details->additional_text != NULL &&item->details->additional_text[0] != '\0';
@@ -3416,11 +3678,8 @@ baul_icon_canvas_item_accessible_get_character_extents (AtkText	   *text,
     atk_component_get_extents (ATK_COMPONENT (text), &pos_x, &pos_y, NULL, NULL, coords);
     item = BAUL_ICON_CANVAS_ITEM (atk_gobject_accessible_get_object (ATK_GOBJECT_ACCESSIBLE (text)));
 
-    if (item->details->pixbuf)
-    {
-        get_scaled_icon_size (item, NULL, &pix_height);
-        pos_y += pix_height;
-    }
+    get_scaled_icon_size (item, NULL, &pix_height);
+    pos_y += pix_height;
 
     have_editable = item->details->editable_text != NULL &&
                     item->details->editable_text[0] != '\0';
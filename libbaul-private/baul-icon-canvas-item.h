@@ -72,6 +72,10 @@ G_BEGIN_DECLS
     /* attributes */
     void        baul_icon_canvas_item_set_image                (BaulIconCanvasItem       *item,
             GdkPixbuf                    *image);
+    void        baul_icon_canvas_item_set_image_placeholder    (BaulIconCanvasItem       *item,
+            int                           width,
+            int                           height);
+    void        baul_icon_canvas_item_release_image            (BaulIconCanvasItem       *item);
 
     cairo_surface_t* baul_icon_canvas_item_get_drag_surface    (BaulIconCanvasItem       *item);
 
@@ -99,6 +103,7 @@ G_BEGIN_DECLS
             CtkCornerType                *corner);
     void        baul_icon_canvas_item_invalidate_label         (BaulIconCanvasItem       *item);
     void        baul_icon_canvas_item_invalidate_label_size    (BaulIconCanvasItem       *item);
+    void        baul_icon_canvas_item_clear_label_measurements (void);
     EelDRect    baul_icon_canvas_item_get_icon_rectangle       (const BaulIconCanvasItem *item);
     EelDRect    baul_icon_canvas_item_get_text_rectangle       (BaulIconCanvasItem       *item,
             gboolean                      for_layout);
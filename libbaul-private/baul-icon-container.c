@@ -43,6 +43,7 @@
 #include <eel/eel-ctk-extensions.h>
 #include <eel/eel-art-extensions.h>
 #include <eel/eel-editable-label.h>
+#include <eel/eel-glib-extensions.h>
 #include <eel/eel-string.h>
 #include <eel/eel-canvas.h>
 #include <eel/eel-canvas-rect-ellipse.h>
@@ -126,6 +127,25 @@
 /* From baul-icon-canvas-item.c */
 #define MAX_TEXT_WIDTH_BESIDE 90
 
+/* Containers with more icons than this are sorted on several threads. */
+#define PARALLEL_SORT_THRESHOLD 10000
+
+/* Time given to each slice of a layout, in microseconds, which leaves
+ * room for drawing a frame in between.
+ */
+#define LAYOUT_SLICE_USEC 8000
+
+/* Size of the cells of the icon index, in world units. */
+#define ICON_INDEX_CELL_SIZE 256
+
+/* Containers with more icons than this only keep the images of the
+ * icons within NEAR_VIEW_PAGES pages of the visible area, and release
+ * them once the icons are more than FAR_FROM_VIEW_PAGES pages away.
+ */
+#define VIRTUALIZE_THRESHOLD 5000
+#define NEAR_VIEW_PAGES 1
+#define FAR_FROM_VIEW_PAGES 3
+
 #define SNAP_HORIZONTAL(func,x) ((func ((double)((x) - DESKTOP_PAD_HORIZONTAL) / SNAP_SIZE_X) * SNAP_SIZE_X) + DESKTOP_PAD_HORIZONTAL)
 #define SNAP_VERTICAL(func, y) ((func ((double)((y) - DESKTOP_PAD_VERTICAL) / SNAP_SIZE_Y) * SNAP_SIZE_Y) + DESKTOP_PAD_VERTICAL)
 
@@ -287,8 +307,313 @@ typedef struct
     gboolean tight;
 } PlacementGrid;
 
+typedef struct
+{
+    gint64 key;
+    int x, y;
+    GPtrArray *icons;
+} IconIndexCell;
+
 static guint signals[LAST_SIGNAL] = { 0 };
 
+static gboolean
+icon_is_positioned (const BaulIcon *icon)
+{
+    return icon->x != ICON_UNPOSITIONED_VALUE && icon->y != ICON_UNPOSITIONED_VALUE;
+}
+
+/* Functions dealing with the icon index. */
+
+static void
+icon_index_cell_free (IconIndexCell *cell)
+{
+    g_ptr_array_free (cell->icons, TRUE);
+    g_free (cell);
+}
+
+static GHashTable *
+icon_index_new (void)
+{
+    return g_hash_table_new_full (g_int64_hash, g_int64_equal,
+                                  NULL, (GDestroyNotify) icon_index_cell_free);
+}
+
+static gint64
+icon_index_key (int cell_x, int cell_y)
+{
+    return (gint64) (((guint64) (guint32) cell_x << 32) | (guint32) cell_y);
+}
+
+static void
+icon_index_remove (BaulIconContainer *container,
+                   BaulIcon *icon)
+{
+    IconIndexCell *cell;
+    gint64 key;
+
+    if (!icon->is_indexed)
+    {
+        return;
+    }
+
+    key = icon_index_key (icon->index_cell_x, icon->index_cell_y);
+    cell = g_hash_table_lookup (container->details->icon_index, &key);
+    g_assert (cell != NULL);
+
+    g_ptr_array_remove_fast (cell->icons, icon);
+    if (cell->icons->len == 0)
+    {
+        g_hash_table_remove (container->details->icon_index, &key);
+    }
+
+    icon->is_indexed = FALSE;
+}
+
+/* Widens the index extents to cover how far the icon reaches from its
+ * position, both as displayed and with its whole label.
+ */
+static void
+icon_index_widen_extents (BaulIconContainer *container,
+                          BaulIcon *icon)
+{
+    EelDRect *extents;
+    double x1, y1, x2, y2;
+
+    if (!icon->is_indexed)
+    {
+        return;
+    }
+
+    extents = &container->details->icon_index_extents;
+
+    eel_canvas_item_get_bounds (EEL_CANVAS_ITEM (icon->item),
+                                &x1, &y1, &x2, &y2);
+    extents->x0 = MIN (extents->x0, x1 - icon->x);
+    extents->y0 = MIN (extents->y0, y1 - icon->y);
+    extents->x1 = MAX (extents->x1, x2 - icon->x);
+    extents->y1 = MAX (extents->y1, y2 - icon->y);
+
+    baul_icon_canvas_item_get_bounds_for_entire_item (icon->item,
+            &x1, &y1, &x2, &y2);
+    extents->x0 = MIN (extents->x0, x1 - icon->x);
+    extents->y0 = MIN (extents->y0, y1 - icon->y);
+    extents->x1 = MAX (extents->x1, x2 - icon->x);
+    extents->y1 = MAX (extents->y1, y2 - icon->y);
+}
+
+static void
+icon_index_update (BaulIconContainer *container,
+                   BaulIcon *icon)
+{
+    IconIndexCell *cell;
+    int cell_x, cell_y;
+    gint64 key;
+
+    if (!icon_is_positioned (icon))
+    {
+        icon_index_remove (container, icon);
+        return;
+    }
+
+    cell_x = floor (icon->x / ICON_INDEX_CELL_SIZE);
+    cell_y = floor (icon->y / ICON_INDEX_CELL_SIZE);
+
+    if (icon->is_indexed &&
+            icon->index_cell_x == cell_x &&
+            icon->index_cell_y == cell_y)
+    {
+        /* Laying out measures the label again, which may have grown. */
+        icon_index_widen_extents (container, icon);
+        return;
+    }
+
+    icon_index_remove (container, icon);
+
+    key = icon_index_key (cell_x, cell_y);
+    cell = g_hash_table_lookup (container->details->icon_index, &key);
+    if (cell == NULL)
+    {
+        cell = g_new (IconIndexCell, 1);
+        cell->key = key;
+        cell->x = cell_x;
+        cell->y = cell_y;
+        cell->icons = g_ptr_array_new ();
+        g_hash_table_insert (container->details->icon_index, &cell->key, cell);
+    }
+
+    g_ptr_array_add (cell->icons, icon);
+    icon->index_cell_x = cell_x;
+    icon->index_cell_y = cell_y;
+    icon->is_indexed = TRUE;
+
+    icon_index_widen_extents (container, icon);
+}
+
+static GList *
+icon_index_prepend_cell (GList *icons,
+                         IconIndexCell *cell)
+{
+    guint i;
+
+    for (i = 0; i < cell->icons->len; i++)
+    {
+        icons = g_list_prepend (icons, g_ptr_array_index (cell->icons, i));
+    }
+
+    return icons;
+}
+
+/* Returns the positioned icons that may intersect @area, in world
+ * coordinates. Callers still have to check each of them.
+ */
+static GList *
+icon_index_query (BaulIconContainer *container,
+                  const EelDRect *area)
+{
+    GHashTable *cells;
+    EelDRect *extents;
+    IconIndexCell *cell;
+    GHashTableIter iter;
+    double x0, y0, x1, y1;
+    int cell_x, cell_y;
+    GList *icons;
+    gint64 key;
+
+    cells = container->details->icon_index;
+    extents = &container->details->icon_index_extents;
+
+    /* An icon at x covers x + extents->x0 to x + extents->x1. */
+    x0 = floor ((area->x0 - extents->x1) / ICON_INDEX_CELL_SIZE);
+    y0 = floor ((area->y0 - extents->y1) / ICON_INDEX_CELL_SIZE);
+    x1 = floor ((area->x1 - extents->x0) / ICON_INDEX_CELL_SIZE);
+    y1 = floor ((area->y1 - extents->y0) / ICON_INDEX_CELL_SIZE);
+
+    icons = NULL;
+
+    /* Visit the cells of the area, unless there are fewer cells
+     * with icons in them than that.
+     */
+    if ((x1 - x0 + 1) * (y1 - y0 + 1) > g_hash_table_size (cells) ||
+            x0 < G_MININT || y0 < G_MININT || x1 >= G_MAXINT || y1 >= G_MAXINT)
+    {
+        g_hash_table_iter_init (&iter, cells);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &cell))
+        {
+            if (cell->x >= x0 && cell->x <= x1 &&
+                    cell->y >= y0 && cell->y <= y1)
+            {
+                icons = icon_index_prepend_cell (icons, cell);
+            }
+        }
+
+        return icons;
+    }
+
+    for (cell_y = y0; cell_y <= y1; cell_y++)
+    {
+        for (cell_x = x0; cell_x <= x1; cell_x++)
+        {
+            key = icon_index_key (cell_x, cell_y);
+            cell = g_hash_table_lookup (cells, &key);
+            if (cell != NULL)
+            {
+                icons = icon_index_prepend_cell (icons, cell);
+            }
+        }
+    }
+
+    return icons;
+}
+
+/* Returns the positioned icons that may intersect @area, for the
+ * other parts of the container. Free the list with g_list_free ().
+ */
+GList *
+baul_icon_container_get_icons_in_area (BaulIconContainer *container,
+                                       const EelDRect *area)
+{
+    return icon_index_query (container, area);
+}
+
+/* Whether the icon may reach into @area, judging by its position. */
+static gboolean
+icon_may_intersect (BaulIconContainer *container,
+                    BaulIcon *icon,
+                    const EelDRect *area)
+{
+    EelDRect *extents;
+
+    if (!icon_is_positioned (icon))
+    {
+        return FALSE;
+    }
+
+    extents = &container->details->icon_index_extents;
+
+    return icon->x + extents->x1 >= area->x0 &&
+           icon->x + extents->x0 <= area->x1 &&
+           icon->y + extents->y1 >= area->y0 &&
+           icon->y + extents->y0 <= area->y1;
+}
+
+static gboolean
+icon_is_near_view (BaulIconContainer *container,
+                   BaulIcon *icon)
+{
+    return icon_may_intersect (container, icon,
+                               &container->details->near_view_area);
+}
+
+static void
+icon_index_clear (BaulIconContainer *container)
+{
+    g_hash_table_remove_all (container->details->icon_index);
+    container->details->icon_index_extents.x0 = 0;
+    container->details->icon_index_extents.y0 = 0;
+    container->details->icon_index_extents.x1 = 0;
+    container->details->icon_index_extents.y1 = 0;
+}
+
+static void
+start_virtualizing (BaulIconContainer *container)
+{
+    BaulIconContainerDetails *details;
+    BaulIcon *icon;
+    GList *p;
+
+    details = container->details;
+
+    details->virtualized = TRUE;
+    details->icons_with_images = g_hash_table_new (NULL, NULL);
+    for (p = details->icons; p != NULL; p = p->next)
+    {
+        icon = p->data;
+        if (!icon->needs_images)
+        {
+            g_hash_table_add (details->icons_with_images, icon);
+        }
+    }
+}
+
+static void
+stop_virtualizing (BaulIconContainer *container)
+{
+    BaulIconContainerDetails *details;
+
+    details = container->details;
+
+    details->virtualized = FALSE;
+    if (details->icons_with_images != NULL)
+    {
+        g_hash_table_destroy (details->icons_with_images);
+        details->icons_with_images = NULL;
+    }
+    details->near_view_area.x0 = 0;
+    details->near_view_area.y0 = 0;
+    details->near_view_area.x1 = 0;
+    details->near_view_area.y1 = 0;
+}
+
 /* Functions dealing with BaulIcons.  */
 
 static void
@@ -296,13 +621,52 @@ icon_free (BaulIcon *icon)
 {
     /* Destroy this canvas item; the parent will unref it. */
     eel_canvas_item_destroy (EEL_CANVAS_ITEM (icon->item));
+    g_free (icon->uri);
     g_free (icon);
 }
 
-static gboolean
-icon_is_positioned (const BaulIcon *icon)
+static void
+icon_forget_uri (BaulIconContainer *container,
+                 BaulIcon *icon)
 {
-    return icon->x != ICON_UNPOSITIONED_VALUE && icon->y != ICON_UNPOSITIONED_VALUE;
+    if (icon->uri == NULL)
+    {
+        return;
+    }
+
+    if (g_hash_table_lookup (container->details->icon_by_uri, icon->uri) == icon)
+    {
+        g_hash_table_remove (container->details->icon_by_uri, icon->uri);
+    }
+
+    g_free (icon->uri);
+    icon->uri = NULL;
+}
+
+/* Files the icon under its current URI, which changes when the file
+ * is renamed or moved.
+ */
+static void
+icon_update_uri (BaulIconContainer *container,
+                 BaulIcon *icon)
+{
+    char *uri;
+
+    uri = baul_icon_container_get_icon_uri (container, icon);
+    if (g_strcmp0 (uri, icon->uri) == 0)
+    {
+        g_free (uri);
+        return;
+    }
+
+    icon_forget_uri (container, icon);
+    icon->uri = uri;
+
+    if (uri != NULL &&
+            g_hash_table_lookup (container->details->icon_by_uri, uri) == NULL)
+    {
+        g_hash_table_insert (container->details->icon_by_uri, uri, icon);
+    }
 }
 
 
@@ -315,13 +679,14 @@ icon_set_position (BaulIcon *icon,
     int x1, x2, y1, y2;
     EelDRect icon_bounds;
 
+    container = BAUL_ICON_CONTAINER (EEL_CANVAS_ITEM (icon->item)->canvas);
+
     if (icon->x == x && icon->y == y)
     {
+        icon_index_update (container, icon);
         return;
     }
 
-    container = BAUL_ICON_CONTAINER (EEL_CANVAS_ITEM (icon->item)->canvas);
-
     if (icon == get_icon_being_renamed (container))
     {
         end_renaming_mode (container, TRUE);
@@ -401,6 +766,9 @@ icon_set_position (BaulIcon *icon,
 
     icon->x = x;
     icon->y = y;
+
+    icon_index_update (container, icon);
+    container->details->rubberband_info.icons_moved = TRUE;
 }
 
 static void
@@ -1220,6 +1588,52 @@ compare_icons (gconstpointer a, gconstpointer b, gpointer icon_container)
     return klass->compare_icons (icon_container, icon_a->data, icon_b->data);
 }
 
+static gboolean
+sort_icons_in_parallel (BaulIconContainer *container,
+                        GList            **icons)
+{
+    BaulIconContainerClass *klass;
+    gpointer *sorted;
+    BaulIcon *icon;
+    GList *p;
+    guint length, i;
+
+    klass = BAUL_ICON_CONTAINER_GET_CLASS (container);
+    if (klass->prepare_icon_for_sort == NULL)
+    {
+        return FALSE;
+    }
+
+    length = g_list_length (*icons);
+    if (length < PARALLEL_SORT_THRESHOLD)
+    {
+        return FALSE;
+    }
+
+    sorted = g_new (gpointer, length);
+    for (p = *icons, i = 0; p != NULL; p = p->next, i++)
+    {
+        icon = p->data;
+        if (!klass->prepare_icon_for_sort (container, icon->data))
+        {
+            g_free (sorted);
+            return FALSE;
+        }
+        sorted[i] = icon;
+    }
+
+    eel_sort_pointers_parallel (sorted, length, compare_icons, container);
+
+    for (p = *icons, i = 0; p != NULL; p = p->next, i++)
+    {
+        p->data = sorted[i];
+    }
+
+    g_free (sorted);
+
+    return TRUE;
+}
+
 static void
 sort_icons (BaulIconContainer *container,
             GList                **icons)
@@ -1229,7 +1643,10 @@ sort_icons (BaulIconContainer *container,
     klass = BAUL_ICON_CONTAINER_GET_CLASS (container);
     g_assert (klass->compare_icons != NULL);
 
-    *icons = g_list_sort_with_data (*icons, compare_icons, container);
+    if (!sort_icons_in_parallel (container, icons))
+    {
+        *icons = g_list_sort_with_data (*icons, compare_icons, container);
+    }
 }
 
 static void
@@ -1282,6 +1699,9 @@ lay_down_one_line (BaulIconContainer *container,
             y_offset = position->y_offset;
         }
 
+        /* In RTL each line is mirrored as it's placed, so that a
+         * layout done in slices shows right from its first lines.
+         */
         icon_set_position
         (icon,
          is_rtl ? get_mirror_x_position (container, icon, x + position->x_offset) : x + position->x_offset,
@@ -1290,6 +1710,9 @@ lay_down_one_line (BaulIconContainer *container,
 
         icon->saved_ltr_x = is_rtl ? get_mirror_x_position (container, icon, icon->x) : icon->x;
 
+        /* It may have been parked by horizontal_layout_park (). */
+        eel_canvas_item_show (EEL_CANVAS_ITEM (icon->item));
+
         x += position->width;
     }
 }
@@ -1332,77 +1755,157 @@ lay_down_one_column (BaulIconContainer *container,
     }
 }
 
-static void
-lay_down_icons_horizontal (BaulIconContainer *container,
-                           GList *icons,
-                           double start_y)
+/* State of a horizontal layout, which can be done a slice at a time. */
+struct BaulIconLayoutState
 {
-    GList *p, *line_start;
-    BaulIcon *icon;
-    double canvas_width, y;
-    EelDRect bounds;
-    EelDRect icon_bounds;
-    EelDRect text_bounds;
-    double max_height_above, max_height_below;
-    double line_width;
-    gboolean gridded_layout;
+    BaulIconContainer *container;
+    GList *icons;
+    double start_y;
+    guint n_icons;
+
+    /* Finding the widest icon and text, for labels beside icons. */
+    GList *next_to_measure;
+    double max_icon_width, max_text_width;
+
+    double canvas_width;
     double grid_width;
-    double max_text_width, max_icon_width;
-    int icon_width;
+    gboolean gridded_layout;
+
+    /* The line being filled. */
+    GList *next, *line_start;
+    guint n_placed;
+    double y;
+    double line_width;
+    double max_height_above, max_height_below;
     int i;
-    CtkAllocation allocation;
     GArray *positions;
-    IconPositions *position = NULL;
+};
+
+/* How many icons to handle between looks at the clock. */
+#define LAYOUT_CLOCK_INTERVAL 32
+
+static gboolean
+layout_deadline_passed (guint n_handled,
+                        gint64 deadline)
+{
+    return deadline != G_MAXINT64 &&
+           n_handled % LAYOUT_CLOCK_INTERVAL == 0 &&
+           g_get_monotonic_time () >= deadline;
+}
+
+static BaulIconLayoutState *
+horizontal_layout_new (BaulIconContainer *container,
+                       GList *icons,
+                       double start_y)
+{
+    BaulIconLayoutState *layout;
+    CtkAllocation allocation;
 
     g_assert (BAUL_IS_ICON_CONTAINER (container));
 
     if (icons == NULL)
     {
-        return;
+        return NULL;
     }
 
-    positions = g_array_new (FALSE, FALSE, sizeof (IconPositions));
+    layout = g_new0 (BaulIconLayoutState, 1);
+    layout->container = container;
+    layout->icons = icons;
+    layout->start_y = start_y;
+    layout->n_icons = g_list_length (icons);
+    layout->positions = g_array_new (FALSE, FALSE, sizeof (IconPositions));
+
     ctk_widget_get_allocation (CTK_WIDGET (container), &allocation);
 
     /* Lay out icons a line at a time. */
-    canvas_width = CANVAS_WIDTH(container, allocation);
-    max_icon_width = max_text_width = 0.0;
+    layout->canvas_width = CANVAS_WIDTH(container, allocation);
+    layout->max_icon_width = layout->max_text_width = 0.0;
 
     if (container->details->label_position == BAUL_ICON_LABEL_POSITION_BESIDE)
+    {
+        layout->next_to_measure = icons;
+    }
+    else
+    {
+        layout->grid_width = STANDARD_ICON_GRID_WIDTH;
+        ctk_widget_queue_resize (CTK_WIDGET (container));
+    }
+
+    layout->gridded_layout = !baul_icon_container_is_tighter_layout (container);
+
+    layout->line_width = container->details->label_position == BAUL_ICON_LABEL_POSITION_BESIDE ? ICON_PAD_LEFT : 0;
+    layout->next = icons;
+    layout->line_start = icons;
+    layout->y = start_y + CONTAINER_PAD_TOP;
+    layout->i = 0;
+
+    layout->max_height_above = 0;
+    layout->max_height_below = 0;
+
+    return layout;
+}
+
+static void
+horizontal_layout_free (BaulIconLayoutState *layout)
+{
+    g_array_free (layout->positions, TRUE);
+    g_free (layout);
+}
+
+/* Lays out icons until done or until @deadline, in monotonic time,
+ * has passed. Returns whether the layout is done.
+ */
+static gboolean
+horizontal_layout_run (BaulIconLayoutState *layout,
+                       gint64 deadline)
+{
+    BaulIconContainer *container;
+    GList *p;
+    BaulIcon *icon;
+    EelDRect bounds;
+    EelDRect icon_bounds;
+    EelDRect text_bounds;
+    int icon_width;
+    guint n_handled;
+    IconPositions *position = NULL;
+
+    container = layout->container;
+    n_handled = 0;
+
+    if (layout->next_to_measure != NULL)
     {
         /* Would it be worth caching these bounds for the next loop? */
-        for (p = icons; p != NULL; p = p->next)
+        for (p = layout->next_to_measure; p != NULL; p = p->next)
         {
+            if (layout_deadline_passed (++n_handled, deadline))
+            {
+                layout->next_to_measure = p;
+                return FALSE;
+            }
+
             icon = p->data;
 
             icon_bounds = baul_icon_canvas_item_get_icon_rectangle (icon->item);
-            max_icon_width = MAX (max_icon_width, ceil (icon_bounds.x1 - icon_bounds.x0));
+            layout->max_icon_width = MAX (layout->max_icon_width, ceil (icon_bounds.x1 - icon_bounds.x0));
 
             text_bounds = baul_icon_canvas_item_get_text_rectangle (icon->item, TRUE);
-            max_text_width = MAX (max_text_width, ceil (text_bounds.x1 - text_bounds.x0));
+            layout->max_text_width = MAX (layout->max_text_width, ceil (text_bounds.x1 - text_bounds.x0));
         }
+        layout->next_to_measure = NULL;
 
-        grid_width = max_icon_width + max_text_width + ICON_PAD_LEFT + ICON_PAD_RIGHT;
+        layout->grid_width = layout->max_icon_width + layout->max_text_width + ICON_PAD_LEFT + ICON_PAD_RIGHT;
     }
-    else
-    {
-        grid_width = STANDARD_ICON_GRID_WIDTH;
-        ctk_widget_queue_resize (CTK_WIDGET (container));
-    }
-
-    gridded_layout = !baul_icon_container_is_tighter_layout (container);
 
-    line_width = container->details->label_position == BAUL_ICON_LABEL_POSITION_BESIDE ? ICON_PAD_LEFT : 0;
-    line_start = icons;
-    y = start_y + CONTAINER_PAD_TOP;
-    i = 0;
-
-    max_height_above = 0;
-    max_height_below = 0;
-    for (p = icons; p != NULL; p = p->next)
+    for (p = layout->next; p != NULL; p = p->next)
     {
         double height_above, height_below;
 
+        if (layout_deadline_passed (++n_handled, deadline))
+        {
+            layout->next = p;
+            return FALSE;
+        }
+
         icon = p->data;
 
         /* Assume it's only one level hierarchy to avoid costly affine calculations */
@@ -1413,9 +1916,9 @@ lay_down_icons_horizontal (BaulIconContainer *container,
         icon_bounds = baul_icon_canvas_item_get_icon_rectangle (icon->item);
         text_bounds = baul_icon_canvas_item_get_text_rectangle (icon->item, TRUE);
 
-        if (gridded_layout)
+        if (layout->gridded_layout)
         {
-            icon_width = ceil ((bounds.x1 - bounds.x0)/grid_width) * grid_width;
+            icon_width = ceil ((bounds.x1 - bounds.x0)/layout->grid_width) * layout->grid_width;
 
 
         }
@@ -1429,59 +1932,60 @@ lay_down_icons_horizontal (BaulIconContainer *container,
         height_below = bounds.y1 - icon_bounds.y1;
 
         /* If this icon doesn't fit, it's time to lay out the line that's queued up. */
-        if (line_start != p && line_width + icon_width >= canvas_width )
+        if (layout->line_start != p && layout->line_width + icon_width >= layout->canvas_width )
         {
             if (container->details->label_position == BAUL_ICON_LABEL_POSITION_BESIDE)
             {
-                y += ICON_PAD_TOP;
+                layout->y += ICON_PAD_TOP;
             }
             else
             {
                 /* Advance to the baseline. */
-                y += ICON_PAD_TOP + max_height_above;
+                layout->y += ICON_PAD_TOP + layout->max_height_above;
             }
 
-            lay_down_one_line (container, line_start, p, y, max_height_above, positions, FALSE);
+            lay_down_one_line (container, layout->line_start, p, layout->y, layout->max_height_above, layout->positions, FALSE);
+            layout->n_placed += layout->i;
 
             if (container->details->label_position == BAUL_ICON_LABEL_POSITION_BESIDE)
             {
-                y += max_height_above + max_height_below + ICON_PAD_BOTTOM;
+                layout->y += layout->max_height_above + layout->max_height_below + ICON_PAD_BOTTOM;
             }
             else
             {
                 /* Advance to next line. */
-                y += max_height_below + ICON_PAD_BOTTOM;
+                layout->y += layout->max_height_below + ICON_PAD_BOTTOM;
             }
 
-            line_width = container->details->label_position == BAUL_ICON_LABEL_POSITION_BESIDE ? ICON_PAD_LEFT : 0;
-            line_start = p;
-            i = 0;
+            layout->line_width = container->details->label_position == BAUL_ICON_LABEL_POSITION_BESIDE ? ICON_PAD_LEFT : 0;
+            layout->line_start = p;
+            layout->i = 0;
 
-            max_height_above = height_above;
-            max_height_below = height_below;
+            layout->max_height_above = height_above;
+            layout->max_height_below = height_below;
         }
         else
         {
-            if (height_above > max_height_above)
+            if (height_above > layout->max_height_above)
             {
-                max_height_above = height_above;
+                layout->max_height_above = height_above;
             }
-            if (height_below > max_height_below)
+            if (height_below > layout->max_height_below)
             {
-                max_height_below = height_below;
+                layout->max_height_below = height_below;
             }
         }
 
-        g_array_set_size (positions, i + 1);
-        position = &g_array_index (positions, IconPositions, i++);
+        g_array_set_size (layout->positions, layout->i + 1);
+        position = &g_array_index (layout->positions, IconPositions, layout->i++);
         position->width = icon_width;
         position->height = icon_bounds.y1 - icon_bounds.y0;
 
         if (container->details->label_position == BAUL_ICON_LABEL_POSITION_BESIDE)
         {
-            if (gridded_layout)
+            if (layout->gridded_layout)
             {
-                position->x_offset = max_icon_width + ICON_PAD_LEFT + ICON_PAD_RIGHT - (icon_bounds.x1 - icon_bounds.x0);
+                position->x_offset = layout->max_icon_width + ICON_PAD_LEFT + ICON_PAD_RIGHT - (icon_bounds.x1 - icon_bounds.x0);
             }
             else
             {
@@ -1496,29 +2000,105 @@ lay_down_icons_horizontal (BaulIconContainer *container,
         }
 
         /* Add this icon. */
-        line_width += icon_width;
+        layout->line_width += icon_width;
     }
+    layout->next = NULL;
 
     /* Lay down that last line of icons. */
-    if (line_start != NULL)
+    if (layout->line_start != NULL)
     {
         if (container->details->label_position == BAUL_ICON_LABEL_POSITION_BESIDE)
         {
-            y += ICON_PAD_TOP;
+            layout->y += ICON_PAD_TOP;
         }
         else
         {
             /* Advance to the baseline. */
-            y += ICON_PAD_TOP + max_height_above;
+            layout->y += ICON_PAD_TOP + layout->max_height_above;
         }
 
-        lay_down_one_line (container, line_start, NULL, y, max_height_above, positions, TRUE);
+        lay_down_one_line (container, layout->line_start, NULL, layout->y, layout->max_height_above, layout->positions, TRUE);
+        layout->n_placed += layout->i;
+        layout->line_start = NULL;
 
         /* Advance to next line. */
-        y += max_height_below + ICON_PAD_BOTTOM;
+        layout->y += layout->max_height_below + ICON_PAD_BOTTOM;
     }
 
-    g_array_free (positions, TRUE);
+    return TRUE;
+}
+
+/* Hides the icons from the line being filled on, which would show at
+ * their old places across the lines laid down so far, and takes them
+ * out of the index, so they can't be picked or drawn until their line
+ * is placed.
+ */
+static void
+horizontal_layout_park (BaulIconLayoutState *layout)
+{
+    GList *p;
+    BaulIcon *icon;
+
+    for (p = layout->line_start; p != NULL; p = p->next)
+    {
+        icon = p->data;
+        eel_canvas_item_hide (EEL_CANVAS_ITEM (icon->item));
+        icon_index_remove (layout->container, icon);
+    }
+}
+
+/* Puts the icons a cancelled layout didn't get to back where they
+ * were.
+ */
+static void
+horizontal_layout_unpark (BaulIconLayoutState *layout)
+{
+    GList *p;
+    BaulIcon *icon;
+
+    for (p = layout->line_start; p != NULL; p = p->next)
+    {
+        icon = p->data;
+        eel_canvas_item_show (EEL_CANVAS_ITEM (icon->item));
+        icon_index_update (layout->container, icon);
+    }
+}
+
+/* Guesses where the layout will end, from the lines laid down so far.
+ * Returns FALSE if there is nothing to go by yet.
+ */
+static gboolean
+horizontal_layout_estimate_bottom (BaulIconLayoutState *layout,
+                                   double *bottom)
+{
+    double height;
+
+    if (layout->n_placed == 0)
+    {
+        return FALSE;
+    }
+
+    height = layout->y - layout->start_y - CONTAINER_PAD_TOP;
+    *bottom = layout->y + height / layout->n_placed * (layout->n_icons - layout->n_placed);
+
+    return TRUE;
+}
+
+static void
+lay_down_icons_horizontal (BaulIconContainer *container,
+                           GList *icons,
+                           double start_y)
+{
+    BaulIconLayoutState *layout;
+
+    layout = horizontal_layout_new (container, icons, start_y);
+    if (layout == NULL)
+    {
+        return;
+    }
+
+    horizontal_layout_run (layout, G_MAXINT64);
+    horizontal_layout_free (layout);
 }
 
 static void
@@ -2323,38 +2903,175 @@ lay_down_icons (BaulIconContainer *container, GList *icons, double start_y)
         }
         break;
 
-    default:
-        g_assert_not_reached ();
+    default:
+        g_assert_not_reached ();
+    }
+}
+
+static void
+cancel_layout_in_slices (BaulIconContainer *container)
+{
+    BaulIconContainerDetails *details;
+
+    details = container->details;
+
+    if (details->layout_idle_id != 0)
+    {
+        g_source_remove (details->layout_idle_id);
+        details->layout_idle_id = 0;
+    }
+
+    if (details->layout_state != NULL)
+    {
+        horizontal_layout_unpark (details->layout_state);
+        horizontal_layout_free (details->layout_state);
+        details->layout_state = NULL;
+    }
+}
+
+/* Starts laying out the icons. Horizontal auto layouts are only set
+ * up here, for continue_layout () to do. Returns whether the icons are
+ * laid down a line at a time, which places them mirrored in RTL.
+ */
+static gboolean
+begin_layout (BaulIconContainer *container)
+{
+    BaulIconContainerDetails *details;
+
+    details = container->details;
+
+    cancel_layout_in_slices (container);
+    finish_adding_new_icons (container);
+
+    /* Don't do any re-laying-out during stretching. Later we
+     * might add smart logic that does this and leaves room for
+     * the stretched icon, but if we do it we want it to be fast
+     * and only re-lay-out when it's really needed.
+     */
+    if (details->auto_layout
+            && details->drag_state != DRAG_STATE_STRETCH)
+    {
+        resort (container);
+
+        if (details->layout_mode == BAUL_ICON_LAYOUT_L_R_T_B ||
+                details->layout_mode == BAUL_ICON_LAYOUT_R_L_T_B)
+        {
+            details->layout_state = horizontal_layout_new (container, details->icons, 0);
+        }
+        else
+        {
+            lay_down_icons (container, details->icons, 0);
+        }
+
+        /* The desktop places its columns unmirrored. */
+        return !baul_icon_container_get_is_desktop (container);
+    }
+
+    return FALSE;
+}
+
+/* Returns whether the layout is done. */
+static gboolean
+continue_layout (BaulIconContainer *container,
+                 gint64 deadline)
+{
+    BaulIconContainerDetails *details;
+
+    details = container->details;
+
+    if (details->layout_state == NULL)
+    {
+        return TRUE;
+    }
+
+    if (!horizontal_layout_run (details->layout_state, deadline))
+    {
+        return FALSE;
+    }
+
+    horizontal_layout_free (details->layout_state);
+    details->layout_state = NULL;
+
+    return TRUE;
+}
+
+static void
+finish_layout (BaulIconContainer *container,
+               gboolean mirrored)
+{
+    if (!mirrored && baul_icon_container_is_layout_rtl (container))
+    {
+        baul_icon_container_set_rtl_positions (container);
+    }
+
+    baul_icon_container_update_scroll_region (container);
+
+    process_pending_icon_to_reveal (container);
+    process_pending_icon_to_rename (container);
+    baul_icon_container_update_visible_icons (container);
+}
+
+/* Makes room for the icons the layout hasn't got to yet, and shows
+ * the ones it has.
+ */
+static void
+show_layout_in_progress (BaulIconContainer *container)
+{
+    EelCanvas *canvas;
+    double x1, y1, x2, y2;
+    double bottom;
+
+    canvas = EEL_CANVAS (container);
+
+    if (horizontal_layout_estimate_bottom (container->details->layout_state, &bottom))
+    {
+        eel_canvas_get_scroll_region (canvas, &x1, &y1, &x2, &y2);
+        y2 = MAX (y1, bottom + ICON_PAD_BOTTOM + CONTAINER_PAD_BOTTOM - 1);
+        eel_canvas_set_scroll_region (canvas, x1, y1, x2, y2);
+    }
+
+    baul_icon_container_update_visible_icons (container);
+}
+
+static gboolean
+layout_in_slices_callback (gpointer callback_data)
+{
+    BaulIconContainer *container;
+
+    container = BAUL_ICON_CONTAINER (callback_data);
+
+    if (!continue_layout (container, g_get_monotonic_time () + LAYOUT_SLICE_USEC))
+    {
+        show_layout_in_progress (container);
+        return TRUE;
     }
+
+    container->details->layout_idle_id = 0;
+    finish_layout (container, TRUE);
+
+    return FALSE;
 }
 
+/* Lays out as much as fits in a slice right away, which covers the
+ * first lines, and does the rest in idle slices so that the view
+ * keeps drawing in between.
+ */
 static void
-redo_layout_internal (BaulIconContainer *container)
+redo_layout_in_slices (BaulIconContainer *container)
 {
-    finish_adding_new_icons (container);
+    gboolean mirrored;
 
-    /* Don't do any re-laying-out during stretching. Later we
-     * might add smart logic that does this and leaves room for
-     * the stretched icon, but if we do it we want it to be fast
-     * and only re-lay-out when it's really needed.
-     */
-    if (container->details->auto_layout
-            && container->details->drag_state != DRAG_STATE_STRETCH)
-    {
-        resort (container);
-        lay_down_icons (container, container->details->icons, 0);
-    }
+    mirrored = begin_layout (container);
 
-    if (baul_icon_container_is_layout_rtl (container))
+    if (continue_layout (container, g_get_monotonic_time () + LAYOUT_SLICE_USEC))
     {
-        baul_icon_container_set_rtl_positions (container);
+        finish_layout (container, mirrored);
+        return;
     }
 
-    baul_icon_container_update_scroll_region (container);
-
-    process_pending_icon_to_reveal (container);
-    process_pending_icon_to_rename (container);
-    baul_icon_container_update_visible_icons (container);
+    horizontal_layout_park (container->details->layout_state);
+    show_layout_in_progress (container);
+    container->details->layout_idle_id = g_idle_add (layout_in_slices_callback, container);
 }
 
 static gboolean
@@ -2363,8 +3080,9 @@ redo_layout_callback (gpointer callback_data)
     BaulIconContainer *container;
 
     container = BAUL_ICON_CONTAINER (callback_data);
-    redo_layout_internal (container);
+    /* Laying out may find that it has to be done again. */
     container->details->idle_id = 0;
+    redo_layout_in_slices (container);
 
     return FALSE;
 }
@@ -2394,7 +3112,7 @@ static void
 redo_layout (BaulIconContainer *container)
 {
     unschedule_redo_layout (container);
-    redo_layout_internal (container);
+    redo_layout_in_slices (container);
 }
 
 static void
@@ -2659,19 +3377,39 @@ baul_icon_container_move_icon (BaulIconContainer *container,
 /* Implementation of rubberband selection.  */
 static void
 rubberband_select (BaulIconContainer *container,
-		   const EelDRect    *previous_rect G_GNUC_UNUSED,
+		   const EelDRect    *previous_rect,
 		   const EelDRect    *current_rect)
 {
-    GList *p;
+    GList *p, *icons;
     gboolean selection_changed, is_in, canvas_rect_calculated;
     EelIRect canvas_rect;
+    EelDRect area;
     EelCanvas *canvas;
+    BaulIconRubberbandInfo *band_info;
     BaulIcon *icon = NULL;
 
     selection_changed = FALSE;
     canvas_rect_calculated = FALSE;
+    band_info = &container->details->rubberband_info;
 
-    for (p = container->details->icons; p != NULL; p = p->next)
+    /* Only the icons under the old or the new rectangle can change
+     * state, as long as none of them moved in between.
+     */
+    if (previous_rect != NULL && !band_info->icons_moved)
+    {
+        area.x0 = MIN (previous_rect->x0, current_rect->x0);
+        area.y0 = MIN (previous_rect->y0, current_rect->y0);
+        area.x1 = MAX (previous_rect->x1, current_rect->x1);
+        area.y1 = MAX (previous_rect->y1, current_rect->y1);
+        icons = icon_index_query (container, &area);
+    }
+    else
+    {
+        icons = g_list_copy (container->details->icons);
+    }
+    band_info->icons_moved = FALSE;
+
+    for (p = icons; p != NULL; p = p->next)
     {
         icon = p->data;
 
@@ -2701,6 +3439,8 @@ rubberband_select (BaulIconContainer *container,
                               is_in ^ icon->was_selected_before_rubberband);
     }
 
+    g_list_free (icons);
+
     if (selection_changed)
     {
         g_signal_emit (container,
@@ -2923,6 +3663,12 @@ start_rubberbanding (BaulIconContainer *container,
 	band_info->prev_x = event->x - ctk_adjustment_get_value (ctk_scrollable_get_hadjustment (CTK_SCROLLABLE (container)));
 	band_info->prev_y = event->y - ctk_adjustment_get_value (ctk_scrollable_get_vadjustment (CTK_SCROLLABLE (container)));
 
+	band_info->prev_rect.x0 = band_info->start_x;
+	band_info->prev_rect.y0 = band_info->start_y;
+	band_info->prev_rect.x1 = band_info->start_x;
+	band_info->prev_rect.y1 = band_info->start_y;
+	band_info->icons_moved = FALSE;
+
 	band_info->active = TRUE;
 
 	if (band_info->timer_id == 0) {
@@ -4362,6 +5108,8 @@ destroy (CtkWidget *object)
         container->details->idle_id = 0;
     }
 
+    cancel_layout_in_slices (container);
+
     if (container->details->stretch_idle_id != 0)
     {
         g_source_remove (container->details->stretch_idle_id);
@@ -4419,6 +5167,19 @@ finalize (GObject *object)
     g_hash_table_destroy (details->icon_set);
     details->icon_set = NULL;
 
+    g_hash_table_destroy (details->icon_by_uri);
+    details->icon_by_uri = NULL;
+
+    g_hash_table_destroy (details->icon_index);
+    details->icon_index = NULL;
+    g_list_free (details->visible_icons);
+    details->visible_icons = NULL;
+    if (details->icons_with_images != NULL)
+    {
+        g_hash_table_destroy (details->icons_with_images);
+        details->icons_with_images = NULL;
+    }
+
     g_free (details->font);
 
     if (details->a11y_item_action_queue != NULL)
@@ -4642,6 +5403,10 @@ style_updated (CtkWidget *widget)
 
     if (ctk_widget_get_realized (widget))
     {
+        /* The font options may have changed, which the shared label
+         * measurements don't account for.
+         */
+        baul_icon_canvas_item_clear_label_measurements ();
         invalidate_labels (container);
         baul_icon_container_request_update_all (container);
     }
@@ -6750,6 +7515,8 @@ baul_icon_container_init (BaulIconContainer *container)
     details = g_new0 (BaulIconContainerDetails, 1);
 
     details->icon_set = g_hash_table_new (g_direct_hash, g_direct_equal);
+    details->icon_by_uri = g_hash_table_new (g_str_hash, g_str_equal);
+    details->icon_index = icon_index_new ();
     details->layout_timestamp = UNDEFINED_TIME;
 
     details->zoom_level = BAUL_ZOOM_LEVEL_STANDARD;
@@ -7008,6 +7775,8 @@ baul_icon_container_clear (BaulIconContainer *container)
     details->layout_timestamp = UNDEFINED_TIME;
     details->store_layout_timestamps_when_finishing_new_icons = FALSE;
 
+    cancel_layout_in_slices (container);
+
     if (details->icons == NULL)
     {
         return;
@@ -7033,6 +7802,11 @@ baul_icon_container_clear (BaulIconContainer *container)
 
     g_hash_table_destroy (details->icon_set);
     details->icon_set = g_hash_table_new (g_direct_hash, g_direct_equal);
+    g_hash_table_remove_all (details->icon_by_uri);
+    icon_index_clear (container);
+    g_list_free (details->visible_icons);
+    details->visible_icons = NULL;
+    stop_virtualizing (container);
 
     baul_icon_container_update_scroll_region (container);
 }
@@ -7247,9 +8021,23 @@ icon_destroy (BaulIconContainer *container,
     item = item->next ? item->next : item->prev;
     icon_to_focus = (item != NULL) ? item->data : NULL;
 
+    /* The layout in progress walks the icon list. */
+    if (details->layout_state != NULL)
+    {
+        cancel_layout_in_slices (container);
+        schedule_redo_layout (container);
+    }
+
     details->icons = g_list_remove (details->icons, icon);
     details->new_icons = g_list_remove (details->new_icons, icon);
     g_hash_table_remove (details->icon_set, icon->data);
+    icon_forget_uri (container, icon);
+    icon_index_remove (container, icon);
+    if (details->icons_with_images != NULL)
+    {
+        g_hash_table_remove (details->icons_with_images, icon);
+    }
+    details->visible_icons = g_list_remove (details->visible_icons, icon);
 
     was_selected = icon->is_selected;
 
@@ -7419,6 +8207,119 @@ baul_icon_container_prioritize_thumbnailing (BaulIconContainer *container,
     klass->prioritize_thumbnailing (container, icon->data);
 }
 
+/* Sorts icons in reverse layout order, the order they are drawn in
+ * from the bottom up.
+ */
+static int
+compare_icons_by_reverse_layout_position (gconstpointer a,
+        gconstpointer b,
+        gpointer user_data)
+{
+    const BaulIcon *icon_a, *icon_b;
+    gboolean vertical;
+    double a_major, a_minor, b_major, b_minor;
+
+    icon_a = a;
+    icon_b = b;
+    vertical = GPOINTER_TO_INT (user_data);
+
+    a_major = vertical ? icon_a->x : icon_a->y;
+    a_minor = vertical ? icon_a->y : icon_a->x;
+    b_major = vertical ? icon_b->x : icon_b->y;
+    b_minor = vertical ? icon_b->y : icon_b->x;
+
+    if (a_major != b_major)
+    {
+        return a_major < b_major ? 1 : -1;
+    }
+    if (a_minor != b_minor)
+    {
+        return a_minor < b_minor ? 1 : -1;
+    }
+    return 0;
+}
+
+/* Gives the icons near the view their images and takes them from the
+ * icons far away, in containers big enough for that.
+ */
+static void
+update_images_near_view (BaulIconContainer *container,
+                         const EelDRect *view,
+                         gboolean vertical)
+{
+    BaulIconContainerDetails *details;
+    EelDRect near_view, far_from_view;
+    GHashTableIter iter;
+    GList *node, *icons;
+    BaulIcon *icon;
+    double page;
+    int x1, y1, x2, y2;
+    int new_x1, new_y1, new_x2, new_y2;
+    gboolean layout_changed;
+
+    details = container->details;
+
+    near_view = *view;
+    far_from_view = *view;
+    if (vertical)
+    {
+        page = view->x1 - view->x0;
+        near_view.x0 -= NEAR_VIEW_PAGES * page;
+        near_view.x1 += NEAR_VIEW_PAGES * page;
+        far_from_view.x0 -= FAR_FROM_VIEW_PAGES * page;
+        far_from_view.x1 += FAR_FROM_VIEW_PAGES * page;
+    }
+    else
+    {
+        page = view->y1 - view->y0;
+        near_view.y0 -= NEAR_VIEW_PAGES * page;
+        near_view.y1 += NEAR_VIEW_PAGES * page;
+        far_from_view.y0 -= FAR_FROM_VIEW_PAGES * page;
+        far_from_view.y1 += FAR_FROM_VIEW_PAGES * page;
+    }
+    details->near_view_area = near_view;
+
+    g_hash_table_iter_init (&iter, details->icons_with_images);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &icon, NULL))
+    {
+        if (!icon_may_intersect (container, icon, &far_from_view))
+        {
+            baul_icon_canvas_item_release_image (icon->item);
+            icon->needs_images = TRUE;
+            g_hash_table_iter_remove (&iter);
+        }
+    }
+
+    layout_changed = FALSE;
+    icons = icon_index_query (container, &near_view);
+    for (node = icons; node != NULL; node = node->next)
+    {
+        icon = node->data;
+
+        if (!icon->needs_images || !icon_is_near_view (container, icon))
+        {
+            continue;
+        }
+
+        icon_get_bounding_box (icon, &x1, &y1, &x2, &y2,
+                               BOUNDS_USAGE_FOR_LAYOUT);
+        baul_icon_container_update_icon (container, icon);
+        icon_get_bounding_box (icon, &new_x1, &new_y1, &new_x2, &new_y2,
+                               BOUNDS_USAGE_FOR_LAYOUT);
+
+        layout_changed |= new_x2 - new_x1 != x2 - x1 || new_y2 - new_y1 != y2 - y1;
+    }
+    g_list_free (icons);
+
+    /* The images may not have the size of the blank space left for
+     * them.
+     */
+    if (layout_changed && details->auto_layout)
+    {
+        schedule_redo_layout (container);
+    }
+}
+
 static void
 baul_icon_container_update_visible_icons (BaulIconContainer *container)
 {
@@ -7426,9 +8327,10 @@ baul_icon_container_update_visible_icons (BaulIconContainer *container)
     double min_y, max_y;
     double min_x, max_x;
     double x0, y0, x1, y1;
-    GList *node;
-    gboolean visible;
+    GList *node, *candidates, *visible_icons;
+    gboolean visible, vertical;
     CtkAllocation allocation;
+    EelDRect area;
     BaulIcon *icon = NULL;
 
     hadj = ctk_scrollable_get_hadjustment (CTK_SCROLLABLE (container));
@@ -7446,48 +8348,102 @@ baul_icon_container_update_visible_icons (BaulIconContainer *container)
     eel_canvas_c2w (EEL_CANVAS (container),
                     max_x, max_y, &max_x, &max_y);
 
-    /* Do the iteration in reverse to get the render-order from top to
-     * bottom for the prioritized thumbnails.
-     */
-    for (node = g_list_last (container->details->icons); node != NULL; node = node->prev)
+    vertical = baul_icon_container_is_layout_vertical (container);
+
+    /* Visibility only looks at the direction the layout scrolls in. */
+    if (vertical)
+    {
+        area.x0 = min_x;
+        area.x1 = max_x;
+        area.y0 = -G_MAXDOUBLE;
+        area.y1 = G_MAXDOUBLE;
+    }
+    else
+    {
+        area.x0 = -G_MAXDOUBLE;
+        area.x1 = G_MAXDOUBLE;
+        area.y0 = min_y;
+        area.y1 = max_y;
+    }
+
+    visible_icons = NULL;
+    candidates = icon_index_query (container, &area);
+    for (node = candidates; node != NULL; node = node->next)
     {
         icon = node->data;
 
-        if (icon_is_positioned (icon))
+        eel_canvas_item_get_bounds (EEL_CANVAS_ITEM (icon->item),
+                                    &x0,
+                                    &y0,
+                                    &x1,
+                                    &y1);
+        eel_canvas_item_i2w (EEL_CANVAS_ITEM (icon->item)->parent,
+                             &x0,
+                             &y0);
+        eel_canvas_item_i2w (EEL_CANVAS_ITEM (icon->item)->parent,
+                             &x1,
+                             &y1);
+
+        if (vertical)
         {
-            eel_canvas_item_get_bounds (EEL_CANVAS_ITEM (icon->item),
-                                        &x0,
-                                        &y0,
-                                        &x1,
-                                        &y1);
-            eel_canvas_item_i2w (EEL_CANVAS_ITEM (icon->item)->parent,
-                                 &x0,
-                                 &y0);
-            eel_canvas_item_i2w (EEL_CANVAS_ITEM (icon->item)->parent,
-                                 &x1,
-                                 &y1);
+            visible = x1 >= min_x && x0 <= max_x;
+        }
+        else
+        {
+            visible = y1 >= min_y && y0 <= max_y;
+        }
 
-            if (baul_icon_container_is_layout_vertical (container))
-            {
-                visible = x1 >= min_x && x0 <= max_x;
-            }
-            else
-            {
-                visible = y1 >= min_y && y0 <= max_y;
-            }
+        if (visible)
+        {
+            visible_icons = g_list_prepend (visible_icons, icon);
+        }
+    }
+    g_list_free (candidates);
 
-            if (visible)
-            {
-                baul_icon_canvas_item_set_is_visible (icon->item, TRUE);
-                baul_icon_container_prioritize_thumbnailing (container,
-                        icon);
-            }
-            else
-            {
-                baul_icon_canvas_item_set_is_visible (icon->item, FALSE);
-            }
+    /* Only the icons that were visible before can have to be hidden. */
+    for (node = container->details->visible_icons; node != NULL; node = node->next)
+    {
+        icon = node->data;
+        icon->is_visible = FALSE;
+    }
+    for (node = visible_icons; node != NULL; node = node->next)
+    {
+        icon = node->data;
+        icon->is_visible = TRUE;
+    }
+    for (node = container->details->visible_icons; node != NULL; node = node->next)
+    {
+        icon = node->data;
+        if (!icon->is_visible)
+        {
+            baul_icon_canvas_item_set_is_visible (icon->item, FALSE);
         }
     }
+    g_list_free (container->details->visible_icons);
+
+    /* Go from the bottom to the top to get the render-order from top
+     * to bottom for the prioritized thumbnails.
+     */
+    visible_icons = g_list_sort_with_data (visible_icons,
+                                           compare_icons_by_reverse_layout_position,
+                                           GINT_TO_POINTER (vertical));
+    for (node = visible_icons; node != NULL; node = node->next)
+    {
+        icon = node->data;
+        baul_icon_canvas_item_set_is_visible (icon->item, TRUE);
+        baul_icon_container_prioritize_thumbnailing (container, icon);
+    }
+
+    container->details->visible_icons = visible_icons;
+
+    if (container->details->virtualized)
+    {
+        area.x0 = min_x;
+        area.y0 = min_y;
+        area.x1 = max_x;
+        area.y1 = max_y;
+        update_images_near_view (container, &area, vertical);
+    }
 }
 
 static void
@@ -7511,6 +8467,40 @@ handle_hadjustment_changed (CtkAdjustment     *adjustment G_GNUC_UNUSED,
 }
 
 
+static void
+icon_update_label (BaulIconContainer *container,
+                   BaulIcon *icon)
+{
+    char *editable_text, *additional_text;
+
+    baul_icon_container_get_icon_text (container,
+                                       icon->data,
+                                       &editable_text,
+                                       &additional_text,
+                                       FALSE);
+
+    /* If name of icon being renamed was changed from elsewhere, end renaming mode.
+     * Alternatively, we could replace the characters in the editable text widget
+     * with the new name, but that could cause timing problems if the user just
+     * happened to be typing at that moment.
+     */
+    if (icon == get_icon_being_renamed (container) &&
+            g_strcmp0 (editable_text,
+                        baul_icon_canvas_item_get_editable_text (icon->item)) != 0)
+    {
+        end_renaming_mode (container, FALSE);
+    }
+
+    eel_canvas_item_set (EEL_CANVAS_ITEM (icon->item),
+                         "editable_text", editable_text,
+                         "additional_text", additional_text,
+                         "highlighted_for_drop", icon == container->details->drop_target,
+                         NULL);
+
+    g_free (editable_text);
+    g_free (additional_text);
+}
+
 void
 baul_icon_container_update_icon (BaulIconContainer *container,
                                  BaulIcon *icon)
@@ -7523,12 +8513,12 @@ baul_icon_container_update_icon (BaulIconContainer *container,
     int n_attach_points;
     GdkPixbuf *pixbuf;
     GList *emblem_pixbufs;
-    char *editable_text, *additional_text;
     char *embedded_text;
     CdkRectangle embedded_text_rect;
     gboolean large_embedded_text;
     gboolean embedded_text_needs_loading;
     gboolean has_open_window;
+    int scale;
 
     if (icon == NULL)
     {
@@ -7537,6 +8527,8 @@ baul_icon_container_update_icon (BaulIconContainer *container,
 
     details = container->details;
 
+    icon_update_uri (container, icon);
+
     /* compute the maximum size based on the scale factor */
     min_image_size = MINIMUM_IMAGE_SIZE * EEL_CANVAS (container)->pixels_per_unit;
     max_image_size = MAX (MAXIMUM_IMAGE_SIZE * EEL_CANVAS (container)->pixels_per_unit, BAUL_ICON_MAXIMUM_SIZE);
@@ -7555,6 +8547,27 @@ baul_icon_container_update_icon (BaulIconContainer *container,
     icon_size = MAX (icon_size, min_image_size);
     icon_size = MIN (icon_size, max_image_size);
 
+    /* In big containers, icons far from view only get their label and
+     * a blank space for the image until they are scrolled near.
+     */
+    if (details->virtualized && !icon_is_near_view (container, icon))
+    {
+        icon_update_label (container, icon);
+
+        scale = ctk_widget_get_scale_factor (CTK_WIDGET (container));
+        baul_icon_canvas_item_set_image_placeholder (icon->item,
+                icon_size * scale,
+                icon_size * scale);
+        baul_icon_canvas_item_set_emblems (icon->item, NULL);
+        baul_icon_canvas_item_set_embedded_text (icon->item, NULL);
+
+        icon->needs_images = TRUE;
+        g_hash_table_remove (details->icons_with_images, icon);
+
+        icon_index_widen_extents (container, icon);
+        return;
+    }
+
     /* Get the icons. */
     emblem_pixbufs = NULL;
     embedded_text = NULL;
@@ -7573,29 +8586,7 @@ baul_icon_container_update_icon (BaulIconContainer *container,
         pixbuf = baul_icon_info_get_pixbuf (icon_info);
     baul_icon_info_get_attach_points (icon_info, &attach_points, &n_attach_points);
 
-    baul_icon_container_get_icon_text (container,
-                                       icon->data,
-                                       &editable_text,
-                                       &additional_text,
-                                       FALSE);
-
-    /* If name of icon being renamed was changed from elsewhere, end renaming mode.
-     * Alternatively, we could replace the characters in the editable text widget
-     * with the new name, but that could cause timing problems if the user just
-     * happened to be typing at that moment.
-     */
-    if (icon == get_icon_being_renamed (container) &&
-            g_strcmp0 (editable_text,
-                        baul_icon_canvas_item_get_editable_text (icon->item)) != 0)
-    {
-        end_renaming_mode (container, FALSE);
-    }
-
-    eel_canvas_item_set (EEL_CANVAS_ITEM (icon->item),
-                         "editable_text", editable_text,
-                         "additional_text", additional_text,
-                         "highlighted_for_drop", icon == details->drop_target,
-                         NULL);
+    icon_update_label (container, icon);
 
     baul_icon_canvas_item_set_image (icon->item, pixbuf);
     baul_icon_canvas_item_set_attach_points (icon->item, attach_points, n_attach_points);
@@ -7607,10 +8598,15 @@ baul_icon_container_update_icon (BaulIconContainer *container,
     g_object_unref (pixbuf);
     g_list_free_full (emblem_pixbufs, g_object_unref);
 
-    g_free (editable_text);
-    g_free (additional_text);
-
     g_object_unref (icon_info);
+
+    icon->needs_images = FALSE;
+    if (details->virtualized)
+    {
+        g_hash_table_add (details->icons_with_images, icon);
+    }
+
+    icon_index_widen_extents (container, icon);
 }
 
 static gboolean
@@ -7851,6 +8847,13 @@ baul_icon_container_add (BaulIconContainer *container,
     details->new_icons = g_list_prepend (details->new_icons, icon);
 
     g_hash_table_insert (details->icon_set, data, icon);
+    icon_update_uri (container, icon);
+
+    if (!details->virtualized &&
+            g_hash_table_size (details->icon_set) > VIRTUALIZE_THRESHOLD)
+    {
+        start_virtualizing (container);
+    }
 
     /* Run an idle function to add the icons. */
     schedule_redo_layout (container);
@@ -7861,10 +8864,24 @@ baul_icon_container_add (BaulIconContainer *container,
 void
 baul_icon_container_layout_now (BaulIconContainer *container)
 {
+    gboolean mirrored;
+
     if (container->details->idle_id != 0)
     {
         unschedule_redo_layout (container);
-        redo_layout_internal (container);
+        mirrored = begin_layout (container);
+        continue_layout (container, G_MAXINT64);
+        finish_layout (container, mirrored);
+    }
+    else if (container->details->layout_state != NULL)
+    {
+        /* Callers want the final positions, so finish the rest of a
+         * layout that's being done in slices.
+         */
+        g_source_remove (container->details->layout_idle_id);
+        container->details->layout_idle_id = 0;
+        continue_layout (container, G_MAXINT64);
+        finish_layout (container, TRUE);
     }
 
     /* Also need to make sure we're properly resized, for instance
@@ -8290,36 +9307,7 @@ BaulIcon *
 baul_icon_container_get_icon_by_uri (BaulIconContainer *container,
                                      const char *uri)
 {
-    BaulIconContainerDetails *details;
-    GList *p;
-
-    /* Eventually, we must avoid searching the entire icon list,
-       but it's OK for now.
-       A hash table mapping uri to icon is one possibility.
-    */
-
-    details = container->details;
-
-    for (p = details->icons; p != NULL; p = p->next)
-    {
-        BaulIcon *icon;
-        char *icon_uri;
-        gboolean is_match;
-
-        icon = p->data;
-
-        icon_uri = baul_icon_container_get_icon_uri
-                   (container, icon);
-        is_match = strcmp (uri, icon_uri) == 0;
-        g_free (icon_uri);
-
-        if (is_match)
-        {
-            return icon;
-        }
-    }
-
-    return NULL;
+    return g_hash_table_lookup (container->details->icon_by_uri, uri);
 }
 
 static BaulIcon *
@@ -166,6 +166,11 @@ typedef struct
     int          (* compare_icons_by_name)    (BaulIconContainer *container,
             BaulIconData *icon_a,
             BaulIconData *icon_b);
+    /* Optional. Returns TRUE if compare_icons () may then be called
+     * for @data from other threads while the container sorts.
+     */
+    gboolean     (* prepare_icon_for_sort)    (BaulIconContainer *container,
+            BaulIconData *data);
     void         (* freeze_updates)           (BaulIconContainer *container);
     void         (* unfreeze_updates)         (BaulIconContainer *container);
     void         (* start_monitor_top_left)   (BaulIconContainer *container,
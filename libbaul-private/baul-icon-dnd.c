@@ -564,10 +564,11 @@ static BaulIcon *
 baul_icon_container_item_at (BaulIconContainer *container,
                              int x, int y)
 {
-    GList *p;
+    GList *p, *icons;
     int size;
     EelDRect point;
     EelIRect canvas_point;
+    BaulIcon *hit_icon;
 
     /* build the hit-test rectangle. Base the size on the scale factor to ensure that it is
      * non-empty even at the smallest scale factor
@@ -579,28 +580,33 @@ baul_icon_container_item_at (BaulIconContainer *container,
     point.x1 = x + size;
     point.y1 = y + size;
 
-    for (p = container->details->icons; p != NULL; p = p->next)
+    eel_canvas_w2c (EEL_CANVAS (container),
+                    point.x0,
+                    point.y0,
+                    &canvas_point.x0,
+                    &canvas_point.y0);
+    eel_canvas_w2c (EEL_CANVAS (container),
+                    point.x1,
+                    point.y1,
+                    &canvas_point.x1,
+                    &canvas_point.y1);
+
+    hit_icon = NULL;
+    icons = baul_icon_container_get_icons_in_area (container, &point);
+    for (p = icons; p != NULL; p = p->next)
     {
         BaulIcon *icon;
         icon = p->data;
 
-        eel_canvas_w2c (EEL_CANVAS (container),
-                        point.x0,
-                        point.y0,
-                        &canvas_point.x0,
-                        &canvas_point.y0);
-        eel_canvas_w2c (EEL_CANVAS (container),
-                        point.x1,
-                        point.y1,
-                        &canvas_point.x1,
-                        &canvas_point.y1);
         if (baul_icon_canvas_item_hit_test_rectangle (icon->item, canvas_point))
         {
-            return icon;
+            hit_icon = icon;
+            break;
         }
     }
+    g_list_free (icons);
 
-    return NULL;
+    return hit_icon;
 }
 
 static char *
@@ -41,6 +41,9 @@ typedef struct
     /* Canvas item for the icon. */
     BaulIconCanvasItem *item;
 
+    /* URI of the icon data, as last asked for. */
+    char *uri;
+
     /* X/Y coordinates. */
     double x, y;
 
@@ -55,6 +58,9 @@ typedef struct
     /* Scale factor (stretches icon). */
     double scale;
 
+    /* Grid cell of the container's icon index the icon is filed in. */
+    int index_cell_x, index_cell_y;
+
     /* Whether this item is selected. */
     eel_boolean_bit is_selected : 1;
 
@@ -65,6 +71,12 @@ typedef struct
     eel_boolean_bit is_visible : 1;
 
     eel_boolean_bit has_lazy_position : 1;
+
+    /* Whether the icon is filed in the container's icon index. */
+    eel_boolean_bit is_indexed : 1;
+
+    /* Whether the images were left out because the icon was far from view. */
+    eel_boolean_bit needs_images : 1;
 } BaulIcon;
 
 
@@ -82,6 +94,11 @@ typedef struct
 
     guint prev_x, prev_y;
     EelDRect prev_rect;
+
+    /* Whether any icon moved since the last update of the selection,
+     * so the icons outside the rectangles have to be checked too.
+     */
+    gboolean icons_moved;
     int last_adj_x;
     int last_adj_y;
 } BaulIconRubberbandInfo;
@@ -122,6 +139,8 @@ enum
     LAST_LABEL_COLOR
 };
 
+typedef struct BaulIconLayoutState BaulIconLayoutState;
+
 struct BaulIconContainerDetails
 {
     /* List of icons. */
@@ -129,6 +148,27 @@ struct BaulIconContainerDetails
     GList *new_icons;
     GHashTable *icon_set;
 
+    /* Icons by URI, for baul_icon_container_get_icon_by_uri (). */
+    GHashTable *icon_by_uri;
+
+    /* Positioned icons by grid cell, so finding the icons in an area
+     * doesn't have to walk all of them. The extents tell how far any
+     * icon reaches from its position.
+     */
+    GHashTable *icon_index;
+    EelDRect icon_index_extents;
+
+    /* Icons last marked as visible. */
+    GList *visible_icons;
+
+    /* Whether there are enough icons to only keep the images of
+     * those near the visible area, which is near_view_area. The
+     * set has the icons that have their images.
+     */
+    gboolean virtualized;
+    GHashTable *icons_with_images;
+    EelDRect near_view_area;
+
     /* Current icon for keyboard navigation. */
     BaulIcon *keyboard_focus;
     BaulIcon *keyboard_rubberband_start;
@@ -190,6 +230,10 @@ struct BaulIconContainerDetails
     /* Idle ID. */
     guint idle_id;
 
+    /* Layout being done a slice at a time, and the idle doing it. */
+    BaulIconLayoutState *layout_state;
+    guint layout_idle_id;
+
     /* Idle handler for stretch code */
     guint stretch_idle_id;
 
@@ -312,6 +356,8 @@ gboolean      baul_icon_container_scroll                      (BaulIconContainer
         int                    delta_x,
         int                    delta_y);
 void          baul_icon_container_update_scroll_region        (BaulIconContainer *container);
+GList *      baul_icon_container_get_icons_in_area           (BaulIconContainer *container,
+        const EelDRect        *area);
 
 
 
@@ -0,0 +1,304 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * Copyright (C) 2026 CAFE Desktop.
+ *
+ * Baul is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Baul is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <config.h>
+#include <glib.h>
+
+#include <eel/eel-ctk-macros.h>
+
+#include "baul-search-engine-index.h"
+#include "baul-search-engine-simple.h"
+#include "baul-filename-index.h"
+
+struct BaulSearchEngineIndexDetails
+{
+    BaulQuery *query;
+
+    BaulFilenameIndexSearch *search;
+    guint search_idle_id;
+
+    /* Used for the queries the index can't answer. */
+    BaulSearchEngine *fallback;
+    gboolean fallback_active;
+};
+
+G_DEFINE_TYPE (BaulSearchEngineIndex,
+               baul_search_engine_index,
+               BAUL_TYPE_SEARCH_ENGINE);
+
+static BaulSearchEngineClass *parent_class = NULL;
+
+static void
+stop_search (BaulSearchEngineIndex *index_engine)
+{
+    if (index_engine->details->search_idle_id != 0)
+    {
+        g_source_remove (index_engine->details->search_idle_id);
+        index_engine->details->search_idle_id = 0;
+    }
+
+    if (index_engine->details->search != NULL)
+    {
+        baul_filename_index_search_free (index_engine->details->search);
+        index_engine->details->search = NULL;
+    }
+}
+
+static void
+finalize (GObject *object)
+{
+    BaulSearchEngineIndex *index_engine;
+
+    index_engine = BAUL_SEARCH_ENGINE_INDEX (object);
+
+    stop_search (index_engine);
+
+    if (index_engine->details->fallback)
+    {
+        g_signal_handlers_disconnect_by_data (index_engine->details->fallback, index_engine);
+        g_object_unref (index_engine->details->fallback);
+        index_engine->details->fallback = NULL;
+    }
+
+    if (index_engine->details->query)
+    {
+        g_object_unref (index_engine->details->query);
+        index_engine->details->query = NULL;
+    }
+
+    g_free (index_engine->details);
+
+    EEL_CALL_PARENT (G_OBJECT_CLASS, finalize, (object));
+}
+
+static gboolean
+search_idle (gpointer user_data)
+{
+    BaulSearchEngineIndex *index_engine;
+    BaulFilenameIndexSearch *search;
+    GList *hits;
+    gboolean more;
+
+    index_engine = user_data;
+    search = index_engine->details->search;
+
+    hits = NULL;
+    more = baul_filename_index_search_step (search, &hits);
+
+    if (hits != NULL)
+    {
+        baul_search_engine_hits_added (BAUL_SEARCH_ENGINE (index_engine), hits);
+        g_list_free_full (hits, g_free);
+
+        /* Someone may have stopped the search when seeing the hits. */
+        if (index_engine->details->search != search)
+        {
+            return FALSE;
+        }
+    }
+
+    if (more)
+    {
+        return TRUE;
+    }
+
+    index_engine->details->search_idle_id = 0;
+    baul_filename_index_search_free (index_engine->details->search);
+    index_engine->details->search = NULL;
+
+    baul_search_engine_finished (BAUL_SEARCH_ENGINE (index_engine));
+
+    return FALSE;
+}
+
+static void
+fallback_hits_added (BaulSearchEngine      *fallback G_GNUC_UNUSED,
+                     GList                 *hits,
+                     BaulSearchEngineIndex *index_engine)
+{
+    baul_search_engine_hits_added (BAUL_SEARCH_ENGINE (index_engine), hits);
+}
+
+static void
+fallback_hits_subtracted (BaulSearchEngine      *fallback G_GNUC_UNUSED,
+                          GList                 *hits,
+                          BaulSearchEngineIndex *index_engine)
+{
+    baul_search_engine_hits_subtracted (BAUL_SEARCH_ENGINE (index_engine), hits);
+}
+
+static void
+fallback_finished (BaulSearchEngine      *fallback G_GNUC_UNUSED,
+                   BaulSearchEngineIndex *index_engine)
+{
+    index_engine->details->fallback_active = FALSE;
+    baul_search_engine_finished (BAUL_SEARCH_ENGINE (index_engine));
+}
+
+static void
+fallback_error (BaulSearchEngine      *fallback G_GNUC_UNUSED,
+                const char            *error_message,
+                BaulSearchEngineIndex *index_engine)
+{
+    index_engine->details->fallback_active = FALSE;
+    baul_search_engine_error (BAUL_SEARCH_ENGINE (index_engine), error_message);
+}
+
+static void
+start_fallback (BaulSearchEngineIndex *index_engine)
+{
+    BaulSearchEngine *fallback;
+
+    if (index_engine->details->fallback == NULL)
+    {
+        fallback = baul_search_engine_simple_new ();
+        g_signal_connect (fallback, "hits-added",
+                          G_CALLBACK (fallback_hits_added), index_engine);
+        g_signal_connect (fallback, "hits-subtracted",
+                          G_CALLBACK (fallback_hits_subtracted), index_engine);
+        g_signal_connect (fallback, "finished",
+                          G_CALLBACK (fallback_finished), index_engine);
+        g_signal_connect (fallback, "error",
+                          G_CALLBACK (fallback_error), index_engine);
+        index_engine->details->fallback = fallback;
+    }
+
+    index_engine->details->fallback_active = TRUE;
+    baul_search_engine_set_query (index_engine->details->fallback,
+                                  index_engine->details->query);
+    baul_search_engine_start (index_engine->details->fallback);
+}
+
+static void
+baul_search_engine_index_start (BaulSearchEngine *engine)
+{
+    BaulSearchEngineIndex *index_engine;
+
+    index_engine = BAUL_SEARCH_ENGINE_INDEX (engine);
+
+    if (index_engine->details->search != NULL ||
+        index_engine->details->fallback_active)
+    {
+        return;
+    }
+
+    if (index_engine->details->query == NULL)
+    {
+        return;
+    }
+
+    index_engine->details->search =
+        baul_filename_index_search_new (index_engine->details->query);
+    if (index_engine->details->search == NULL)
+    {
+        start_fallback (index_engine);
+        return;
+    }
+
+    index_engine->details->search_idle_id = g_idle_add (search_idle, index_engine);
+}
+
+static void
+baul_search_engine_index_stop (BaulSearchEngine *engine)
+{
+    BaulSearchEngineIndex *index_engine;
+
+    index_engine = BAUL_SEARCH_ENGINE_INDEX (engine);
+
+    stop_search (index_engine);
+
+    if (index_engine->details->fallback_active)
+    {
+        baul_search_engine_stop (index_engine->details->fallback);
+        index_engine->details->fallback_active = FALSE;
+    }
+}
+
+static gboolean
+baul_search_engine_index_is_indexed (BaulSearchEngine *engine)
+{
+    BaulSearchEngineIndex *index_engine;
+
+    index_engine = BAUL_SEARCH_ENGINE_INDEX (engine);
+
+    /* Otherwise searches go to the fallback, which crawls. */
+    return baul_filename_index_can_search (index_engine->details->query);
+}
+
+static void
+baul_search_engine_index_set_query (BaulSearchEngine *engine, BaulQuery *query)
+{
+    BaulSearchEngineIndex *index_engine;
+
+    index_engine = BAUL_SEARCH_ENGINE_INDEX (engine);
+
+    if (query)
+    {
+        g_object_ref (query);
+    }
+
+    if (index_engine->details->query)
+    {
+        g_object_unref (index_engine->details->query);
+    }
+
+    index_engine->details->query = query;
+}
+
+static void
+baul_search_engine_index_class_init (BaulSearchEngineIndexClass *class)
+{
+    GObjectClass *gobject_class;
+    BaulSearchEngineClass *engine_class;
+
+    parent_class = g_type_class_peek_parent (class);
+
+    gobject_class = G_OBJECT_CLASS (class);
+    gobject_class->finalize = finalize;
+
+    engine_class = BAUL_SEARCH_ENGINE_CLASS (class);
+    engine_class->set_query = baul_search_engine_index_set_query;
+    engine_class->start = baul_search_engine_index_start;
+    engine_class->stop = baul_search_engine_index_stop;
+    engine_class->is_indexed = baul_search_engine_index_is_indexed;
+}
+
+static void
+baul_search_engine_index_init (BaulSearchEngineIndex *engine)
+{
+    engine->details = g_new0 (BaulSearchEngineIndexDetails, 1);
+}
+
+
+BaulSearchEngine *
+baul_search_engine_index_new (void)
+{
+    BaulSearchEngine *engine;
+
+    if (!baul_filename_index_is_enabled ())
+    {
+        return NULL;
+    }
+
+    engine = g_object_new (BAUL_TYPE_SEARCH_ENGINE_INDEX, NULL);
+
+    return engine;
+}
@@ -0,0 +1,51 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * Copyright (C) 2026 CAFE Desktop.
+ *
+ * Baul is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Baul is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef BAUL_SEARCH_ENGINE_INDEX_H
+#define BAUL_SEARCH_ENGINE_INDEX_H
+
+#include "baul-search-engine.h"
+
+#define BAUL_TYPE_SEARCH_ENGINE_INDEX		(baul_search_engine_index_get_type ())
+#define BAUL_SEARCH_ENGINE_INDEX(obj)		(G_TYPE_CHECK_INSTANCE_CAST ((obj), BAUL_TYPE_SEARCH_ENGINE_INDEX, BaulSearchEngineIndex))
+#define BAUL_SEARCH_ENGINE_INDEX_CLASS(klass)	(G_TYPE_CHECK_CLASS_CAST ((klass), BAUL_TYPE_SEARCH_ENGINE_INDEX, BaulSearchEngineIndexClass))
+#define BAUL_IS_SEARCH_ENGINE_INDEX(obj)		(G_TYPE_CHECK_INSTANCE_TYPE ((obj), BAUL_TYPE_SEARCH_ENGINE_INDEX))
+#define BAUL_IS_SEARCH_ENGINE_INDEX_CLASS(klass)	(G_TYPE_CHECK_CLASS_TYPE ((klass), BAUL_TYPE_SEARCH_ENGINE_INDEX))
+#define BAUL_SEARCH_ENGINE_INDEX_GET_CLASS(obj)    (G_TYPE_INSTANCE_GET_CLASS ((obj), BAUL_TYPE_SEARCH_ENGINE_INDEX, BaulSearchEngineIndexClass))
+
+typedef struct BaulSearchEngineIndexDetails BaulSearchEngineIndexDetails;
+
+typedef struct BaulSearchEngineIndex
+{
+    BaulSearchEngine parent;
+    BaulSearchEngineIndexDetails *details;
+} BaulSearchEngineIndex;
+
+typedef struct
+{
+    BaulSearchEngineClass parent_class;
+} BaulSearchEngineIndexClass;
+
+GType          baul_search_engine_index_get_type  (void);
+
+BaulSearchEngine* baul_search_engine_index_new       (void);
+
+#endif /* BAUL_SEARCH_ENGINE_INDEX_H */
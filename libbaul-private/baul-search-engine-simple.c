@@ -30,30 +30,56 @@
 #include <eel/eel-ctk-macros.h>
 
 #include "baul-search-engine-simple.h"
+#include "baul-global-preferences.h"
 
 #define BATCH_SIZE 500
 
+/* File contents are searched in chunks of this size. */
+#define CONTENTS_CHUNK_SIZE 65536
+
+/* Upper bound for the number of threads crawling at the same time. */
+#define MAX_SEARCH_THREADS 16
+
 typedef struct
 {
     BaulSearchEngineSimple *engine;
     GCancellable *cancellable;
 
     char *contained_text;
+    char *lower_contained_text;
+    guint64 contents_size_limit;
+    gboolean odt2txt_available;
     GList *mime_types;
     GList *tags;
     char **words;
     GList *found_list;
 
-    GQueue *directories; /* GFiles */
+    /* Lowercasing ASCII names by hand gives the same result as
+     * g_utf8_strdown (), except in Turkic locales.
+     */
+    gboolean ascii_lowercase;
 
+    /* Shared by the search threads, protected by mutex. */
+    GMutex mutex;
+    GCond cond;
+    GQueue *directories; /* GFiles */
     GHashTable *visited;
+    int running_threads;
+    int busy_threads;
 
-    gint n_processed_files;
-    GList *uri_hits;
     gint64 timestamp;
     gint64 size;
 } SearchThreadData;
 
+/* State private to one search thread. */
+typedef struct
+{
+    SearchThreadData *data;
+    gint n_processed_files;
+    GList *uri_hits;
+    GString *name_buffer;
+} SearchThread;
+
 
 struct BaulSearchEngineSimpleDetails
 {
@@ -88,6 +114,19 @@ finalize (GObject *object)
     EEL_CALL_PARENT (G_OBJECT_CLASS, finalize, (object));
 }
 
+static inline gchar *
+utf8_normalize_strdown (const char *str) {
+    gchar* lower = NULL;
+    gchar *normalized = g_utf8_normalize (str, -1, G_NORMALIZE_DEFAULT);
+
+    if (normalized)
+        lower = g_utf8_strdown (normalized, -1);
+
+    g_free (normalized);
+
+    return lower;
+}
+
 static SearchThreadData *
 search_thread_data_new (BaulSearchEngineSimple *engine,
                         BaulQuery *query)
@@ -122,11 +161,25 @@ search_thread_data_new (BaulSearchEngineSimple *engine,
     g_free (lower);
     g_free (normalized);
 
+    lower = g_utf8_strdown ("I", -1);
+    data->ascii_lowercase = strcmp (lower, "i") == 0;
+    g_free (lower);
+
+    g_mutex_init (&data->mutex);
+    g_cond_init (&data->cond);
+
     data->tags = baul_query_get_tags (query);
     data->mime_types = baul_query_get_mime_types (query);
     data->timestamp = baul_query_get_timestamp (query);
     data->size = baul_query_get_size (query);
     data->contained_text = baul_query_get_contained_text (query);
+    if (data->contained_text != NULL)
+    {
+        data->lower_contained_text = utf8_normalize_strdown (data->contained_text);
+        data->contents_size_limit =
+            g_settings_get_uint64 (baul_preferences,
+                                   BAUL_PREFERENCES_SEARCH_TEXT_SIZE_LIMIT);
+    }
 
     data->cancellable = g_cancellable_new ();
 
@@ -144,8 +197,10 @@ search_thread_data_free (SearchThreadData *data)
     g_strfreev (data->words);
     g_list_free_full (data->tags, g_free);
     g_list_free_full (data->mime_types, g_free);
-    g_list_free_full (data->uri_hits, g_free);
     g_free (data->contained_text);
+    g_free (data->lower_contained_text);
+    g_mutex_clear (&data->mutex);
+    g_cond_clear (&data->cond);
     g_free (data);
 }
 
@@ -194,20 +249,20 @@ search_thread_add_hits_idle (gpointer user_data)
 }
 
 static void
-send_batch (SearchThreadData *data)
+send_batch (SearchThread *thread)
 {
-    data->n_processed_files = 0;
+    thread->n_processed_files = 0;
 
-    if (data->uri_hits)
+    if (thread->uri_hits)
     {
         SearchHits *hits;
 
         hits = g_new (SearchHits, 1);
-        hits->uris = data->uri_hits;
-        hits->thread_data = data;
+        hits->uris = thread->uri_hits;
+        hits->thread_data = thread->data;
         g_idle_add (search_thread_add_hits_idle, hits);
     }
-    data->uri_hits = NULL;
+    thread->uri_hits = NULL;
 }
 
 #define G_FILE_ATTRIBUTE_XATTR_XDG_TAGS "xattr::xdg.tags"
@@ -376,85 +431,304 @@ read_odt (const char *filepath) {
     return output;
 }
 
-static inline gchar *
-utf8_normalize_strdown (const char *str) {
-    gchar* lower = NULL;
-    gchar *normalized = g_utf8_normalize (str, -1, G_NORMALIZE_DEFAULT);
+/* Like memmem (), which is not available everywhere. memchr () is
+ * vectorized by the C library, so this is fast for most needles.
+ */
+static const char *
+find_bytes (const char *haystack,
+            gsize       haystack_len,
+            const char *needle,
+            gsize       needle_len)
+{
+    const char *p, *last;
 
-    if (normalized)
-        lower = g_utf8_strdown (normalized, -1);
+    if (needle_len == 0)
+    {
+        return haystack;
+    }
 
-    g_free (normalized);
+    if (haystack_len < needle_len)
+    {
+        return NULL;
+    }
 
-    return lower;
+    last = haystack + haystack_len - needle_len;
+    for (p = haystack; p <= last; p++)
+    {
+        p = memchr (p, needle[0], last - p + 1);
+        if (p == NULL)
+        {
+            return NULL;
+        }
+        if (memcmp (p + 1, needle + 1, needle_len - 1) == 0)
+        {
+            return p;
+        }
+    }
+
+    return NULL;
 }
 
-static inline gboolean
-is_file_has_str (
-    const char *filepath,
-    const char *str,
-    const char *mime_type,
-    gboolean odt2txt_available)
+/* Appends len bytes of text to window, lowercased the same way as
+ * the contained text of the query.
+ */
+static void
+append_lower_text (SearchThreadData *data,
+                   GString          *window,
+                   const char       *text,
+                   gsize             len,
+                   gboolean          valid_utf8)
 {
-    gboolean rc = TRUE;
-    gchar *contents = NULL;
-    gchar *lower_contents = NULL;
-    gchar *lower_str = NULL;
+    gsize i;
+    gboolean ascii;
+    char *normalized, *lower;
 
-    if (str[0] == '\0') {
-        return TRUE;
+    ascii = TRUE;
+    for (i = 0; i < len; i++)
+    {
+        if (text[i] & 0x80)
+        {
+            ascii = FALSE;
+            break;
+        }
     }
 
-    if (g_content_type_is_mime_type (mime_type, "text/plain")) {
-        rc = g_file_get_contents (filepath, &contents, NULL, NULL);
+    if (valid_utf8 && !(ascii && data->ascii_lowercase))
+    {
+        normalized = g_utf8_normalize (text, len, G_NORMALIZE_DEFAULT);
+        if (normalized != NULL)
+        {
+            lower = g_utf8_strdown (normalized, -1);
+            g_string_append (window, lower);
+            g_free (lower);
+            g_free (normalized);
+            return;
+        }
     }
-    else {
-        if (!odt2txt_available) {
-            g_warning ("Can't search in file '%s'. odt2txt not found.", filepath);
-            rc = FALSE;
+
+    /* Either plain ASCII, or not text we can normalize: only fold
+     * the ASCII letters.
+     */
+    for (i = 0; i < len; i++)
+    {
+        g_string_append_c (window, g_ascii_tolower (text[i]));
+    }
+}
+
+/* Reads the stream in fixed size chunks, looking for the contained
+ * text of the query. Only the current chunk and the last few bytes of
+ * the one before it are kept in memory, so that matches spanning two
+ * chunks are found too.
+ */
+static gboolean
+stream_has_str (GInputStream     *stream,
+                SearchThreadData *data)
+{
+    char *buffer;
+    GString *window;
+    const char *needle, *end;
+    gsize needle_len, pending, len, valid_len, keep;
+    guint64 total, to_read;
+    gssize n_read;
+    gboolean found, first, valid_utf8;
+
+    needle = data->lower_contained_text;
+    needle_len = strlen (needle);
+
+    buffer = g_malloc (CONTENTS_CHUNK_SIZE);
+    window = g_string_sized_new (CONTENTS_CHUNK_SIZE + needle_len);
+    found = FALSE;
+    first = TRUE;
+    pending = 0;
+    total = 0;
+
+    while (!found && !g_cancellable_is_cancelled (data->cancellable))
+    {
+        to_read = CONTENTS_CHUNK_SIZE - pending;
+        if (data->contents_size_limit != 0)
+        {
+            if (total >= data->contents_size_limit)
+            {
+                break;
+            }
+            to_read = MIN (to_read, data->contents_size_limit - total);
         }
-        else {
-            contents = read_odt (filepath);
-            if (!contents)
-                rc = FALSE;
+
+        n_read = g_input_stream_read (stream, buffer + pending, to_read,
+                                      data->cancellable, NULL);
+        if (n_read <= 0)
+        {
+            break;
+        }
+        total += n_read;
+
+        /* Don't bother with binary files that only claim to be text. */
+        if (first)
+        {
+            if (memchr (buffer, '\0', n_read) != NULL)
+            {
+                break;
+            }
+            first = FALSE;
+        }
+
+        len = pending + n_read;
+
+        /* Keep a character cut in half by the end of the chunk for
+         * the next one.
+         */
+        valid_utf8 = g_utf8_validate (buffer, len, &end);
+        valid_len = end - buffer;
+        pending = 0;
+        if (!valid_utf8)
+        {
+            if (len - valid_len < 4 &&
+                g_utf8_get_char_validated (end, len - valid_len) == (gunichar) -2)
+            {
+                pending = len - valid_len;
+                valid_utf8 = TRUE;
+            }
+            else
+            {
+                valid_len = len;
+            }
+        }
+
+        append_lower_text (data, window, buffer, valid_len, valid_utf8);
+
+        if (find_bytes (window->str, window->len, needle, needle_len) != NULL)
+        {
+            found = TRUE;
         }
+
+        keep = needle_len > 0 ? needle_len - 1 : 0;
+        if (window->len > keep)
+        {
+            g_string_erase (window, 0, window->len - keep);
+        }
+
+        memmove (buffer, buffer + valid_len, pending);
     }
 
-    if (rc) {
-        lower_str = utf8_normalize_strdown (str);
-        lower_contents = utf8_normalize_strdown (contents);
+    g_string_free (window, TRUE);
+    g_free (buffer);
 
-        if (lower_str && lower_contents && strstr (lower_contents, lower_str))
-            rc = TRUE;
-        else
-            rc = FALSE;
+    return found;
+}
+
+static gboolean
+is_file_has_str (GFile            *file,
+                 const char       *mime_type,
+                 SearchThreadData *data)
+{
+    GInputStream *stream;
+    gboolean rc;
+
+    if (data->lower_contained_text == NULL)
+    {
+        return FALSE;
+    }
+
+    if (data->lower_contained_text[0] == '\0')
+    {
+        return TRUE;
+    }
+
+    if (g_content_type_is_mime_type (mime_type, "text/plain"))
+    {
+        stream = G_INPUT_STREAM (g_file_read (file, data->cancellable, NULL));
+    }
+    else
+    {
+        char *filepath, *contents;
+
+        filepath = g_file_get_path (file);
+        if (filepath == NULL)
+        {
+            return FALSE;
+        }
+
+        if (!data->odt2txt_available)
+        {
+            g_warning ("Can't search in file '%s'. odt2txt not found.", filepath);
+            g_free (filepath);
+            return FALSE;
+        }
+
+        contents = read_odt (filepath);
+        g_free (filepath);
+        stream = contents == NULL ? NULL :
+                 g_memory_input_stream_new_from_data (contents, strlen (contents), g_free);
     }
 
-    g_free (contents);
-    g_free (lower_str);
-    g_free (lower_contents);
+    if (stream == NULL)
+    {
+        return FALSE;
+    }
+
+    rc = stream_has_str (stream, data);
+    g_object_unref (stream);
 
     return rc;
 }
 
+/* Returns the name lowercased the same way as the search words, in
+ * a buffer that is reused for every file.
+ */
+static const char *
+get_lower_name (SearchThread *thread,
+                const char   *display_name)
+{
+    char *lower_name, *normalized;
+    const char *p;
+
+    g_string_truncate (thread->name_buffer, 0);
+
+    if (thread->data->ascii_lowercase)
+    {
+        for (p = display_name; *p != '\0' && !(*p & 0x80); p++)
+        {
+            g_string_append_c (thread->name_buffer, g_ascii_tolower (*p));
+        }
+
+        if (*p == '\0')
+        {
+            return thread->name_buffer->str;
+        }
+
+        g_string_truncate (thread->name_buffer, 0);
+    }
+
+    normalized = g_utf8_normalize (display_name, -1, G_NORMALIZE_NFD);
+    lower_name = g_utf8_strdown (normalized, -1);
+    g_string_append (thread->name_buffer, lower_name);
+    g_free (normalized);
+    g_free (lower_name);
+
+    return thread->name_buffer->str;
+}
+
 static void
-visit_directory (GFile *dir, SearchThreadData *data)
+visit_directory (GFile *dir, SearchThread *thread)
 {
+    SearchThreadData *data;
     GFileEnumerator *enumerator;
     GFileInfo *info;
     GFile *child;
     const char *mime_type, *display_name;
-    char *lower_name, *normalized;
+    const char *lower_name;
     gboolean hit;
     int i;
     GList *l;
+    GList *subdirectories;
     const char *id;
     gboolean visited;
     GTimeVal result;
     gchar *attributes;
     GString *attr_string;
-    gchar *filepath = NULL;
-    gboolean odt2txt_available = FALSE;
+
+    data = thread->data;
+    subdirectories = NULL;
 
     attr_string = g_string_new (STD_ATTRIBUTES);
     if (data->mime_types != NULL || data->contained_text != NULL) {
@@ -471,10 +745,6 @@ visit_directory (GFile *dir, SearchThreadData *data)
         g_string_append (attr_string, "," G_FILE_ATTRIBUTE_STANDARD_SIZE);
     }
 
-    if (data->contained_text != NULL) {
-        odt2txt_available = check_odt2txt();
-    }
-
     attributes = g_string_free (attr_string, FALSE);
     enumerator = g_file_enumerate_children (dir, (const char*)attributes, 0,
                                             data->cancellable, NULL);
@@ -498,9 +768,7 @@ visit_directory (GFile *dir, SearchThreadData *data)
             goto next;
         }
 
-        normalized = g_utf8_normalize (display_name, -1, G_NORMALIZE_NFD);
-        lower_name = g_utf8_strdown (normalized, -1);
-        g_free (normalized);
+        lower_name = get_lower_name (thread, display_name);
 
         hit = TRUE;
         for (i = 0; data->words[i] != NULL; i++)
@@ -511,7 +779,6 @@ visit_directory (GFile *dir, SearchThreadData *data)
                 break;
             }
         }
-        g_free (lower_name);
 
         if (hit && data->mime_types)
         {
@@ -568,9 +835,7 @@ visit_directory (GFile *dir, SearchThreadData *data)
                 g_content_type_equals (mime_type, "application/vnd.oasis.opendocument.presentation") ||
                 g_content_type_equals (mime_type, "application/vnd.oasis.opendocument.presentation-template")
             ) {
-                g_free (filepath);
-                filepath = g_file_get_path (child);
-                hit = is_file_has_str (filepath, data->contained_text, mime_type, odt2txt_available);
+                hit = is_file_has_str (child, mime_type, data);
             }
             else {
                 hit = FALSE;
@@ -579,13 +844,13 @@ visit_directory (GFile *dir, SearchThreadData *data)
 
         if (hit)
         {
-            data->uri_hits = g_list_prepend (data->uri_hits, g_file_get_uri (child));
+            thread->uri_hits = g_list_prepend (thread->uri_hits, g_file_get_uri (child));
         }
 
-        data->n_processed_files++;
-        if (data->n_processed_files > BATCH_SIZE)
+        thread->n_processed_files++;
+        if (thread->n_processed_files > BATCH_SIZE)
         {
-            send_batch (data);
+            send_batch (thread);
         }
 
         if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
@@ -594,6 +859,7 @@ visit_directory (GFile *dir, SearchThreadData *data)
             visited = FALSE;
             if (id)
             {
+                g_mutex_lock (&data->mutex);
                 if (g_hash_table_lookup_extended (data->visited,
                                                   id, NULL, NULL))
                 {
@@ -603,11 +869,12 @@ visit_directory (GFile *dir, SearchThreadData *data)
                 {
                     g_hash_table_insert (data->visited, g_strdup (id), NULL);
                 }
+                g_mutex_unlock (&data->mutex);
             }
 
             if (!visited)
             {
-                g_queue_push_tail (data->directories, g_object_ref (child));
+                subdirectories = g_list_prepend (subdirectories, g_object_ref (child));
             }
         }
 
@@ -616,17 +883,101 @@ next:
         g_object_unref (info);
     }
 
-    g_free (filepath);
     g_object_unref (enumerator);
+
+    /* Hand the subdirectories to whichever thread is free. */
+    if (subdirectories != NULL)
+    {
+        g_mutex_lock (&data->mutex);
+        subdirectories = g_list_reverse (subdirectories);
+        for (l = subdirectories; l != NULL; l = l->next)
+        {
+            g_queue_push_tail (data->directories, l->data);
+        }
+        g_cond_broadcast (&data->cond);
+        g_mutex_unlock (&data->mutex);
+        g_list_free (subdirectories);
+    }
 }
 
 
+/* Runs in every search thread: visit directories from the shared
+ * queue until it is empty and no other thread can add to it anymore.
+ */
+static void
+search_thread_run (SearchThreadData *data)
+{
+    SearchThread thread;
+    GFile *dir;
+    gboolean last;
+
+    thread.data = data;
+    thread.n_processed_files = 0;
+    thread.uri_hits = NULL;
+    thread.name_buffer = g_string_new (NULL);
+
+    g_mutex_lock (&data->mutex);
+    while (!g_cancellable_is_cancelled (data->cancellable))
+    {
+        dir = g_queue_pop_head (data->directories);
+        if (dir == NULL)
+        {
+            if (data->busy_threads == 0)
+            {
+                break;
+            }
+
+            g_cond_wait_until (&data->cond, &data->mutex,
+                               g_get_monotonic_time () + 100 * G_TIME_SPAN_MILLISECOND);
+            continue;
+        }
+
+        data->busy_threads++;
+        g_mutex_unlock (&data->mutex);
+
+        visit_directory (dir, &thread);
+        g_object_unref (dir);
+
+        g_mutex_lock (&data->mutex);
+        data->busy_threads--;
+        g_cond_broadcast (&data->cond);
+    }
+    g_mutex_unlock (&data->mutex);
+
+    send_batch (&thread);
+    g_string_free (thread.name_buffer, TRUE);
+
+    g_mutex_lock (&data->mutex);
+    data->running_threads--;
+    last = data->running_threads == 0;
+    g_cond_broadcast (&data->cond);
+    g_mutex_unlock (&data->mutex);
+
+    /* The last thread out reports that the search is done, after the
+     * hits of all threads were queued.
+     */
+    if (last)
+    {
+        g_idle_add (search_thread_done_idle, data);
+    }
+}
+
+static gpointer
+search_worker_func (gpointer user_data)
+{
+    search_thread_run (user_data);
+
+    return NULL;
+}
+
 static gpointer
 search_thread_func (gpointer user_data)
 {
     SearchThreadData *data;
     GFile *dir;
     GFileInfo *info;
+    GThread *thread;
+    int n_threads, i;
 
     data = user_data;
 
@@ -645,15 +996,20 @@ search_thread_func (gpointer user_data)
         g_object_unref (info);
     }
 
-    while (!g_cancellable_is_cancelled (data->cancellable) &&
-            (dir = g_queue_pop_head (data->directories)) != NULL)
+    if (data->contained_text != NULL)
     {
-        visit_directory (dir, data);
-        g_object_unref (dir);
+        data->odt2txt_available = check_odt2txt ();
+    }
+
+    n_threads = CLAMP ((int) g_get_num_processors (), 1, MAX_SEARCH_THREADS);
+    data->running_threads = n_threads;
+    for (i = 1; i < n_threads; i++)
+    {
+        thread = g_thread_new ("baul-search-simple", search_worker_func, data);
+        g_thread_unref (thread);
     }
-    send_batch (data);
 
-    g_idle_add (search_thread_done_idle, data);
+    search_thread_run (data);
 
     return NULL;
 }
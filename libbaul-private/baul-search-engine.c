@@ -27,6 +27,7 @@
 
 #include "baul-search-engine.h"
 #include "baul-search-engine-beagle.h"
+#include "baul-search-engine-index.h"
 #include "baul-search-engine-simple.h"
 #include "baul-search-engine-tracker.h"
 
@@ -126,6 +127,13 @@ baul_search_engine_new (void)
 {
     BaulSearchEngine *engine;
 
+    /* Only used when folders to index were configured. */
+    engine = baul_search_engine_index_new ();
+    if (engine)
+    {
+        return engine;
+    }
+
     engine = baul_search_engine_tracker_new ();
     if (engine)
     {
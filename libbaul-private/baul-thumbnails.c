@@ -60,10 +60,14 @@
 /* Cool-off period between last file modification time and thumbnail creation */
 #define THUMBNAIL_CREATION_DELAY_SECS 3
 
-static void thumbnail_thread_func (GTask        *task,
-                                   gpointer      source_object,
-                                   gpointer      task_data,
-                                   GCancellable *cancellable);
+/* Upper bound for the number of threads making thumbnails at once. */
+#define MAX_THUMBNAIL_THREADS 8
+
+/* Stop trying to thumbnail a MIME type after this many failures in a
+   row, so that a few broken files don't turn off a type that works. */
+#define MIME_TYPE_MAX_FAILURES 10
+
+static gpointer thumbnail_thread_func (gpointer data);
 
 /* structure used for making thumbnails, associating a uri with where the thumbnail is to be stored */
 
@@ -72,35 +76,59 @@ typedef struct
     char *image_uri;
     char *mime_type;
     time_t original_file_mtime;
+
+    /* Used by the queue. Lock thumbnails_mutex when accessing these. */
+    guint64 priority;      /* when it was last asked to hurry, 0 if never */
+    guint64 sequence;      /* order in which thumbnails were asked for */
+    GSequenceIter *iter;   /* NULL while the thumbnail is being made */
+    gboolean unwanted;     /* removed from the queue while being made */
 } BaulThumbnailInfo;
 
+typedef struct
+{
+    guint failures; /* since the last success */
+} MimeTypeResults;
+
 /*
  * Thumbnail thread state.
  */
 
-/* The id of the idle handler used to start the thumbnail thread, or 0 if no
+/* The id of the idle handler used to start the thumbnail threads, or 0 if no
    idle handler is currently registered. */
 static guint thumbnail_thread_starter_id = 0;
 
 /* Our mutex used when accessing data shared between the main thread and the
-   thumbnail thread, i.e. the thumbnail_thread_is_running flag and the
-   thumbnails_to_make list. */
+   thumbnail threads, i.e. the queue, the counters and the results per
+   MIME type. */
 static GMutex thumbnails_mutex;
 
-/* A flag to indicate whether a thumbnail thread is running, so we don't
-   start more than one. Lock thumbnails_mutex when accessing this. */
-static volatile gboolean thumbnail_thread_is_running = FALSE;
-
-/* The list of BaulThumbnailInfo structs containing information about the
-   thumbnails we are making. Lock thumbnails_mutex when accessing this. */
-static volatile GQueue thumbnails_to_make = G_QUEUE_INIT;
+/* The BaulThumbnailInfo structs waiting to be made, in the order they
+   will be made. Lock thumbnails_mutex when accessing this. */
+static GSequence *thumbnails_to_make = NULL;
 
-/* Quickly check if uri is in thumbnails_to_make list */
+/* Maps uris to the BaulThumbnailInfo structs that are waiting or being
+   made, so the main thread doesn't add them again. Lock
+   thumbnails_mutex when accessing this. */
 static GHashTable *thumbnails_to_make_hash = NULL;
 
-/* The currently thumbnailed icon. it also exists in the thumbnails_to_make list
- * to avoid adding it again. Lock thumbnails_mutex when accessing this. */
-static BaulThumbnailInfo *currently_thumbnailing = NULL;
+static guint64 next_sequence = 0;
+static guint64 next_priority = 0;
+
+/* The number of thumbnail threads running, and how many may run. Lock
+   thumbnails_mutex when accessing these. */
+static int thumbnail_threads_running = 0;
+static int thumbnail_threads_max = 0;
+
+/* MimeTypeResults by MIME type. Lock thumbnails_mutex when accessing this. */
+static GHashTable *mime_type_results = NULL;
+
+/* Counters for baul_thumbnail_get_stats (). Lock thumbnails_mutex when
+   accessing these. */
+static guint64 thumbnails_made = 0;
+static guint64 thumbnails_failed = 0;
+static guint64 thumbnails_wasted = 0;
+static gint64 threads_active_since = 0;
+static gint64 threads_active_time = 0;
 
 static CafeDesktopThumbnailFactory *thumbnail_factory = NULL;
 
@@ -139,6 +167,81 @@ free_thumbnail_info (BaulThumbnailInfo *info)
     g_free (info);
 }
 
+/* Puts the thumbnails that were asked to hurry most recently first,
+   and the others in the order they were asked for. */
+static gint
+compare_thumbnail_info (gconstpointer a,
+                        gconstpointer b,
+                        gpointer      user_data G_GNUC_UNUSED)
+{
+    const BaulThumbnailInfo *info_a = a;
+    const BaulThumbnailInfo *info_b = b;
+
+    if (info_a->priority != info_b->priority)
+    {
+        return info_a->priority > info_b->priority ? -1 : 1;
+    }
+
+    if (info_a->sequence != info_b->sequence)
+    {
+        return info_a->sequence < info_b->sequence ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/* Called with thumbnails_mutex held. */
+static void
+ensure_queue (void)
+{
+    if (thumbnails_to_make == NULL)
+    {
+        thumbnails_to_make = g_sequence_new (NULL);
+        thumbnails_to_make_hash = g_hash_table_new (g_str_hash, g_str_equal);
+        mime_type_results = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                   g_free, g_free);
+        thumbnail_threads_max = CLAMP ((int) g_get_num_processors (),
+                                       1, MAX_THUMBNAIL_THREADS);
+    }
+}
+
+/* Called with thumbnails_mutex held. */
+static void
+record_mime_type_result (const char *mime_type,
+                         gboolean    success)
+{
+    MimeTypeResults *results;
+
+    if (mime_type == NULL)
+    {
+        return;
+    }
+
+    results = g_hash_table_lookup (mime_type_results, mime_type);
+    if (results == NULL)
+    {
+        results = g_new0 (MimeTypeResults, 1);
+        g_hash_table_insert (mime_type_results, g_strdup (mime_type), results);
+    }
+
+    if (success)
+    {
+        results->failures = 0;
+    }
+    else
+    {
+        results->failures++;
+    }
+}
+
+/* Called with thumbnails_mutex held. */
+static gboolean
+mime_type_keeps_failing (const MimeTypeResults *results)
+{
+    return results != NULL &&
+           results->failures >= MIME_TYPE_MAX_FAILURES;
+}
+
 static CafeDesktopThumbnailFactory *
 get_thumbnail_factory (void)
 {
@@ -154,13 +257,14 @@ get_thumbnail_factory (void)
 
 
 /* This function is added as a very low priority idle function to start the
-   thread to create any needed thumbnails. It is added with a very low priority
+   threads to create any needed thumbnails. It is added with a very low priority
    so that it doesn't delay showing the directory in the icon/list views.
    We want to show the files in the directory as quickly as possible. */
 static gboolean
 thumbnail_thread_starter_cb (gpointer data G_GNUC_UNUSED)
 {
-    GTask *task;
+    GThread *thread;
+    int n_threads, i;
 
     /* Don't do this in thread, since g_object_ref is not threadsafe */
     if (thumbnail_factory == NULL)
@@ -168,21 +272,31 @@ thumbnail_thread_starter_cb (gpointer data G_GNUC_UNUSED)
         thumbnail_factory = get_thumbnail_factory ();
     }
 
-#ifdef DEBUG_THUMBNAILS
-    g_message ("(Main Thread) Creating thumbnails thread\n");
-#endif
-    /* We set a flag to indicate the thread is running, so we don't create
-       a new one. We don't need to lock a mutex here, as the thumbnail
-       thread isn't running yet. And we know we won't create the thread
-       twice, as we also check thumbnail_thread_starter_id before
-       scheduling this idle function. */
-    thumbnail_thread_is_running = TRUE;
-    task = g_task_new (NULL, NULL, NULL, NULL);
-    g_task_run_in_thread (task, thumbnail_thread_func);
-
     thumbnail_thread_starter_id = 0;
 
-    g_object_unref (task);
+    g_mutex_lock (&thumbnails_mutex);
+
+    /* Start as many threads as there are thumbnails waiting, up to the
+       number of cores. */
+    n_threads = MIN (thumbnail_threads_max,
+                     g_sequence_get_length (thumbnails_to_make)) - thumbnail_threads_running;
+    if (n_threads > 0 && thumbnail_threads_running == 0)
+    {
+        threads_active_since = g_get_monotonic_time ();
+    }
+    n_threads = MAX (n_threads, 0);
+    thumbnail_threads_running += n_threads;
+
+    g_mutex_unlock (&thumbnails_mutex);
+
+#ifdef DEBUG_THUMBNAILS
+    g_message ("(Main Thread) Creating %d thumbnails threads\n", n_threads);
+#endif
+    for (i = 0; i < n_threads; i++)
+    {
+        thread = g_thread_new ("baul-thumbnails", thumbnail_thread_func, NULL);
+        g_thread_unref (thread);
+    }
 
     return FALSE;
 }
@@ -201,15 +315,24 @@ baul_thumbnail_remove_from_queue (const char *file_uri)
 
     if (thumbnails_to_make_hash)
     {
-        GList *node;
+        BaulThumbnailInfo *info;
 
-        node = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
+        info = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
 
-        if (node && node->data != currently_thumbnailing)
+        if (info != NULL)
         {
             g_hash_table_remove (thumbnails_to_make_hash, file_uri);
-            free_thumbnail_info (node->data);
-            g_queue_delete_link ((GQueue *)&thumbnails_to_make, node);
+
+            if (info->iter != NULL)
+            {
+                g_sequence_remove (info->iter);
+                free_thumbnail_info (info);
+            }
+            else
+            {
+                /* A thread is making it; it frees the info when done. */
+                info->unwanted = TRUE;
+            }
         }
     }
 
@@ -237,14 +360,17 @@ baul_thumbnail_prioritize (const char *file_uri)
 
     if (thumbnails_to_make_hash)
     {
-        GList *node;
+        BaulThumbnailInfo *info;
 
-        node = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
+        info = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
 
-        if (node && node->data != currently_thumbnailing)
+        /* The files on screen are asked to hurry every time the view
+           scrolls, so the ones that went off screen fall behind the
+           ones that came into view. */
+        if (info != NULL && info->iter != NULL)
         {
-            g_queue_unlink ((GQueue *)&thumbnails_to_make, node);
-            g_queue_push_head_link ((GQueue *)&thumbnails_to_make, node);
+            info->priority = ++next_priority;
+            g_sequence_sort_changed (info->iter, compare_thumbnail_info, NULL);
         }
     }
 
@@ -258,6 +384,49 @@ baul_thumbnail_prioritize (const char *file_uri)
     g_mutex_unlock (&thumbnails_mutex);
 }
 
+void
+baul_thumbnail_get_stats (BaulThumbnailStats *stats)
+{
+    gint64 active_time;
+    GHashTableIter iter;
+    MimeTypeResults *results;
+
+    memset (stats, 0, sizeof (BaulThumbnailStats));
+
+    g_mutex_lock (&thumbnails_mutex);
+
+    if (thumbnails_to_make != NULL)
+    {
+        stats->queue_length = g_sequence_get_length (thumbnails_to_make);
+        stats->running_threads = thumbnail_threads_running;
+        stats->made = thumbnails_made;
+        stats->failed = thumbnails_failed;
+        stats->wasted = thumbnails_wasted;
+
+        active_time = threads_active_time;
+        if (thumbnail_threads_running > 0)
+        {
+            active_time += g_get_monotonic_time () - threads_active_since;
+        }
+        if (active_time > 0)
+        {
+            stats->per_second = (thumbnails_made + thumbnails_failed) *
+                                (double) G_USEC_PER_SEC / active_time;
+        }
+
+        g_hash_table_iter_init (&iter, mime_type_results);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &results))
+        {
+            if (mime_type_keeps_failing (results))
+            {
+                stats->failing_mime_types++;
+            }
+        }
+    }
+
+    g_mutex_unlock (&thumbnails_mutex);
+}
+
 
 /***************************************************************************
  * Thumbnail Thread Functions.
@@ -368,8 +537,20 @@ baul_can_thumbnail (BaulFile *file)
     time_t mtime;
     char *mime_type;
 
-    uri = baul_file_get_uri (file);
     mime_type = baul_file_get_mime_type (file);
+
+    /* Don't keep trying a type no thumbnailer could ever handle. */
+    g_mutex_lock (&thumbnails_mutex);
+    res = mime_type_results != NULL &&
+          mime_type_keeps_failing (g_hash_table_lookup (mime_type_results, mime_type));
+    g_mutex_unlock (&thumbnails_mutex);
+    if (res)
+    {
+        g_free (mime_type);
+        return FALSE;
+    }
+
+    uri = baul_file_get_uri (file);
     mtime = baul_file_get_mtime (file);
 
     factory = get_thumbnail_factory ();
@@ -388,7 +569,7 @@ baul_create_thumbnail (BaulFile *file)
 {
     time_t file_mtime = 0;
     BaulThumbnailInfo *info;
-    GList *existing;
+    BaulThumbnailInfo *existing_info;
 
     baul_file_set_is_thumbnailing (file, TRUE);
 
@@ -421,33 +602,28 @@ baul_create_thumbnail (BaulFile *file)
      * MUTEX LOCKED
      *********************************/
 
-    if (thumbnails_to_make_hash == NULL)
-    {
-        thumbnails_to_make_hash = g_hash_table_new (g_str_hash,
-                                  g_str_equal);
-    }
+    ensure_queue ();
 
     /* Check if it is already in the list of thumbnails to make. */
-    existing = g_hash_table_lookup (thumbnails_to_make_hash, info->image_uri);
-    if (existing == NULL)
+    existing_info = g_hash_table_lookup (thumbnails_to_make_hash, info->image_uri);
+    if (existing_info == NULL)
     {
-        GList *node;
-
         /* Add the thumbnail to the list. */
 #ifdef DEBUG_THUMBNAILS
         g_message ("(Main Thread) Adding thumbnail: %s\n",
                    info->image_uri);
 #endif
-        g_queue_push_tail ((GQueue *)&thumbnails_to_make, info);
-        node = g_queue_peek_tail_link ((GQueue *)&thumbnails_to_make);
+        info->sequence = ++next_sequence;
+        info->iter = g_sequence_insert_sorted (thumbnails_to_make, info,
+                                               compare_thumbnail_info, NULL);
         g_hash_table_insert (thumbnails_to_make_hash,
                              info->image_uri,
-                             node);
-        /* If the thumbnail thread isn't running, and we haven't
-           scheduled an idle function to start it up, do that now.
-           We don't want to start it until all the other work is done,
+                             info);
+        /* If not all the threads are running, and we haven't
+           scheduled an idle function to start them, do that now.
+           We don't want to start them until all the other work is done,
            so the GUI will be updated as quickly as possible.*/
-        if (thumbnail_thread_is_running == FALSE &&
+        if (thumbnail_threads_running < thumbnail_threads_max &&
                 thumbnail_thread_starter_id == 0)
         {
             thumbnail_thread_starter_id = g_idle_add_full (G_PRIORITY_LOW, thumbnail_thread_starter_cb, NULL, NULL);
@@ -455,14 +631,11 @@ baul_create_thumbnail (BaulFile *file)
     }
     else
     {
-        BaulThumbnailInfo *existing_info;
-
 #ifdef DEBUG_THUMBNAILS
         g_message ("(Main Thread) Updating non-current mtime: %s\n",
                    info->image_uri);
 #endif
         /* The file in the queue might need a new original mtime */
-        existing_info = existing->data;
         existing_info->original_file_mtime = info->original_file_mtime;
         free_thumbnail_info (info);
     }
@@ -477,18 +650,37 @@ baul_create_thumbnail (BaulFile *file)
     g_mutex_unlock (&thumbnails_mutex);
 }
 
-/* thumbnail_thread is invoked as a separate thread to to make thumbnails. */
+/* Called with thumbnails_mutex held, once a thread is done with info. */
 static void
-thumbnail_thread_func (GTask        *task G_GNUC_UNUSED,
-		       gpointer      source_object G_GNUC_UNUSED,
-		       gpointer      task_data G_GNUC_UNUSED,
-		       GCancellable *cancellable G_GNUC_UNUSED)
+thumbnail_done (BaulThumbnailInfo *info,
+                time_t             thumbnailed_mtime)
+{
+    if (!info->unwanted && info->original_file_mtime != thumbnailed_mtime)
+    {
+        /* The file changed while we were at it, so make it again. */
+        info->iter = g_sequence_insert_sorted (thumbnails_to_make, info,
+                                               compare_thumbnail_info, NULL);
+        return;
+    }
+
+    if (!info->unwanted)
+    {
+        g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
+    }
+    free_thumbnail_info (info);
+}
+
+/* thumbnail_thread_func is run by each of the threads making thumbnails. */
+static gpointer
+thumbnail_thread_func (gpointer data G_GNUC_UNUSED)
 {
     BaulThumbnailInfo *info = NULL;
     GdkPixbuf *pixbuf;
+    GSequenceIter *iter;
     time_t current_orig_mtime = 0;
     time_t current_time;
-    GList *node;
+    char *image_uri;
+    gboolean success;
 
     /* We loop until there are no more thumbails to make, at which point
        we exit the thread. */
@@ -503,44 +695,31 @@ thumbnail_thread_func (GTask        *task G_GNUC_UNUSED,
          * MUTEX LOCKED
          *********************************/
 
-        /* Pop the last thumbnail we just made off the head of the
-           list and free it. I did this here so we only have to lock
-           the mutex once per thumbnail, rather than once before
-           creating it and once after.
-           Don't pop the thumbnail off the queue if the original file
-           mtime of the request changed. Then we need to redo the thumbnail.
-        */
-        if (currently_thumbnailing &&
-                currently_thumbnailing->original_file_mtime == current_orig_mtime)
-        {
-            g_assert (info == currently_thumbnailing);
-            node = g_hash_table_lookup (thumbnails_to_make_hash, info->image_uri);
-            g_assert (node != NULL);
-            g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
-            free_thumbnail_info (info);
-            g_queue_delete_link ((GQueue *)&thumbnails_to_make, node);
-        }
-        currently_thumbnailing = NULL;
-
-        /* If there are no more thumbnails to make, reset the
-           thumbnail_thread_is_running flag, unlock the mutex, and
-           exit the thread. */
-        if (g_queue_is_empty ((GQueue *)&thumbnails_to_make))
+        /* If there are no more thumbnails to make, unlock the mutex,
+           and exit the thread. */
+        if (g_sequence_is_empty (thumbnails_to_make))
         {
 #ifdef DEBUG_THUMBNAILS
             g_message ("(Thumbnail Thread) Exiting\n");
 #endif
-            thumbnail_thread_is_running = FALSE;
+            thumbnail_threads_running--;
+            if (thumbnail_threads_running == 0)
+            {
+                threads_active_time += g_get_monotonic_time () - threads_active_since;
+            }
             g_mutex_unlock (&thumbnails_mutex);
-            return;
+            return NULL;
         }
 
-        /* Get the next one to make. We leave it on the list until it
-           is created so the main thread doesn't add it again while we
+        /* Get the next one to make. We leave it in the hash table until
+           it is created so the main thread doesn't add it again while we
            are creating it. */
-        info = g_queue_peek_head ((GQueue *)&thumbnails_to_make);
-        currently_thumbnailing = info;
+        iter = g_sequence_get_begin_iter (thumbnails_to_make);
+        info = g_sequence_get (iter);
+        g_sequence_remove (iter);
+        info->iter = NULL;
         current_orig_mtime = info->original_file_mtime;
+        image_uri = g_strdup (info->image_uri);
         /*********************************
          * MUTEX UNLOCKED
          *********************************/
@@ -559,33 +738,42 @@ thumbnail_thread_func (GTask        *task G_GNUC_UNUSED,
         {
 #ifdef DEBUG_THUMBNAILS
             g_message ("(Thumbnail Thread) Skipping: %s\n",
-                       info->image_uri);
+                       image_uri);
 #endif
+            g_mutex_lock (&thumbnails_mutex);
+            if (!info->unwanted)
+            {
+                g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
+            }
+            free_thumbnail_info (info);
+            g_mutex_unlock (&thumbnails_mutex);
+
             /* Reschedule thumbnailing via a change notification */
             g_timeout_add_seconds (1, thumbnail_thread_notify_file_changed,
-                                   g_strdup (info->image_uri));
+                                   image_uri);
             continue;
         }
 
         /* Create the thumbnail. */
 #ifdef DEBUG_THUMBNAILS
         g_message ("(Thumbnail Thread) Creating thumbnail: %s\n",
-                   info->image_uri);
+                   image_uri);
 #endif
 
         pixbuf = cafe_desktop_thumbnail_factory_generate_thumbnail (thumbnail_factory,
-                 info->image_uri,
+                 image_uri,
                  info->mime_type);
 
-        if (pixbuf)
+        success = pixbuf != NULL;
+        if (success)
         {
 #ifdef DEBUG_THUMBNAILS
 			g_message ("(Thumbnail Thread) Saving thumbnail: %s\n",
-				   info->image_uri);
+				   image_uri);
 #endif
             cafe_desktop_thumbnail_factory_save_thumbnail (thumbnail_factory,
                     pixbuf,
-                    info->image_uri,
+                    image_uri,
                     current_orig_mtime);
             g_object_unref (pixbuf);
         }
@@ -593,16 +781,34 @@ thumbnail_thread_func (GTask        *task G_GNUC_UNUSED,
         {
 #ifdef DEBUG_THUMBNAILS
 			g_message ("(Thumbnail Thread) Thumbnail failed: %s\n",
-				   info->image_uri);
+				   image_uri);
 #endif
             cafe_desktop_thumbnail_factory_create_failed_thumbnail (thumbnail_factory,
-                    info->image_uri,
+                    image_uri,
                     current_orig_mtime);
         }
+
+        g_mutex_lock (&thumbnails_mutex);
+        record_mime_type_result (info->mime_type, success);
+        if (success)
+        {
+            thumbnails_made++;
+        }
+        else
+        {
+            thumbnails_failed++;
+        }
+        if (info->unwanted)
+        {
+            thumbnails_wasted++;
+        }
+        thumbnail_done (info, current_orig_mtime);
+        g_mutex_unlock (&thumbnails_mutex);
+
         /* We need to call baul_file_changed(), but I don't think that is
            thread safe. So add an idle handler and do it from the main loop. */
         g_idle_add_full (G_PRIORITY_HIGH_IDLE,
                          thumbnail_thread_notify_file_changed,
-                         g_strdup (info->image_uri), NULL);
+                         image_uri, NULL);
     }
 }
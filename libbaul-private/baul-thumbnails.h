@@ -40,5 +40,18 @@ gboolean   baul_thumbnail_is_mimetype_limited_by_size
 void       baul_thumbnail_remove_from_queue     (const char   *file_uri);
 void       baul_thumbnail_prioritize            (const char   *file_uri);
 
+typedef struct
+{
+    guint queue_length;       /* waiting, not counting the ones being made */
+    guint running_threads;
+    guint64 made;
+    guint64 failed;
+    guint64 wasted;           /* made for files nobody wanted anymore */
+    guint failing_mime_types; /* given up on for this session */
+    double per_second;        /* while any thread was running */
+} BaulThumbnailStats;
+
+void       baul_thumbnail_get_stats             (BaulThumbnailStats *stats);
+
 
 #endif /* BAUL_THUMBNAILS_H */
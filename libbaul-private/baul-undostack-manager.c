@@ -977,6 +977,31 @@ baul_undostack_manager_data_add_trashed_file (BaulUndoStackActionData
   data->isValid = TRUE;
 }
 
+/** ****************************************************************
+ * Pushes trashed files, mtimes[i] being the modification time of the
+ * i-th file, in an existing undo data container
+ ** ****************************************************************/
+void
+baul_undostack_manager_data_add_trashed_files (BaulUndoStackActionData
+    * data, GList * files, const guint64 * mtimes)
+{
+  GList *l;
+  guint64 *modificationTime;
+
+  if (!data || !files)
+    return;
+
+  for (l = files; l != NULL; l = l->next, mtimes++) {
+    modificationTime = g_new (guint64, 1);
+    *modificationTime = *mtimes;
+
+    g_hash_table_insert (data->trashed, g_file_get_uri (l->data),
+        modificationTime);
+  }
+
+  data->isValid = TRUE;
+}
+
 /** ****************************************************************
  * Pushes a recursive permission change data in an existing undo data container
  ** ****************************************************************/
@@ -157,6 +157,10 @@ void
 baul_undostack_manager_data_add_trashed_file(
     BaulUndoStackActionData* data, GFile* file, guint64 mtime);
 
+void
+baul_undostack_manager_data_add_trashed_files(
+    BaulUndoStackActionData* data, GList* files, const guint64* mtimes);
+
 void
 baul_undostack_manager_request_menu_update(BaulUndoStackManager* manager);
 
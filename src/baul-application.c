@@ -48,6 +48,7 @@
 
 #include <libbaul-private/baul-debug-log.h>
 #include <libbaul-private/baul-file-utilities.h>
+#include <libbaul-private/baul-filename-index.h>
 #include <libbaul-private/baul-global-preferences.h>
 #include <libbaul-private/baul-lib-self-check-functions.h>
 #include <libbaul-private/baul-extensions.h>
@@ -2198,6 +2199,11 @@ baul_application_startup (GApplication *app)
      */
     baul_global_preferences_init ();
 
+    /* Load or build the file name index for searching, if the user
+     * asked for one.
+     */
+    baul_filename_index_init ();
+
 	/* initialize the session manager client */
 	baul_application_smclient_startup (self);
 
@@ -538,6 +538,23 @@ fm_icon_container_compare_icons (BaulIconContainer *container,
                                        (BaulFile *)icon_b);
 }
 
+static gboolean
+fm_icon_container_prepare_icon_for_sort (BaulIconContainer *container,
+                                         BaulIconData      *data)
+{
+    FMIconView *icon_view;
+
+    icon_view = get_icon_view (container);
+    g_return_val_if_fail (icon_view != NULL, FALSE);
+
+    if (FM_ICON_CONTAINER (container)->sort_for_desktop)
+    {
+        return FALSE;
+    }
+
+    return fm_icon_view_prepare_file_for_sort (icon_view, BAUL_FILE (data));
+}
+
 static int
 fm_icon_container_compare_icons_by_name (BaulIconContainer *container G_GNUC_UNUSED,
 					 BaulIconData      *icon_a,
@@ -598,6 +615,7 @@ fm_icon_container_class_init (FMIconContainerClass *klass)
 
     ic_class->compare_icons = fm_icon_container_compare_icons;
     ic_class->compare_icons_by_name = fm_icon_container_compare_icons_by_name;
+    ic_class->prepare_icon_for_sort = fm_icon_container_prepare_icon_for_sort;
     ic_class->freeze_updates = fm_icon_container_freeze_updates;
     ic_class->unfreeze_updates = fm_icon_container_unfreeze_updates;
 
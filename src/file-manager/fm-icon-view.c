@@ -2444,6 +2444,13 @@ fm_icon_view_compare_files (FMIconView   *icon_view,
             icon_view->details->sort_reversed);
 }
 
+gboolean
+fm_icon_view_prepare_file_for_sort (FMIconView   *icon_view,
+                                    BaulFile *file)
+{
+    return baul_file_prepare_for_sort (file, icon_view->details->sort->sort_type);
+}
+
 static int
 compare_files (FMDirectoryView   *icon_view,
                BaulFile *a,
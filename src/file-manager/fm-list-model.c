@@ -34,6 +34,7 @@
 
 #include <libegg/eggtreemultidnd.h>
 
+#include <eel/eel-glib-extensions.h>
 #include <eel/eel-graphic-effects.h>
 
 #include <libbaul-private/baul-dnd.h>
@@ -55,6 +56,14 @@ static GQuark attribute_name_q,
 /* msec delay after Loading... dummy row turns into (empty) */
 #define LOADING_TO_EMPTY_DELAY 100
 
+/* Upper bound for the memory used by the rendered row icons of all
+ * list views together.
+ */
+#define ICON_SURFACE_CACHE_MAX_SIZE (32 * 1024 * 1024)
+
+/* Folders with more rows than this are sorted on several threads. */
+#define PARALLEL_SORT_THRESHOLD 10000
+
 static guint list_model_signals[LAST_SIGNAL] = { 0 };
 
 static int fm_list_model_file_entry_compare_func (gconstpointer a,
@@ -83,7 +92,7 @@ struct FMListModelDetails
 
     GPtrArray *columns;
 
-    GList *highlight_files;
+    GHashTable *highlight_files;
 };
 
 typedef struct
@@ -104,6 +113,14 @@ struct FileEntry
     GSequence *files;
     GSequenceIter *ptr;
     guint loaded : 1;
+
+    /* The icon last rendered for this row, see get_icon_surface () */
+    cairo_surface_t *icon_surface;
+    GList *icon_surface_link;
+    guint icon_surface_generation;
+    int icon_surface_size;
+    int icon_surface_scale;
+    guint icon_surface_highlighted : 1;
 };
 
 G_DEFINE_TYPE_WITH_CODE (FMListModel, fm_list_model, G_TYPE_OBJECT,
@@ -122,9 +139,112 @@ static const CtkTargetEntry drag_types [] =
 
 static CtkTargetList *drag_target_list = NULL;
 
+static gboolean show_icons_in_list_view;
+
+/* Rendered row icons, most recently used first. */
+static GQueue icon_surface_lru = G_QUEUE_INIT;
+static gsize icon_surface_cache_size = 0;
+static guint icon_surface_generation = 0;
+
+static gsize
+get_icon_surface_size (cairo_surface_t *surface)
+{
+    if (cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE)
+    {
+        return 0;
+    }
+
+    return (gsize) cairo_image_surface_get_stride (surface) *
+           cairo_image_surface_get_height (surface);
+}
+
+static void
+file_entry_forget_icon (FileEntry *file_entry)
+{
+    if (file_entry->icon_surface == NULL)
+    {
+        return;
+    }
+
+    icon_surface_cache_size -= get_icon_surface_size (file_entry->icon_surface);
+    g_queue_delete_link (&icon_surface_lru, file_entry->icon_surface_link);
+    file_entry->icon_surface_link = NULL;
+
+    cairo_surface_destroy (file_entry->icon_surface);
+    file_entry->icon_surface = NULL;
+}
+
+static void
+file_entry_remember_icon (FileEntry *file_entry,
+                          cairo_surface_t *surface,
+                          int icon_size,
+                          int icon_scale,
+                          gboolean highlighted)
+{
+    gsize size;
+
+    file_entry_forget_icon (file_entry);
+
+    size = get_icon_surface_size (surface);
+    if (size > ICON_SURFACE_CACHE_MAX_SIZE / 4)
+    {
+        return;
+    }
+
+    file_entry->icon_surface = cairo_surface_reference (surface);
+    file_entry->icon_surface_generation = icon_surface_generation;
+    file_entry->icon_surface_size = icon_size;
+    file_entry->icon_surface_scale = icon_scale;
+    file_entry->icon_surface_highlighted = highlighted;
+
+    g_queue_push_head (&icon_surface_lru, file_entry);
+    file_entry->icon_surface_link = icon_surface_lru.head;
+    icon_surface_cache_size += size;
+
+    while (icon_surface_cache_size > ICON_SURFACE_CACHE_MAX_SIZE)
+    {
+        file_entry_forget_icon (g_queue_peek_tail (&icon_surface_lru));
+    }
+}
+
+static cairo_surface_t *
+file_entry_lookup_icon (FileEntry *file_entry,
+                        int icon_size,
+                        int icon_scale,
+                        gboolean highlighted)
+{
+    if (file_entry->icon_surface == NULL ||
+        file_entry->icon_surface_generation != icon_surface_generation ||
+        file_entry->icon_surface_size != icon_size ||
+        file_entry->icon_surface_scale != icon_scale ||
+        file_entry->icon_surface_highlighted != highlighted)
+    {
+        return NULL;
+    }
+
+    if (file_entry->icon_surface_link != icon_surface_lru.head)
+    {
+        g_queue_unlink (&icon_surface_lru, file_entry->icon_surface_link);
+        g_queue_push_head_link (&icon_surface_lru, file_entry->icon_surface_link);
+    }
+
+    return file_entry->icon_surface;
+}
+
+static void
+icon_theme_changed_callback (CtkIconTheme *icon_theme G_GNUC_UNUSED,
+                             FMListModel *model G_GNUC_UNUSED)
+{
+    /* Makes every cached row icon stale without walking the models;
+     * running once per model does no harm.
+     */
+    icon_surface_generation++;
+}
+
 static void
 file_entry_free (FileEntry *file_entry)
 {
+    file_entry_forget_icon (file_entry);
     baul_file_unref (file_entry->file);
     if (file_entry->reverse_map)
     {
@@ -283,15 +403,101 @@ fm_list_model_get_icon_scale (FMListModel *model)
     return retval;
 }
 
+static cairo_surface_t *
+render_icon_surface (BaulFile *file,
+                     int icon_size,
+                     int icon_scale,
+                     BaulFileIconFlags flags,
+                     gboolean highlighted)
+{
+    GdkPixbuf *icon, *rendered_icon;
+    GIcon *gicon, *emblemed_icon;
+    GList *emblem_icons, *l;
+    BaulIconInfo *icon_info;
+    GEmblem *emblem;
+    BaulFile *parent_file;
+    char *emblems_to_ignore[3];
+    int i;
+    cairo_surface_t *surface;
+    const char *icon_name;
+
+    gicon = baul_file_get_gicon (file, flags);
+
+    /* render emblems with GEmblemedIcon */
+    parent_file = baul_file_get_parent (file);
+    i = 0;
+    emblems_to_ignore[i++] = BAUL_FILE_EMBLEM_NAME_TRASH;
+    if (parent_file) {
+    	if (!baul_file_can_write (parent_file)) {
+            emblems_to_ignore[i++] = BAUL_FILE_EMBLEM_NAME_CANT_WRITE;
+    	}
+    	baul_file_unref (parent_file);
+    }
+    emblems_to_ignore[i++] = NULL;
+
+    emblem = NULL;
+    emblem_icons = baul_file_get_emblem_icons (file,
+    					       emblems_to_ignore);
+
+    if (emblem_icons != NULL) {
+        GIcon *emblem_icon;
+
+        emblem_icon = emblem_icons->data;
+        emblem = g_emblem_new (emblem_icon);
+        emblemed_icon = g_emblemed_icon_new (gicon, emblem);
+
+        g_object_unref (emblem);
+
+    	for (l = emblem_icons->next; l != NULL; l = l->next) {
+    	    emblem_icon = l->data;
+    	    emblem = g_emblem_new (emblem_icon);
+    	    g_emblemed_icon_add_emblem
+    	        (G_EMBLEMED_ICON (emblemed_icon), emblem);
+
+            g_object_unref (emblem);
+    	}
+
+        g_list_free_full (emblem_icons, g_object_unref);
+
+    	g_object_unref (gicon);
+    	gicon = emblemed_icon;
+    }
+
+    icon_info = baul_file_get_icon (file, icon_size, icon_scale, flags);
+    icon_name = baul_icon_info_get_used_name (icon_info);
+
+    if (icon_name != NULL) {
+        g_object_unref (icon_info);
+        icon_info = baul_icon_info_lookup (gicon, icon_size, icon_scale);
+    }
+    icon = baul_icon_info_get_pixbuf_at_size (icon_info, icon_size);
+
+    g_object_unref (icon_info);
+    g_object_unref (gicon);
+
+    if (highlighted)
+    {
+        rendered_icon = eel_create_spotlight_pixbuf (icon);
+
+        if (rendered_icon != NULL)
+        {
+            g_object_unref (icon);
+            icon = rendered_icon;
+        }
+    }
+
+    surface = cdk_cairo_surface_create_from_pixbuf (icon, icon_scale, NULL);
+    g_object_unref (icon);
+
+    return surface;
+}
+
 static void
 fm_list_model_get_value (CtkTreeModel *tree_model, CtkTreeIter *iter, int column, GValue *value)
 {
     FMListModel *model;
     FileEntry *file_entry;
     BaulFile *file;
-    GdkPixbuf *rendered_icon;
-    GIcon *emblemed_icon;
-    GList *emblem_icons, *l;
     BaulZoomLevel zoom_level;
     BaulFileIconFlags flags;
 
@@ -322,7 +528,7 @@ fm_list_model_get_value (CtkTreeModel *tree_model, CtkTreeIter *iter, int column
     case FM_LIST_MODEL_LARGE_ICON_COLUMN:
     case FM_LIST_MODEL_LARGER_ICON_COLUMN:
     case FM_LIST_MODEL_LARGEST_ICON_COLUMN:
-        if (!g_settings_get_boolean (baul_preferences, BAUL_PREFERENCES_SHOW_ICONS_IN_LIST_VIEW)) {
+        if (!show_icons_in_list_view) {
             cairo_surface_t *surface;
             int icon_size;
 
@@ -339,16 +545,9 @@ fm_list_model_get_value (CtkTreeModel *tree_model, CtkTreeIter *iter, int column
 
         if (file != NULL)
         {
-            GdkPixbuf *icon;
-            GIcon *gicon;
-            BaulIconInfo *icon_info;
-            GEmblem *emblem;
             int icon_size, icon_scale;
-            BaulFile *parent_file;
-            char *emblems_to_ignore[3];
-            int i;
+            gboolean highlighted;
             cairo_surface_t *surface;
-            const char *icon_name;
 
             zoom_level = fm_list_model_get_zoom_level_from_column_id (column);
             icon_size = baul_get_icon_size_for_zoom_level (zoom_level);
@@ -380,76 +579,33 @@ fm_list_model_get_value (CtkTreeModel *tree_model, CtkTreeIter *iter, int column
                 }
             }
 
-            gicon = baul_file_get_gicon (file, flags);
-
-            /* render emblems with GEmblemedIcon */
-            parent_file = baul_file_get_parent (file);
-            i = 0;
-            emblems_to_ignore[i++] = BAUL_FILE_EMBLEM_NAME_TRASH;
-            if (parent_file) {
-            	if (!baul_file_can_write (parent_file)) {
-                    emblems_to_ignore[i++] = BAUL_FILE_EMBLEM_NAME_CANT_WRITE;
-            	}
-            	baul_file_unref (parent_file);
-            }
-            emblems_to_ignore[i++] = NULL;
-
-            emblem = NULL;
-            emblem_icons = baul_file_get_emblem_icons (file,
-            					       emblems_to_ignore);
-
-            if (emblem_icons != NULL) {
-                GIcon *emblem_icon;
-
-                emblem_icon = emblem_icons->data;
-                emblem = g_emblem_new (emblem_icon);
-                emblemed_icon = g_emblemed_icon_new (gicon, emblem);
-
-                g_object_unref (emblem);
-
-            	for (l = emblem_icons->next; l != NULL; l = l->next) {
-            	    emblem_icon = l->data;
-            	    emblem = g_emblem_new (emblem_icon);
-            	    g_emblemed_icon_add_emblem
-            	        (G_EMBLEMED_ICON (emblemed_icon), emblem);
-
-                    g_object_unref (emblem);
-            	}
-
-                g_list_free_full (emblem_icons, g_object_unref);
-
-            	g_object_unref (gicon);
-            	gicon = emblemed_icon;
-            }
-
-            icon_info = baul_file_get_icon (file, icon_size, icon_scale, flags);
-            icon_name = baul_icon_info_get_used_name (icon_info);
+            highlighted = model->details->highlight_files != NULL &&
+                          g_hash_table_contains (model->details->highlight_files, file);
 
-            if (icon_name != NULL) {
-                g_object_unref (icon_info);
-                icon_info = baul_icon_info_lookup (gicon, icon_size, icon_scale);
+            /* The drop target icon is short-lived, don't let it
+             * replace the normal one in the cache.
+             */
+            if (flags & BAUL_FILE_ICON_FLAGS_FOR_DRAG_ACCEPT)
+            {
+                surface = render_icon_surface (file, icon_size, icon_scale,
+                                               flags, highlighted);
+                g_value_take_boxed (value, surface);
+                break;
             }
-            icon = baul_icon_info_get_pixbuf_at_size (icon_info, icon_size);
-
-            g_object_unref (icon_info);
-            g_object_unref (gicon);
 
-            if (model->details->highlight_files != NULL &&
-                    g_list_find_custom (model->details->highlight_files,
-                                        file, (GCompareFunc) baul_file_compare_location))
+            surface = file_entry_lookup_icon (file_entry, icon_size, icon_scale,
+                                              highlighted);
+            if (surface != NULL)
             {
-                rendered_icon = eel_create_spotlight_pixbuf (icon);
-
-                if (rendered_icon != NULL)
-                {
-                    g_object_unref (icon);
-                    icon = rendered_icon;
-                }
+                g_value_set_boxed (value, surface);
+                break;
             }
 
-            surface = cdk_cairo_surface_create_from_pixbuf (icon, icon_scale, NULL);
+            surface = render_icon_surface (file, icon_size, icon_scale,
+                                           flags, highlighted);
+            file_entry_remember_icon (file_entry, surface, icon_size, icon_scale,
+                                      highlighted);
             g_value_take_boxed (value, surface);
-            g_object_unref (icon);
         }
         break;
     case FM_LIST_MODEL_FILE_NAME_IS_EDITABLE_COLUMN:
@@ -805,6 +961,56 @@ fm_list_model_compare_func (FMListModel *model,
     return result;
 }
 
+static gboolean
+fm_list_model_sort_file_entries_in_parallel (FMListModel *model,
+                                             GSequence *files,
+                                             GSequenceIter **old_order,
+                                             int length)
+{
+    gpointer *entries;
+    FileEntry *file_entry;
+    GSequenceIter *end;
+    int i;
+
+    if (length < PARALLEL_SORT_THRESHOLD)
+    {
+        return FALSE;
+    }
+
+    /* The other threads must only read the files, so fill in what the
+     * comparisons would otherwise compute on the fly.
+     */
+    entries = g_new (gpointer, length);
+    for (i = 0; i < length; ++i)
+    {
+        file_entry = g_sequence_get (old_order[i]);
+
+        if (file_entry->file != NULL &&
+                !baul_file_prepare_for_sort_by_attribute_q (file_entry->file,
+                        model->details->sort_attribute))
+        {
+            g_free (entries);
+            return FALSE;
+        }
+
+        entries[i] = file_entry;
+    }
+
+    eel_sort_pointers_parallel (entries, length,
+                                fm_list_model_file_entry_compare_func, model);
+
+    end = g_sequence_get_end_iter (files);
+    for (i = 0; i < length; ++i)
+    {
+        file_entry = entries[i];
+        g_sequence_move (file_entry->ptr, end);
+    }
+
+    g_free (entries);
+
+    return TRUE;
+}
+
 static void
 fm_list_model_sort_file_entries (FMListModel *model, GSequence *files, CtkTreePath *path)
 {
@@ -842,7 +1048,10 @@ fm_list_model_sort_file_entries (FMListModel *model, GSequence *files, CtkTreePa
     }
 
     /* sort */
-    g_sequence_sort (files, fm_list_model_file_entry_compare_func, model);
+    if (!fm_list_model_sort_file_entries_in_parallel (model, files, old_order, length))
+    {
+        g_sequence_sort (files, fm_list_model_file_entry_compare_func, model);
+    }
 
     /* generate new order */
     new_order = g_new (int, length);
@@ -1176,6 +1385,7 @@ fm_list_model_file_changed (FMListModel *model, BaulFile *file,
         return;
     }
 
+    file_entry_forget_icon (g_sequence_get (ptr));
 
     pos_before = g_sequence_iter_get_position (ptr);
 
@@ -1704,7 +1914,7 @@ fm_list_model_finalize (GObject *object)
 
     if (model->details->highlight_files != NULL)
     {
-        baul_file_list_free (model->details->highlight_files);
+        g_hash_table_destroy (model->details->highlight_files);
         model->details->highlight_files = NULL;
     }
 
@@ -1723,6 +1933,11 @@ fm_list_model_init (FMListModel *model)
     model->details->stamp = g_random_int ();
     model->details->sort_attribute = 0;
     model->details->columns = g_ptr_array_new ();
+
+    g_signal_connect_object (ctk_icon_theme_get_default (),
+                             "changed",
+                             G_CALLBACK (icon_theme_changed_callback),
+                             model, 0);
 }
 
 static void
@@ -1738,6 +1953,10 @@ fm_list_model_class_init (FMListModelClass *klass)
     object_class->finalize = fm_list_model_finalize;
     object_class->dispose = fm_list_model_dispose;
 
+    eel_g_settings_add_auto_boolean (baul_preferences,
+                                     BAUL_PREFERENCES_SHOW_ICONS_IN_LIST_VIEW,
+                                     &show_icons_in_list_view);
+
     list_model_signals[SUBDIRECTORY_UNLOADED] =
         g_signal_new ("subdirectory_unloaded",
                       FM_TYPE_LIST_MODEL,
@@ -1863,23 +2082,46 @@ refresh_row (gpointer data,
     g_list_free_full (iters, g_free);
 }
 
+static void
+refresh_highlighted_row (gpointer key,
+                         gpointer value G_GNUC_UNUSED,
+                         gpointer user_data)
+{
+    refresh_row (key, user_data);
+}
+
 void
 fm_list_model_set_highlight_for_files (FMListModel *model,
                                        GList *files)
 {
-    if (model->details->highlight_files != NULL)
+    GHashTable *old_highlight_files;
+    GList *l;
+
+    old_highlight_files = model->details->highlight_files;
+    model->details->highlight_files = NULL;
+
+    if (files != NULL)
     {
-        g_list_foreach (model->details->highlight_files,
-                        refresh_row, model);
-        baul_file_list_free (model->details->highlight_files);
-        model->details->highlight_files = NULL;
+        model->details->highlight_files =
+            g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                   (GDestroyNotify) baul_file_unref, NULL);
+        for (l = files; l != NULL; l = l->next)
+        {
+            g_hash_table_add (model->details->highlight_files,
+                              baul_file_ref (l->data));
+        }
     }
 
-    if (files != NULL)
+    if (old_highlight_files != NULL)
     {
-        model->details->highlight_files = baul_file_list_copy (files);
-        g_list_foreach (model->details->highlight_files,
-                        refresh_row, model);
+        g_hash_table_foreach (old_highlight_files,
+                              refresh_highlighted_row, model);
+        g_hash_table_destroy (old_highlight_files);
+    }
 
+    if (model->details->highlight_files != NULL)
+    {
+        g_hash_table_foreach (model->details->highlight_files,
+                              refresh_highlighted_row, model);
     }
 }
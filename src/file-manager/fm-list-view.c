@@ -56,6 +56,7 @@
 #include <libbaul-private/baul-icon-dnd.h>
 #include <libbaul-private/baul-metadata.h>
 #include <libbaul-private/baul-module.h>
+#include <libbaul-private/baul-thumbnails.h>
 #include <libbaul-private/baul-tree-view-drag-dest.h>
 #include <libbaul-private/baul-view-factory.h>
 #include <libbaul-private/baul-clipboard.h>
@@ -114,6 +115,8 @@ struct FMListViewDetails
     gulong clipboard_handler_id;
 
     GQuark last_sort_attr;
+
+    guint prioritize_thumbnails_idle_id;
 };
 
 struct SelectionForeachData
@@ -159,6 +162,8 @@ static void   fm_list_view_rename_callback                 (BaulFile      *file,
         GFile             *result_location,
         GError            *error,
         gpointer           callback_data);
+static void   vadjustment_value_changed_callback           (CtkAdjustment *adjustment,
+        FMListView        *view);
 
 
 G_DEFINE_TYPE_WITH_CODE (FMListView, fm_list_view, FM_TYPE_DIRECTORY_VIEW,
@@ -1891,11 +1896,83 @@ create_and_set_up_tree_view (FMListView *view)
     ctk_widget_show (CTK_WIDGET (view->details->tree_view));
     ctk_container_add (CTK_CONTAINER (view), CTK_WIDGET (view->details->tree_view));
 
+    /* Make the thumbnails of the rows scrolled into view first. */
+    g_signal_connect_object (ctk_scrollable_get_vadjustment (CTK_SCROLLABLE (view->details->tree_view)),
+                             "value-changed",
+                             G_CALLBACK (vadjustment_value_changed_callback), view, 0);
+
 
     atk_obj = ctk_widget_get_accessible (CTK_WIDGET (view->details->tree_view));
     atk_object_set_name (atk_obj, _("List View"));
 }
 
+static gboolean
+prioritize_visible_thumbnails_callback (gpointer callback_data)
+{
+    FMListView *view;
+    CdkRectangle visible_rect, row_area;
+    CtkTreePath *path;
+    BaulFile *file;
+    GList *uris, *l;
+    int bin_x, bin_y, y;
+
+    view = FM_LIST_VIEW (callback_data);
+    view->details->prioritize_thumbnails_idle_id = 0;
+
+    ctk_tree_view_get_visible_rect (view->details->tree_view, &visible_rect);
+    ctk_tree_view_convert_tree_to_bin_window_coords (view->details->tree_view,
+                                                     visible_rect.x, visible_rect.y,
+                                                     &bin_x, &bin_y);
+
+    /* Collect the rows on screen from the top down. */
+    uris = NULL;
+    y = bin_y;
+    while (y < bin_y + visible_rect.height &&
+           ctk_tree_view_get_path_at_pos (view->details->tree_view, bin_x, y,
+                                          &path, NULL, NULL, NULL))
+    {
+        ctk_tree_view_get_background_area (view->details->tree_view,
+                                           path, NULL, &row_area);
+
+        file = fm_list_model_file_for_path (view->details->model, path);
+        if (file != NULL)
+        {
+            if (baul_file_is_thumbnailing (file))
+            {
+                uris = g_list_prepend (uris, baul_file_get_uri (file));
+            }
+            baul_file_unref (file);
+        }
+        ctk_tree_path_free (path);
+
+        if (row_area.height <= 0)
+        {
+            break;
+        }
+        y = row_area.y + row_area.height;
+    }
+
+    /* The last file to hurry is made first, so go from the bottom up. */
+    for (l = uris; l != NULL; l = l->next)
+    {
+        baul_thumbnail_prioritize (l->data);
+    }
+    g_list_free_full (uris, g_free);
+
+    return FALSE;
+}
+
+static void
+vadjustment_value_changed_callback (CtkAdjustment *adjustment G_GNUC_UNUSED,
+                                    FMListView    *view)
+{
+    if (view->details->prioritize_thumbnails_idle_id == 0)
+    {
+        view->details->prioritize_thumbnails_idle_id =
+            g_idle_add (prioritize_visible_thumbnails_callback, view);
+    }
+}
+
 static void
 fm_list_view_add_file (FMDirectoryView *view, BaulFile *file, BaulDirectory *directory)
 {
@@ -3146,6 +3223,12 @@ fm_list_view_dispose (GObject *object)
         list_view->details->renaming_file_activate_timeout = 0;
     }
 
+    if (list_view->details->prioritize_thumbnails_idle_id != 0)
+    {
+        g_source_remove (list_view->details->prioritize_thumbnails_idle_id);
+        list_view->details->prioritize_thumbnails_idle_id = 0;
+    }
+
     if (list_view->details->clipboard_handler_id != 0)
     {
         g_signal_handler_disconnect (baul_clipboard_monitor_get (),
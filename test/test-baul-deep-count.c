@@ -0,0 +1,145 @@
+#include <config.h>
+
+#include <ctk/ctk.h>
+#include <glib/gstdio.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <libbaul-private/baul-file.h>
+#include <libbaul-private/baul-file-attributes.h>
+
+/* Deep-counts a synthetic tree and reports time and peak RSS.
+ *
+ * Usage: test-baul-deep-count [number of entries]
+ */
+
+#define DEFAULT_ENTRY_COUNT 500000
+#define ENTRIES_PER_DIRECTORY 1000
+#define HARD_LINK_EVERY 100
+
+static gint64 start_time;
+
+static void
+create_tree (const char *root,
+	     int         entry_count)
+{
+	char *dir, *path, *previous;
+	int i, fd;
+
+	dir = NULL;
+	previous = NULL;
+	for (i = 0; i < entry_count; i++) {
+		if (i % ENTRIES_PER_DIRECTORY == 0) {
+			g_free (dir);
+			dir = g_strdup_printf ("%s/dir%06d", root, i / ENTRIES_PER_DIRECTORY);
+			g_mkdir (dir, 0755);
+			g_clear_pointer (&previous, g_free);
+			continue;
+		}
+
+		path = g_strdup_printf ("%s/file%06d", dir, i);
+		if (previous != NULL && i % HARD_LINK_EVERY == 0) {
+			/* Hard links must only be counted once. */
+			if (link (previous, path) != 0) {
+				g_printerr ("could not link %s\n", path);
+			}
+		} else {
+			fd = g_open (path, O_CREAT | O_WRONLY, 0644);
+			if (fd >= 0) {
+				if (write (fd, "baul", 4) != 4) {
+					g_printerr ("could not write %s\n", path);
+				}
+				close (fd);
+			}
+		}
+		g_free (previous);
+		previous = path;
+	}
+	g_free (previous);
+	g_free (dir);
+}
+
+static void
+remove_tree (const char *path)
+{
+	GDir *dir;
+	const char *name;
+	char *child;
+
+	dir = g_dir_open (path, 0, NULL);
+	if (dir != NULL) {
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			child = g_build_filename (path, name, NULL);
+			remove_tree (child);
+			g_free (child);
+		}
+		g_dir_close (dir);
+	}
+	g_remove (path);
+}
+
+static void
+deep_count_done (BaulFile *file,
+		 gpointer  callback_data G_GNUC_UNUSED)
+{
+	guint directory_count, file_count, unreadable_count;
+	goffset total_size, total_size_on_disk;
+	struct rusage usage;
+
+	baul_file_get_deep_counts (file,
+				   &directory_count, &file_count, &unreadable_count,
+				   &total_size, &total_size_on_disk,
+				   FALSE);
+	getrusage (RUSAGE_SELF, &usage);
+
+	g_print ("deep count: %u directories, %u files, %" G_GOFFSET_FORMAT " bytes\n",
+		 directory_count, file_count, total_size);
+	g_print ("time: %.3f s\n",
+		 (g_get_monotonic_time () - start_time) / (double) G_USEC_PER_SEC);
+	g_print ("peak RSS: %ld KiB\n", usage.ru_maxrss);
+
+	ctk_main_quit ();
+}
+
+int
+main (int argc, char **argv)
+{
+	BaulFile *file;
+	GFile *location;
+	char *root;
+	int entry_count;
+
+	ctk_init (&argc, &argv);
+
+	entry_count = DEFAULT_ENTRY_COUNT;
+	if (argc > 1) {
+		entry_count = atoi (argv[1]);
+	}
+
+	root = g_dir_make_tmp ("baul-deep-count-XXXXXX", NULL);
+	if (root == NULL) {
+		g_printerr ("could not create a temporary directory\n");
+		return 1;
+	}
+
+	g_print ("creating %d entries in %s\n", entry_count, root);
+	create_tree (root, entry_count);
+
+	location = g_file_new_for_path (root);
+	file = baul_file_get (location);
+	g_object_unref (location);
+
+	start_time = g_get_monotonic_time ();
+	baul_file_call_when_ready (file,
+				   BAUL_FILE_ATTRIBUTE_DEEP_COUNTS,
+				   deep_count_done, NULL);
+	ctk_main ();
+
+	baul_file_unref (file);
+	remove_tree (root);
+	g_free (root);
+
+	return 0;
+}
@@ -1,4 +1,8 @@
 #include <ctk/ctk.h>
+#include <glib/gstdio.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <libbaul-private/baul-directory.h>
@@ -76,6 +80,115 @@ done_loading (BaulDirectory *directory)
 	}
 }
 
+/* Benchmark mode: test-baul-directory-async --benchmark [entries...]
+ *
+ * Loads directories with the given number of entries (10k, 100k and 1M
+ * by default) and reports the time until the first files are added,
+ * which is when a view can first paint, and the time until the
+ * directory is done loading.
+ */
+
+static gint64 benchmark_start;
+static gint64 benchmark_first_paint;
+
+static void
+benchmark_files_added (BaulDirectory *directory G_GNUC_UNUSED,
+		       GList         *added_files G_GNUC_UNUSED)
+{
+	if (benchmark_first_paint == 0) {
+		benchmark_first_paint = g_get_monotonic_time ();
+	}
+}
+
+static void
+benchmark_done_loading (BaulDirectory *directory G_GNUC_UNUSED)
+{
+	ctk_main_quit ();
+}
+
+static char *
+benchmark_create_directory (int entry_count)
+{
+	char *root, *path;
+	int i, fd;
+
+	root = g_dir_make_tmp ("baul-directory-async-XXXXXX", NULL);
+	if (root == NULL) {
+		return NULL;
+	}
+
+	for (i = 0; i < entry_count; i++) {
+		path = g_strdup_printf ("%s/IMG_%07d.JPG", root, i);
+		fd = g_open (path, O_CREAT | O_WRONLY, 0644);
+		if (fd >= 0) {
+			close (fd);
+		}
+		g_free (path);
+	}
+
+	return root;
+}
+
+static void
+benchmark_remove_directory (const char *root)
+{
+	GDir *dir;
+	const char *name;
+	char *path;
+
+	dir = g_dir_open (root, 0, NULL);
+	if (dir != NULL) {
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			path = g_build_filename (root, name, NULL);
+			g_remove (path);
+			g_free (path);
+		}
+		g_dir_close (dir);
+	}
+	g_rmdir (root);
+}
+
+static void
+benchmark (int entry_count)
+{
+	BaulDirectory *directory;
+	GFile *location;
+	char *root;
+
+	root = benchmark_create_directory (entry_count);
+	if (root == NULL) {
+		g_printerr ("could not create a temporary directory\n");
+		return;
+	}
+
+	location = g_file_new_for_path (root);
+	directory = baul_directory_get (location);
+	g_object_unref (location);
+
+	g_signal_connect (directory, "files-added", G_CALLBACK (benchmark_files_added), NULL);
+	g_signal_connect (directory, "done-loading", G_CALLBACK (benchmark_done_loading), NULL);
+
+	benchmark_first_paint = 0;
+	benchmark_start = g_get_monotonic_time ();
+	baul_directory_file_monitor_add (directory, client1, TRUE,
+					 BAUL_FILE_ATTRIBUTE_INFO,
+					 NULL, NULL);
+	ctk_main ();
+
+	g_print ("%d entries: first paint %.3f s, done %.3f s\n",
+		 entry_count,
+		 (benchmark_first_paint - benchmark_start) / (double) G_USEC_PER_SEC,
+		 (g_get_monotonic_time () - benchmark_start) / (double) G_USEC_PER_SEC);
+
+	baul_directory_file_monitor_remove (directory, client1);
+	g_signal_handlers_disconnect_by_func (directory, benchmark_files_added, NULL);
+	g_signal_handlers_disconnect_by_func (directory, benchmark_done_loading, NULL);
+	baul_directory_unref (directory);
+
+	benchmark_remove_directory (root);
+	g_free (root);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -86,6 +199,20 @@ main (int argc, char **argv)
 
 	ctk_init (&argc, &argv);
 
+	if (argc > 1 && strcmp (argv[1], "--benchmark") == 0) {
+		int i;
+
+		if (argc == 2) {
+			benchmark (10000);
+			benchmark (100000);
+			benchmark (1000000);
+		}
+		for (i = 2; i < argc; i++) {
+			benchmark (atoi (argv[i]));
+		}
+		return 0;
+	}
+
 	query = baul_query_new ();
 	baul_query_set_text (query, "richard hult");
 	directory = baul_directory_get_by_uri ("x-baul-search://0/");
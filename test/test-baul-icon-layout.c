@@ -0,0 +1,232 @@
+/* Lays out a big icon container and reports how often the main loop
+ * was blocked for longer than a frame while doing it.
+ *
+ * Usage: test-baul-icon-layout [number of icons]
+ */
+
+#include <stdlib.h>
+
+#include <libbaul-private/baul-icon-container.h>
+#include <libbaul-private/baul-icon-private.h>
+#include <libbaul-private/baul-icon-info.h>
+
+#include "test.h"
+
+#define FRAME_BUDGET_USEC 16667
+
+typedef struct {
+	char *name;
+	char *info;
+} TestItem;
+
+typedef BaulIconContainer TestContainer;
+typedef BaulIconContainerClass TestContainerClass;
+
+static GType test_container_get_type (void);
+
+G_DEFINE_TYPE (TestContainer, test_container, BAUL_TYPE_ICON_CONTAINER);
+
+static GdkPixbuf *test_pixbuf;
+
+static BaulIconInfo *
+test_container_get_icon_images (BaulIconContainer *container G_GNUC_UNUSED,
+				BaulIconData      *data G_GNUC_UNUSED,
+				int                icon_size G_GNUC_UNUSED,
+				GList            **emblem_pixbufs G_GNUC_UNUSED,
+				char             **embedded_text G_GNUC_UNUSED,
+				gboolean           for_drag_accept G_GNUC_UNUSED,
+				gboolean           need_large_embeddded_text G_GNUC_UNUSED,
+				gboolean          *embedded_text_needs_loading,
+				gboolean          *has_window_open)
+{
+	*embedded_text_needs_loading = FALSE;
+	*has_window_open = FALSE;
+
+	return baul_icon_info_new_for_pixbuf (test_pixbuf, 1);
+}
+
+static void
+test_container_get_icon_text (BaulIconContainer *container G_GNUC_UNUSED,
+			      BaulIconData      *data,
+			      char             **editable_text,
+			      char             **additional_text,
+			      gboolean           include_invisible G_GNUC_UNUSED)
+{
+	TestItem *item;
+
+	item = (TestItem *) data;
+
+	*editable_text = g_strdup (item->name);
+	if (additional_text != NULL) {
+		*additional_text = g_strdup (item->info);
+	}
+}
+
+static int
+test_container_compare_icons (BaulIconContainer *container G_GNUC_UNUSED,
+			      BaulIconData      *icon_a,
+			      BaulIconData      *icon_b)
+{
+	return g_strcmp0 (((TestItem *) icon_a)->name, ((TestItem *) icon_b)->name);
+}
+
+static void
+test_container_do_nothing (BaulIconContainer *container G_GNUC_UNUSED)
+{
+}
+
+static void
+test_container_prioritize_thumbnailing (BaulIconContainer *container G_GNUC_UNUSED,
+					BaulIconData      *data G_GNUC_UNUSED)
+{
+}
+
+static void
+test_container_class_init (TestContainerClass *class)
+{
+	class->get_icon_images = test_container_get_icon_images;
+	class->get_icon_text = test_container_get_icon_text;
+	class->compare_icons = test_container_compare_icons;
+	class->compare_icons_by_name = test_container_compare_icons;
+	class->freeze_updates = test_container_do_nothing;
+	class->unfreeze_updates = test_container_do_nothing;
+	class->prioritize_thumbnailing = test_container_prioritize_thumbnailing;
+}
+
+static void
+test_container_init (TestContainer *container G_GNUC_UNUSED)
+{
+}
+
+/* Watches how long the main loop goes without running its sources. */
+typedef struct {
+	gint64 last_tick;
+	guint n_overruns;
+	gint64 longest_stall;
+} FrameWatch;
+
+static gboolean
+frame_watch_tick (gpointer callback_data)
+{
+	FrameWatch *watch;
+	gint64 now, stall;
+
+	watch = callback_data;
+	now = g_get_monotonic_time ();
+	stall = now - watch->last_tick;
+
+	if (stall > FRAME_BUDGET_USEC) {
+		watch->n_overruns++;
+	}
+	watch->longest_stall = MAX (watch->longest_stall, stall);
+	watch->last_tick = now;
+
+	return TRUE;
+}
+
+static gboolean
+layout_is_done (BaulIconContainer *container)
+{
+	return container->details->idle_id == 0 &&
+		container->details->layout_idle_id == 0;
+}
+
+static void
+run_step (const char *name,
+	  BaulIconContainer *container)
+{
+	FrameWatch watch = { 0 };
+	gint64 start;
+	guint tick_id;
+
+	start = g_get_monotonic_time ();
+	watch.last_tick = start;
+	tick_id = g_timeout_add_full (G_PRIORITY_HIGH, 1, frame_watch_tick, &watch, NULL);
+
+	/* Let the layout get scheduled before waiting for it. */
+	ctk_main_iteration_do (FALSE);
+	while (!layout_is_done (container)) {
+		ctk_main_iteration ();
+	}
+	while (ctk_events_pending ()) {
+		ctk_main_iteration ();
+	}
+
+	g_source_remove (tick_id);
+	frame_watch_tick (&watch);
+
+	g_print ("%-10s %8.1f ms, %4u frame budget overruns, longest stall %6.1f ms\n",
+		 name,
+		 (g_get_monotonic_time () - start) / 1000.0,
+		 watch.n_overruns,
+		 watch.longest_stall / 1000.0);
+}
+
+int
+main (int argc, char* argv[])
+{
+	CtkWidget *window, *scroller, *container;
+	TestItem *items;
+	int n_items, i;
+
+	test_init (&argc, &argv);
+
+	n_items = argc > 1 ? atoi (argv[1]) : 20000;
+	if (n_items <= 0) {
+		g_printerr ("Usage: %s [number of icons]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	test_pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, 48, 48);
+	gdk_pixbuf_fill (test_pixbuf, 0x3465a4ff);
+
+	window = test_window_new ("Icon Layout Test", 0);
+	ctk_window_set_default_size (CTK_WINDOW (window), 800, 600);
+
+	scroller = ctk_scrolled_window_new (NULL, NULL);
+	ctk_scrolled_window_set_policy (CTK_SCROLLED_WINDOW (scroller),
+					CTK_POLICY_NEVER,
+					CTK_POLICY_AUTOMATIC);
+	ctk_container_add (CTK_CONTAINER (window), scroller);
+
+	container = g_object_new (test_container_get_type (), NULL);
+	baul_icon_container_set_auto_layout (BAUL_ICON_CONTAINER (container), TRUE);
+	ctk_container_add (CTK_CONTAINER (scroller), container);
+
+	ctk_widget_show_all (window);
+	while (ctk_events_pending ()) {
+		ctk_main_iteration ();
+	}
+
+	items = g_new (TestItem, n_items);
+	for (i = 0; i < n_items; i++) {
+		/* Vary the label lengths, so lines have different heights. */
+		items[i].name = g_strdup_printf ("file %06d%s.txt", i,
+						 i % 7 == 0 ? " with a much longer name that wraps" : "");
+		items[i].info = g_strdup_printf ("%d kB", i % 1000);
+		baul_icon_container_add (BAUL_ICON_CONTAINER (container),
+					 (BaulIconData *) &items[i]);
+	}
+
+	g_print ("Laying out %d icons\n", n_items);
+
+	run_step ("add", BAUL_ICON_CONTAINER (container));
+
+	ctk_window_resize (CTK_WINDOW (window), 1100, 700);
+	run_step ("resize", BAUL_ICON_CONTAINER (container));
+
+	baul_icon_container_set_zoom_level (BAUL_ICON_CONTAINER (container),
+					    BAUL_ZOOM_LEVEL_LARGER);
+	run_step ("zoom", BAUL_ICON_CONTAINER (container));
+
+	ctk_widget_destroy (window);
+
+	for (i = 0; i < n_items; i++) {
+		g_free (items[i].name);
+		g_free (items[i].info);
+	}
+	g_free (items);
+	g_object_unref (test_pixbuf);
+
+	return test_quit (EXIT_SUCCESS);
+}
@@ -0,0 +1,99 @@
+/* Times the eel graphic effects on icons of the usual sizes.
+ *
+ * Usage: test-eel-graphic-effects [iterations]
+ */
+
+#include <stdlib.h>
+
+#include <eel/eel-graphic-effects.h>
+
+#include "test.h"
+
+static const int sizes[] = { 16, 24, 32, 48, 64, 96, 128, 256 };
+
+static GdkPixbuf *
+new_icon_pixbuf (int size)
+{
+	GdkPixbuf *pixbuf;
+	guchar *pixels;
+	int i, n_bytes;
+
+	pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, size, size);
+	pixels = gdk_pixbuf_get_pixels (pixbuf);
+	n_bytes = gdk_pixbuf_get_rowstride (pixbuf) * size;
+	for (i = 0; i < n_bytes; i++) {
+		pixels[i] = (i * 97) & 0xff;
+	}
+
+	return pixbuf;
+}
+
+static void
+print_time (const char *name,
+	    int size,
+	    int iterations,
+	    gint64 start)
+{
+	double usecs;
+
+	usecs = (double) (g_get_monotonic_time () - start) / iterations;
+	g_print ("%-10s %4dpx %9.2f usecs %8.1f Mpixels/s\n",
+		 name, size, usecs, size * size / usecs);
+}
+
+int
+main (int argc, char* argv[])
+{
+	GdkPixbuf *pixbuf, *result;
+	cairo_surface_t *surface, *result_surface;
+	CdkRGBA color = { 0.3, 0.5, 0.9, 1.0 };
+	gint64 start;
+	guint s;
+	int i, iterations;
+
+	test_init (&argc, &argv);
+
+	iterations = argc > 1 ? atoi (argv[1]) : 2000;
+	if (iterations <= 0) {
+		g_printerr ("Usage: %s [iterations]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	for (s = 0; s < G_N_ELEMENTS (sizes); s++) {
+		pixbuf = new_icon_pixbuf (sizes[s]);
+		surface = cdk_cairo_surface_create_from_pixbuf (pixbuf, 1, NULL);
+
+		start = g_get_monotonic_time ();
+		for (i = 0; i < iterations; i++) {
+			result = eel_create_spotlight_pixbuf (pixbuf);
+			g_object_unref (result);
+		}
+		print_time ("spotlight", sizes[s], iterations, start);
+
+		start = g_get_monotonic_time ();
+		for (i = 0; i < iterations; i++) {
+			result_surface = eel_create_spotlight_surface (surface, 1);
+			cairo_surface_destroy (result_surface);
+		}
+		print_time ("surface", sizes[s], iterations, start);
+
+		start = g_get_monotonic_time ();
+		for (i = 0; i < iterations; i++) {
+			result = eel_create_darkened_pixbuf (pixbuf, 128, 200);
+			g_object_unref (result);
+		}
+		print_time ("darkened", sizes[s], iterations, start);
+
+		start = g_get_monotonic_time ();
+		for (i = 0; i < iterations; i++) {
+			result = eel_create_colorized_pixbuf (pixbuf, &color);
+			g_object_unref (result);
+		}
+		print_time ("colorized", sizes[s], iterations, start);
+
+		cairo_surface_destroy (surface);
+		g_object_unref (pixbuf);
+	}
+
+	return test_quit (EXIT_SUCCESS);
+}